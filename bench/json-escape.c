@@ -0,0 +1,122 @@
+/**
+ * JSON escaping microbenchmark
+ *
+ * Compares json_escape() against a naive byte-at-a-time escaper on a few
+ * megabytes of log-like text and on text with no escapes at all, and
+ * reports input throughput in GB/s.
+ *
+ *   cc -O2 -Isrc bench/json-escape.c src/json.c -o json-escape-bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "util.h"
+
+#define INPUT_SIZE (8u << 20)
+#define ROUNDS 20
+
+// The escaper the NDJSON output started out with, short escapes as
+// json_escape() writes them
+static size_t
+escape_naive(char *dst, const char *src, size_t len)
+{
+    size_t out = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = src[i];
+        if (ch == '"' || ch == '\\') {
+            dst[out++] = '\\';
+            dst[out++] = ch;
+        } else if (ch == '\b' || ch == '\f' || ch == '\n' || ch == '\r' || ch == '\t') {
+            dst[out++] = '\\';
+            dst[out++] = "btn?fr"[ch - '\b']; // \b \t \n \v \f \r
+        } else if (ch < 0x20) {
+            out += sprintf(dst + out, "\\u%04x", ch);
+        } else {
+            dst[out++] = ch;
+        }
+    }
+    return out;
+}
+
+static void
+fill_log_text(char *buf, size_t len)
+{
+    static const char line[] =
+        "2026-01-01T12:00:00Z INFO worker[42]: request \"GET /api/v1/items\" "
+        "took 12ms\tstatus=200 path=C:\\\\tmp\r\n"
+        "2026-01-01T12:00:01Z DEBUG worker[42]: raw \b\f\x01\x1f bytes\n";
+
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = line[i % (sizeof(line) - 1)];
+    }
+}
+
+static void
+fill_plain_text(char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = 'a' + i % 26;
+    }
+}
+
+static double
+gbps(size_t bytes, uint64_t ns)
+{
+    return (double)bytes * ROUNDS / (double)ns;
+}
+
+static void
+run(const char *name, const char *src, size_t len, char *dst, char *check)
+{
+    size_t naive_len = 0;
+    size_t fast_len = 0;
+    size_t consumed;
+
+    uint64_t start = clock_ns(CLOCK_MONOTONIC);
+    for (int r = 0; r < ROUNDS; r++) {
+        naive_len = escape_naive(check, src, len);
+    }
+    uint64_t naive_ns = clock_ns(CLOCK_MONOTONIC) - start;
+
+    start = clock_ns(CLOCK_MONOTONIC);
+    for (int r = 0; r < ROUNDS; r++) {
+        fast_len = json_escape(dst, len * 6, src, len, &consumed);
+    }
+    uint64_t fast_ns = clock_ns(CLOCK_MONOTONIC) - start;
+
+    if (fast_len != naive_len || memcmp(dst, check, fast_len) != 0) {
+        fprintf(stderr, "%s: output mismatch\n", name);
+        exit(1);
+    }
+
+    printf("%-6s naive %6.2f GB/s   %-6s %6.2f GB/s   speedup %.1fx\n",
+           name, gbps(len, naive_ns), json_escape_isa(), gbps(len, fast_ns),
+           (double)naive_ns / (double)fast_ns);
+}
+
+int
+main(void)
+{
+    char *src = malloc(INPUT_SIZE);
+    char *dst = malloc(INPUT_SIZE * 6);
+    char *check = malloc(INPUT_SIZE * 6);
+    if (!src || !dst || !check) {
+        perror("malloc");
+        return 1;
+    }
+
+    fill_log_text(src, INPUT_SIZE);
+    run("log", src, INPUT_SIZE, dst, check);
+
+    fill_plain_text(src, INPUT_SIZE);
+    run("plain", src, INPUT_SIZE, dst, check);
+
+    free(src);
+    free(dst);
+    free(check);
+    return 0;
+}
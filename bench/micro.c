@@ -0,0 +1,531 @@
+/**
+ * Capture path microbenchmarks
+ *
+ * One binary for the data paths a capture goes through once its bytes
+ * arrive: draining the offer pipe into a memfd, framing records for
+ * stdout, hashing, appending to the history and looking captures up in
+ * its index. Every benchmark runs a fixed batch per repetition after a
+ * few warmup runs; the median is what gets compared.
+ *
+ * -j writes the results as JSON, and -b compares against a JSON file
+ * written earlier. Any benchmark slower than the baseline by more than
+ * -t percent makes the exit status 1, so CI can keep a stored baseline
+ * and fail on regressions. Pin to a core with -c for stable numbers.
+ *
+ *   zig build bench -- -r 20 -c 2 -j results.json -b baseline.json
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "event-loop.h"
+#include "hash.h"
+#include "history.h"
+#include "output.h"
+#include "payload.h"
+#include "sink.h"
+#include "util.h"
+
+#define MAX_REPS 1000
+#define DRAIN_SIZE (64u << 20)
+#define HISTORY_SIZE 100
+#define HISTORY_PAYLOADS 1024
+
+struct bench {
+    const char *name;
+    void (*setup)(void);
+    // One repetition, returns the bytes it processed
+    uint64_t (*run)(void);
+    void (*teardown)(void);
+    uint64_t ops; // Operations per repetition
+};
+
+struct result {
+    const struct bench *bench;
+    int reps;
+    uint64_t bytes;
+    uint64_t min_ns;
+    uint64_t median_ns;
+    uint64_t mean_ns;
+};
+
+// Results are compared against these only if the compiler keeps the work
+static volatile uint64_t sink_value;
+
+static char *text_block;
+
+static char *
+make_text(size_t size)
+{
+    char *text = malloc(size);
+    if (!text) {
+        perror("malloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < size; i++) {
+        text[i] = (i % 72 == 71) ? '\n' : (i % 9 == 8) ? '"' : 'a' + i % 26;
+    }
+    return text;
+}
+
+static struct payload *
+make_payload(const char *mime_type, const void *data, size_t size)
+{
+    struct payload *payload = payload_create(mime_type);
+    int fds[2];
+
+    if (!payload || pipe2(fds, O_CLOEXEC) == -1) {
+        perror("payload");
+        exit(1);
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, 1 << 20);
+    for (size_t off = 0; off < size;) {
+        size_t n = size - off < 65536 ? size - off : 65536;
+        if (write(fds[1], (const char *)data + off, n) != (ssize_t)n ||
+            payload_read_from(payload, fds[0], n) != (ssize_t)n) {
+            perror("payload");
+            exit(1);
+        }
+        off += n;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    if (payload_seal(payload) == -1) {
+        perror("payload_seal");
+        exit(1);
+    }
+    payload->hash = hash64(payload->data, payload->size, 0);
+    return payload;
+}
+
+// Pipe drain: a producer thread fills the offer pipe, we move it into a memfd
+
+static void *
+produce(void *data)
+{
+    int fd = (intptr_t)data;
+
+    for (size_t left = DRAIN_SIZE; left > 0;) {
+        size_t n = left < 65536 ? left : 65536;
+        ssize_t w = write(fd, text_block, n);
+        if (w <= 0) {
+            break;
+        }
+        left -= w;
+    }
+    close(fd);
+    return NULL;
+}
+
+static uint64_t
+run_pipe_drain(void)
+{
+    struct payload *payload = payload_create("text/plain");
+    pthread_t producer;
+    int fds[2];
+
+    if (!payload || pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe_drain");
+        exit(1);
+    }
+    fcntl(fds[0], F_SETPIPE_SZ, 1 << 20);
+    pthread_create(&producer, NULL, produce, (void *)(intptr_t)fds[1]);
+
+    ssize_t n;
+    while ((n = payload_read_from(payload, fds[0], 1 << 20)) != 0) {
+        if (n == -1 && errno != EINTR) {
+            perror("payload_read_from");
+            exit(1);
+        }
+    }
+    pthread_join(producer, NULL);
+    close(fds[0]);
+
+    uint64_t size = payload->size;
+    payload_unref(payload);
+    return size;
+}
+
+// Output framing into /dev/null through the non-blocking sink
+
+#define FRAMING_RECORDS 256
+
+static struct event_loop *framing_loop;
+static struct sink framing_sink;
+static struct output framing_output;
+static struct payload *framing_payload;
+
+static void
+setup_framing(enum output_format format)
+{
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    framing_loop = event_loop_create();
+    if (fd == -1 || !framing_loop || sink_init(&framing_sink, framing_loop, fd, 4 << 20) == -1) {
+        perror("framing");
+        exit(1);
+    }
+    output_init(&framing_output, &framing_sink, format);
+    framing_payload = make_payload("text/plain;charset=utf-8", text_block, 64 << 10);
+    // ASCII, as the pipeline would have found it: NDJSON escapes it as text
+    framing_payload->analyzed = true;
+    framing_payload->utf8 = true;
+}
+
+static void setup_framing_raw(void) { setup_framing(OUTPUT_RAW); }
+static void setup_framing_binary(void) { setup_framing(OUTPUT_BINARY); }
+static void setup_framing_ndjson(void) { setup_framing(OUTPUT_NDJSON); }
+
+static uint64_t
+run_framing(void)
+{
+    for (int i = 0; i < FRAMING_RECORDS; i++) {
+        if (output_write_payload(&framing_output, framing_payload) == -1) {
+            perror("output_write_payload");
+            exit(1);
+        }
+    }
+    return (uint64_t)FRAMING_RECORDS * framing_payload->size;
+}
+
+static void
+teardown_framing(void)
+{
+    int fd = framing_sink.fd;
+
+    payload_unref(framing_payload);
+    output_finish(&framing_output);
+    sink_finish(&framing_sink);
+    event_loop_destroy(framing_loop);
+    close(fd);
+}
+
+// Hashing, bulk and clipboard-sized
+
+#define HASH_BULK_SIZE (16u << 20)
+#define HASH_SMALL_SIZE 64
+#define HASH_SMALL_COUNT 100000
+
+static uint64_t
+run_hash_bulk(void)
+{
+    sink_value = hash64(text_block, HASH_BULK_SIZE, 0);
+    return HASH_BULK_SIZE;
+}
+
+static uint64_t
+run_hash_small(void)
+{
+    uint64_t h = 0;
+
+    for (int i = 0; i < HASH_SMALL_COUNT; i++) {
+        h ^= hash64(text_block + (i & 4095), HASH_SMALL_SIZE, h);
+    }
+    sink_value = h;
+    return (uint64_t)HASH_SMALL_COUNT * HASH_SMALL_SIZE;
+}
+
+// History append with eviction, and index lookups
+
+static struct history bench_history;
+static struct payload *history_payloads[HISTORY_PAYLOADS];
+
+static void
+setup_history(void)
+{
+    char buf[256];
+
+    if (history_init(&bench_history, HISTORY_SIZE) == -1) {
+        perror("history_init");
+        exit(1);
+    }
+    for (int i = 0; i < HISTORY_PAYLOADS; i++) {
+        int len = snprintf(buf, sizeof(buf), "clipboard entry %d %.*s", i, 128, text_block);
+        history_payloads[i] = make_payload("text/plain;charset=utf-8", buf, len);
+    }
+    // Lookups run against a full history
+    for (int i = 0; i < HISTORY_SIZE; i++) {
+        history_append(&bench_history, history_payloads[i]);
+    }
+}
+
+static uint64_t
+run_history_append(void)
+{
+    uint64_t bytes = 0;
+
+    for (int i = 0; i < HISTORY_PAYLOADS; i++) {
+        history_append(&bench_history, history_payloads[i]);
+        bytes += history_payloads[i]->size;
+    }
+    return bytes;
+}
+
+// Half of the payloads are in the history after setup, half are not
+static uint64_t
+run_history_lookup(void)
+{
+    uint64_t bytes = 0;
+    uint64_t hits = 0;
+
+    for (int i = 0; i < 2 * HISTORY_SIZE; i++) {
+        hits += history_find(&bench_history, history_payloads[i]) != NULL;
+        bytes += history_payloads[i]->size;
+    }
+    sink_value = hits;
+    return bytes;
+}
+
+static void
+teardown_history(void)
+{
+    history_finish(&bench_history);
+    for (int i = 0; i < HISTORY_PAYLOADS; i++) {
+        payload_unref(history_payloads[i]);
+    }
+}
+
+static const struct bench benches[] = {
+    { "pipe_drain", NULL, run_pipe_drain, NULL, 1 },
+    { "framing_raw", setup_framing_raw, run_framing, teardown_framing, FRAMING_RECORDS },
+    { "framing_binary", setup_framing_binary, run_framing, teardown_framing, FRAMING_RECORDS },
+    { "framing_ndjson", setup_framing_ndjson, run_framing, teardown_framing, FRAMING_RECORDS },
+    { "hash_bulk", NULL, run_hash_bulk, NULL, 1 },
+    { "hash_small", NULL, run_hash_small, NULL, HASH_SMALL_COUNT },
+    { "history_append", setup_history, run_history_append, teardown_history, HISTORY_PAYLOADS },
+    { "history_lookup", setup_history, run_history_lookup, teardown_history, 2 * HISTORY_SIZE },
+};
+
+static int
+compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void
+measure(const struct bench *bench, int warmup, int reps, struct result *result)
+{
+    static uint64_t times[MAX_REPS];
+    uint64_t total = 0;
+
+    if (bench->setup) {
+        bench->setup();
+    }
+    for (int i = 0; i < warmup; i++) {
+        bench->run();
+    }
+    for (int i = 0; i < reps; i++) {
+        uint64_t start = clock_ns(CLOCK_MONOTONIC);
+        result->bytes = bench->run();
+        times[i] = clock_ns(CLOCK_MONOTONIC) - start;
+        total += times[i];
+    }
+    if (bench->teardown) {
+        bench->teardown();
+    }
+
+    qsort(times, reps, sizeof(times[0]), compare_u64);
+    result->bench = bench;
+    result->reps = reps;
+    result->min_ns = times[0];
+    result->median_ns = times[reps / 2];
+    result->mean_ns = total / reps;
+}
+
+static void
+write_json(FILE *out, const struct result *results, int count, int cpu, int warmup)
+{
+    fprintf(out, "{\n  \"cpu\": %d,\n  \"warmup\": %d,\n  \"benchmarks\": [\n", cpu, warmup);
+    for (int i = 0; i < count; i++) {
+        const struct result *r = &results[i];
+        fprintf(out,
+                "    {\"name\": \"%s\", \"reps\": %d, \"ops\": %llu, \"bytes\": %llu, "
+                "\"min_ns\": %llu, \"median_ns\": %llu, \"mean_ns\": %llu}%s\n",
+                r->bench->name, r->reps, (unsigned long long)r->bench->ops,
+                (unsigned long long)r->bytes, (unsigned long long)r->min_ns,
+                (unsigned long long)r->median_ns, (unsigned long long)r->mean_ns,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static char *
+read_file(const char *path)
+{
+    FILE *file = fopen(path, "re");
+    char *text = NULL;
+    size_t size = 0;
+
+    if (!file) {
+        return NULL;
+    }
+    for (;;) {
+        char *grown = realloc(text, size + 65536 + 1);
+        if (!grown) {
+            free(text);
+            fclose(file);
+            return NULL;
+        }
+        text = grown;
+        size_t n = fread(text + size, 1, 65536, file);
+        size += n;
+        if (n == 0) {
+            break;
+        }
+    }
+    text[size] = '\0';
+    fclose(file);
+    return text;
+}
+
+// Median of a benchmark in a file from write_json, 0 if it is not there
+static uint64_t
+baseline_median(const char *text, const char *name)
+{
+    char key[128];
+
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char *entry = strstr(text, key);
+    if (!entry) {
+        return 0;
+    }
+    const char *median = strstr(entry, "\"median_ns\":");
+    const char *next = strstr(entry + 1, "\"name\":");
+    if (!median || (next && median > next)) {
+        return 0;
+    }
+    return strtoull(median + strlen("\"median_ns\":"), NULL, 10);
+}
+
+static void
+print_usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] [FILTER...]\n", program_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -w N     Warmup runs per benchmark (default 2)\n");
+    fprintf(stderr, "  -r N     Measured repetitions per benchmark (default 10)\n");
+    fprintf(stderr, "  -c CPU   Pin to this CPU\n");
+    fprintf(stderr, "  -j FILE  Write results as JSON\n");
+    fprintf(stderr, "  -b FILE  Compare medians against JSON results from an earlier run\n");
+    fprintf(stderr, "  -t PCT   Slowdown against the baseline counted as a regression (default 5)\n");
+    fprintf(stderr, "  -h       Show this help message\n");
+    fprintf(stderr, "Only benchmarks whose name contains one of the FILTERs run.\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    int warmup = 2;
+    int reps = 10;
+    int cpu = -1;
+    double threshold = 5;
+    const char *json_path = NULL;
+    const char *baseline_path = NULL;
+    char *baseline = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:r:c:j:b:t:h")) != -1) {
+        switch (opt) {
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'r':
+                reps = atoi(optarg);
+                break;
+            case 'c':
+                cpu = atoi(optarg);
+                break;
+            case 'j':
+                json_path = optarg;
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 't':
+                threshold = strtod(optarg, NULL);
+                break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (reps < 1 || reps > MAX_REPS || warmup < 0) {
+        fprintf(stderr, "Repetitions must be 1 to %d\n", MAX_REPS);
+        return 1;
+    }
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            perror("sched_setaffinity");
+            return 1;
+        }
+    }
+    if (baseline_path) {
+        baseline = read_file(baseline_path);
+        if (!baseline) {
+            fprintf(stderr, "Failed to read %s: %s\n", baseline_path, strerror(errno));
+            return 1;
+        }
+    }
+
+    text_block = make_text(HASH_BULK_SIZE);
+
+    struct result results[ARRAY_LENGTH(benches)];
+    int count = 0;
+    int regressions = 0;
+
+    printf("%-16s %12s %12s %12s %10s", "benchmark", "median", "min", "per op", "MB/s");
+    printf(baseline ? " %9s\n" : "\n", "vs base");
+    for (size_t i = 0; i < ARRAY_LENGTH(benches); i++) {
+        const struct bench *bench = &benches[i];
+        bool selected = optind == argc;
+        for (int f = optind; f < argc && !selected; f++) {
+            selected = strstr(bench->name, argv[f]) != NULL;
+        }
+        if (!selected) {
+            continue;
+        }
+
+        struct result *r = &results[count++];
+        measure(bench, warmup, reps, r);
+        printf("%-16s %9.3f ms %9.3f ms %9.1f ns %10.1f", bench->name, r->median_ns / 1e6,
+               r->min_ns / 1e6, (double)r->median_ns / bench->ops,
+               r->bytes / 1e6 / (r->median_ns / 1e9));
+
+        uint64_t base = baseline ? baseline_median(baseline, bench->name) : 0;
+        if (base) {
+            double change = (double)r->median_ns / base * 100 - 100;
+            bool regressed = change > threshold;
+            regressions += regressed;
+            printf(" %+8.1f%%%s", change, regressed ? "  REGRESSION" : "");
+        }
+        printf("\n");
+    }
+
+    if (json_path) {
+        FILE *out = fopen(json_path, "we");
+        if (!out) {
+            fprintf(stderr, "Failed to write %s: %s\n", json_path, strerror(errno));
+            return 1;
+        }
+        write_json(out, results, count, cpu, warmup);
+        fclose(out);
+    }
+
+    free(baseline);
+    free(text_block);
+    return regressions ? 1 : 0;
+}
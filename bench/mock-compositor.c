@@ -0,0 +1,1068 @@
+/**
+ * Headless compositor stand-in for capture benchmarks
+ *
+ * Serves wl_seat and zwlr_data_control_manager_v1 on a private Wayland
+ * socket, starts the monitor against it and plays a selection storm:
+ * COUNT selections at RATE per second, cycling through payload sizes and
+ * MIME sets. Every payload opens with a "zcbench:SEQ" marker, so scanning
+ * the monitor's stdout tells which selections made it through and how
+ * long each took from the selection event to its bytes leaving the
+ * monitor. Selections the monitor never fetched were coalesced or
+ * dropped; fetched ones that never showed up were lost on the way. The
+ * CPU time the monitor used over the selections played is its cost per
+ * event, the figure to compare monitors built with different features by.
+ *
+ * With -o the monitor is a one-shot client instead, such as zigclip-paste:
+ * the first selection is current before it connects, it is started RUNS
+ * times and each run is timed from the fork to its exit. That cold start
+ * time is what a script calling it pays.
+ *
+ * With -p the storm is a session the monitor recorded with -R instead,
+ * played with its original timing scaled by -x (0 for as fast as
+ * possible), MIME lists and payload sizes. Selections whose payloads had
+ * the same hash get the same bytes, so deduplication sees what it saw in
+ * production; only the first of them can be told apart in the output.
+ *
+ * Needs nothing but libwayland-server, so it runs on a CI box without a
+ * session. XDG_RUNTIME_DIR is made up if unset.
+ *
+ *   cc -O2 -Isrc bench/mock-compositor.c src/histogram.c src/mem.c \
+ *       src/recording.c src/wlr-data-control-protocol.c -lwayland-server -o mock-compositor
+ *   ./mock-compositor -n 5000 -r 1000 -s 1K,64K,1M -- ./zig-out/bin/wayland-client -c 5
+ *   ./mock-compositor -p session.zrec -x 0 -- ./zig-out/bin/wayland-client -d
+ *   ./mock-compositor -o 200 -s 4K -- ./zig-out/bin/zigclip-paste
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
+#include "histogram.h"
+#include "recording.h"
+#include "util.h"
+#include "wlr-data-control-server-protocol.h"
+
+#define MARKER "zcbench:"
+#define MARKER_DIGITS 10
+#define MARKER_LEN (sizeof(MARKER) - 1 + MARKER_DIGITS)
+#define HEADER_LEN (MARKER_LEN + 1) // Marker and newline
+
+#define MAX_DEVICES 8
+#define MAX_SIZES 16
+#define MAX_MIME_SETS 8
+#define MAX_MIMES 8
+#define BURST_PER_MS 16 // Selections per millisecond without a rate
+
+struct mime_set {
+    char *types[MAX_MIMES];
+    int count;
+};
+
+// One selection to play
+struct planned_selection {
+    uint64_t at_ns; // Since the storm began, before scaling by speed
+    size_t size;
+    uint32_t content; // Selection whose payload bytes this one repeats
+    char **mime_types;
+    int mime_count;
+    uint64_t hash; // From a recording, 0 if it was never captured
+};
+
+struct mock {
+    struct wl_display *display;
+    struct wl_event_loop *loop;
+    struct wl_event_source *storm_timer;
+    struct wl_event_source *idle_timer;
+    struct wl_resource *devices[MAX_DEVICES];
+    int device_count;
+
+    // Storm shape
+    struct planned_selection *plan;
+    uint32_t count;
+    double rate;
+    double speed; // Replay time scale, 0 plays back to back
+    bool burst;
+    struct recording_reader *recording; // Owns the replayed MIME types
+    size_t sizes[MAX_SIZES];
+    int size_count;
+    struct mime_set sets[MAX_MIME_SETS];
+    int set_count;
+    int warmup_ms;
+    int idle_ms;
+    int oneshot_runs; // One-shot client runs to time, 0 for a storm
+
+    uint32_t sent;
+    uint64_t *sent_ns; // Per selection
+    bool *fetched;
+    bool *wanted; // Fetched, by content
+    bool *delivered; // By content
+    uint64_t start_ns;
+    uint64_t last_activity_ns;
+
+    uint64_t fetches;
+    uint64_t unique_fetches;
+    uint64_t delivered_count;
+    uint64_t duplicates;
+    uint64_t writes_failed;
+    uint64_t bytes_served;
+    struct histogram latency;
+    struct histogram cold_start; // Fork to exit of one-shot runs
+
+    // The monitor
+    pid_t child;
+    struct rusage child_usage; // CPU the monitor used, for its cost per event
+    int child_fd;
+    struct wl_event_source *child_source;
+    char carry[MARKER_LEN];
+    size_t carry_len;
+    bool stopping;
+    bool finished;
+};
+
+struct mock_offer {
+    struct mock *mock;
+    uint32_t seq;
+    uint32_t content;
+    size_t size;
+};
+
+// One receive request being served
+struct writer {
+    struct mock *mock;
+    struct wl_event_source *source;
+    int fd;
+    char header[HEADER_LEN + 1];
+    size_t size;
+    size_t offset;
+};
+
+static char filler[65536];
+
+static void
+touch(struct mock *mock)
+{
+    mock->last_activity_ns = clock_ns(CLOCK_MONOTONIC);
+}
+
+static void
+writer_destroy(struct writer *writer)
+{
+    wl_event_source_remove(writer->source);
+    close(writer->fd);
+    free(writer);
+}
+
+static int
+handle_writable(int fd, uint32_t mask, void *data)
+{
+    struct writer *writer = data;
+    struct mock *mock = writer->mock;
+
+    while (writer->offset < writer->size) {
+        const char *from;
+        size_t len;
+        if (writer->offset < HEADER_LEN) {
+            from = writer->header + writer->offset;
+            len = HEADER_LEN - writer->offset;
+        } else {
+            from = filler;
+            len = sizeof(filler);
+        }
+        if (len > writer->size - writer->offset) {
+            len = writer->size - writer->offset;
+        }
+
+        ssize_t n = write(fd, from, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN) {
+            return 0;
+        }
+        if (n <= 0) {
+            // The monitor gave up on this one
+            mock->writes_failed++;
+            break;
+        }
+        writer->offset += n;
+        mock->bytes_served += n;
+        touch(mock);
+    }
+
+    writer_destroy(writer);
+    return 0;
+}
+
+static void
+offer_receive(struct wl_client *client, struct wl_resource *resource,
+              const char *mime_type, int32_t fd)
+{
+    struct mock_offer *offer = wl_resource_get_user_data(resource);
+    struct mock *mock = offer->mock;
+    struct writer *writer = calloc(1, sizeof(*writer));
+
+    mock->fetches++;
+    if (!mock->fetched[offer->seq]) {
+        mock->fetched[offer->seq] = true;
+        mock->unique_fetches++;
+    }
+    mock->wanted[offer->content] = true;
+
+    if (!writer) {
+        close(fd);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    writer->mock = mock;
+    writer->fd = fd;
+    writer->size = offer->size;
+    snprintf(writer->header, sizeof(writer->header), MARKER "%0*u\n",
+             MARKER_DIGITS, offer->content);
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    writer->source = wl_event_loop_add_fd(mock->loop, fd, WL_EVENT_WRITABLE,
+                                          handle_writable, writer);
+    if (!writer->source) {
+        close(fd);
+        free(writer);
+    }
+}
+
+static void
+offer_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static const struct zwlr_data_control_offer_v1_interface offer_impl = {
+    .receive = offer_receive,
+    .destroy = offer_destroy,
+};
+
+static void
+handle_offer_destroy(struct wl_resource *resource)
+{
+    free(wl_resource_get_user_data(resource));
+}
+
+static void
+send_offer(struct mock *mock, struct wl_resource *device, uint32_t seq)
+{
+    const struct planned_selection *planned = &mock->plan[seq];
+    struct mock_offer *offer = calloc(1, sizeof(*offer));
+    if (!offer) {
+        return;
+    }
+    offer->mock = mock;
+    offer->seq = seq;
+    offer->content = planned->content;
+    offer->size = planned->size;
+
+    struct wl_resource *resource = wl_resource_create(
+        wl_resource_get_client(device), &zwlr_data_control_offer_v1_interface,
+        wl_resource_get_version(device), 0);
+    if (!resource) {
+        free(offer);
+        return;
+    }
+    wl_resource_set_implementation(resource, &offer_impl, offer, handle_offer_destroy);
+
+    zwlr_data_control_device_v1_send_data_offer(device, resource);
+    for (int m = 0; m < planned->mime_count; m++) {
+        zwlr_data_control_offer_v1_send_offer(resource, planned->mime_types[m]);
+    }
+    zwlr_data_control_device_v1_send_selection(device, resource);
+}
+
+static void
+send_selection(struct mock *mock)
+{
+    uint32_t seq = mock->sent++;
+
+    mock->sent_ns[seq] = clock_ns(CLOCK_MONOTONIC);
+    for (int i = 0; i < mock->device_count; i++) {
+        send_offer(mock, mock->devices[i], seq);
+    }
+}
+
+static int
+handle_storm(void *data)
+{
+    struct mock *mock = data;
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+
+    if (mock->start_ns == 0) {
+        mock->start_ns = now;
+    }
+
+    double elapsed_ns = (now - mock->start_ns) * mock->speed;
+    uint32_t burst_end = mock->sent + BURST_PER_MS;
+    while (mock->sent < mock->count &&
+           (mock->burst ? mock->sent < burst_end : mock->plan[mock->sent].at_ns <= elapsed_ns)) {
+        send_selection(mock);
+    }
+    touch(mock);
+
+    if (mock->sent == mock->count) {
+        wl_event_source_timer_update(mock->idle_timer, mock->idle_ms);
+    } else if (mock->burst) {
+        wl_event_source_timer_update(mock->storm_timer, 1);
+    } else {
+        double wait_ms = (mock->plan[mock->sent].at_ns - elapsed_ns) / mock->speed / 1e6;
+        wl_event_source_timer_update(mock->storm_timer, wait_ms < 1 ? 1 : (int)wait_ms + 1);
+    }
+    return 0;
+}
+
+static void
+stop(struct mock *mock)
+{
+    if (!mock->stopping) {
+        mock->stopping = true;
+        kill(mock->child, SIGTERM);
+    }
+}
+
+// Storm over, wait for the monitor to go quiet before stopping it
+static int
+handle_idle(void *data)
+{
+    struct mock *mock = data;
+    uint64_t quiet_ms = (clock_ns(CLOCK_MONOTONIC) - mock->last_activity_ns) / 1000000;
+
+    if (quiet_ms < (uint64_t)mock->idle_ms) {
+        wl_event_source_timer_update(mock->idle_timer, mock->idle_ms - quiet_ms);
+        return 0;
+    }
+    stop(mock);
+    return 0;
+}
+
+static void
+scan_output(struct mock *mock, const char *buf, size_t len)
+{
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    const char *p = buf;
+    const char *end = buf + len;
+
+    while ((p = memmem(p, end - p, MARKER, sizeof(MARKER) - 1)) != NULL) {
+        if ((size_t)(end - p) < MARKER_LEN) {
+            break; // Rest of it comes with the next read
+        }
+        char *digits_end;
+        unsigned long seq = strtoul(p + sizeof(MARKER) - 1, &digits_end, 10);
+        p += MARKER_LEN;
+        if (digits_end != p || seq >= mock->sent) {
+            continue;
+        }
+        if (mock->delivered[seq]) {
+            mock->duplicates++;
+            continue;
+        }
+        mock->delivered[seq] = true;
+        mock->delivered_count++;
+        histogram_record(&mock->latency, now - mock->sent_ns[seq]);
+    }
+}
+
+static int
+handle_child_output(int fd, uint32_t mask, void *data)
+{
+    struct mock *mock = data;
+    static char buf[MARKER_LEN + (1 << 20)];
+
+    for (;;) {
+        memcpy(buf, mock->carry, mock->carry_len);
+        ssize_t n = read(fd, buf + mock->carry_len, sizeof(buf) - mock->carry_len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN) {
+            return 0;
+        }
+        if (n <= 0) {
+            break;
+        }
+
+        size_t len = mock->carry_len + n;
+        scan_output(mock, buf, len);
+        touch(mock);
+
+        // A marker may straddle reads, keep anything that could be its start
+        mock->carry_len = len < MARKER_LEN - 1 ? len : MARKER_LEN - 1;
+        memcpy(mock->carry, buf + len - mock->carry_len, mock->carry_len);
+    }
+
+    wl_event_source_remove(mock->child_source);
+    mock->child_source = NULL;
+    close(fd);
+    mock->finished = true;
+    return 0;
+}
+
+static void
+device_set_selection(struct wl_client *client, struct wl_resource *resource,
+                     struct wl_resource *source)
+{
+    // The monitor only watches, nothing to hand out
+}
+
+static void
+device_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static const struct zwlr_data_control_device_v1_interface device_impl = {
+    .set_selection = device_set_selection,
+    .destroy = device_destroy,
+    .set_primary_selection = device_set_selection,
+};
+
+static void
+handle_device_destroy(struct wl_resource *resource)
+{
+    struct mock *mock = wl_resource_get_user_data(resource);
+
+    for (int i = 0; i < mock->device_count; i++) {
+        if (mock->devices[i] == resource) {
+            mock->devices[i] = mock->devices[--mock->device_count];
+            break;
+        }
+    }
+}
+
+static void
+source_offer(struct wl_client *client, struct wl_resource *resource, const char *mime_type)
+{
+}
+
+static void
+source_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static const struct zwlr_data_control_source_v1_interface source_impl = {
+    .offer = source_offer,
+    .destroy = source_destroy,
+};
+
+static void
+manager_create_data_source(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_resource *source = wl_resource_create(
+        client, &zwlr_data_control_source_v1_interface, wl_resource_get_version(resource), id);
+    if (!source) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(source, &source_impl, NULL, NULL);
+}
+
+static void
+manager_get_data_device(struct wl_client *client, struct wl_resource *resource,
+                        uint32_t id, struct wl_resource *seat)
+{
+    struct mock *mock = wl_resource_get_user_data(resource);
+
+    if (mock->device_count == MAX_DEVICES) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    struct wl_resource *device = wl_resource_create(
+        client, &zwlr_data_control_device_v1_interface, wl_resource_get_version(resource), id);
+    if (!device) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(device, &device_impl, mock, handle_device_destroy);
+    mock->devices[mock->device_count++] = device;
+
+    // One-shot clients find the first selection current, a real
+    // compositor announces it right away
+    if (mock->oneshot_runs > 0) {
+        mock->sent = 1;
+        mock->sent_ns[0] = clock_ns(CLOCK_MONOTONIC);
+        send_offer(mock, device, 0);
+        return;
+    }
+
+    // Like a real compositor, start with the current (empty) selection
+    zwlr_data_control_device_v1_send_selection(device, NULL);
+
+    if (mock->sent == 0 && mock->start_ns == 0) {
+        wl_event_source_timer_update(mock->storm_timer,
+                                     mock->warmup_ms > 0 ? mock->warmup_ms : 1);
+    }
+}
+
+static void
+manager_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static const struct zwlr_data_control_manager_v1_interface manager_impl = {
+    .create_data_source = manager_create_data_source,
+    .get_data_device = manager_get_data_device,
+    .destroy = manager_destroy,
+};
+
+static void
+bind_manager(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(
+        client, &zwlr_data_control_manager_v1_interface, version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &manager_impl, data, NULL);
+}
+
+static void
+seat_get_device(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    wl_resource_post_error(resource, 0, "mock seat has no input devices");
+}
+
+static void
+seat_release(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static const struct wl_seat_interface seat_impl = {
+    .get_pointer = seat_get_device,
+    .get_keyboard = seat_get_device,
+    .get_touch = seat_get_device,
+    .release = seat_release,
+};
+
+static void
+bind_seat(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wl_seat_interface, version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &seat_impl, data, NULL);
+    wl_seat_send_capabilities(resource, 0);
+}
+
+static pid_t
+spawn_monitor(struct mock *mock, const char *socket, char **argv)
+{
+    int out[2];
+
+    if (pipe2(out, O_CLOEXEC) == -1) {
+        return -1;
+    }
+    fcntl(out[0], F_SETPIPE_SZ, 1 << 20);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(out[1], STDOUT_FILENO);
+        setenv("WAYLAND_DISPLAY", socket, 1);
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    close(out[1]);
+    if (pid == -1) {
+        close(out[0]);
+        return -1;
+    }
+
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+    mock->child_fd = out[0];
+    mock->child_source = wl_event_loop_add_fd(mock->loop, out[0], WL_EVENT_READABLE,
+                                              handle_child_output, mock);
+    return pid;
+}
+
+// Parse a byte count with an optional K, M or G suffix
+static bool
+parse_size(const char *arg, size_t *size)
+{
+    char *end;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (end == arg) {
+        return false;
+    }
+
+    switch (*end) {
+        case 'G': case 'g': value <<= 10; // fall through
+        case 'M': case 'm': value <<= 10; // fall through
+        case 'K': case 'k': value <<= 10; end++; break;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+
+    *size = value;
+    return true;
+}
+
+static bool
+parse_sizes(struct mock *mock, char *arg)
+{
+    mock->size_count = 0;
+    for (char *item = strtok(arg, ","); item; item = strtok(NULL, ",")) {
+        if (mock->size_count == MAX_SIZES || !parse_size(item, &mock->sizes[mock->size_count])) {
+            return false;
+        }
+        mock->size_count++;
+    }
+    return mock->size_count > 0;
+}
+
+// Sets separated by spaces, types within a set by commas
+static bool
+parse_mime_sets(struct mock *mock, char *arg)
+{
+    char *set_save, *type_save;
+
+    mock->set_count = 0;
+    for (char *set = strtok_r(arg, " ", &set_save); set; set = strtok_r(NULL, " ", &set_save)) {
+        if (mock->set_count == MAX_MIME_SETS) {
+            return false;
+        }
+        struct mime_set *mimes = &mock->sets[mock->set_count++];
+        mimes->count = 0;
+        for (char *type = strtok_r(set, ",", &type_save); type;
+             type = strtok_r(NULL, ",", &type_save)) {
+            if (mimes->count == MAX_MIMES) {
+                return false;
+            }
+            mimes->types[mimes->count++] = type;
+        }
+    }
+    return mock->set_count > 0;
+}
+
+// COUNT selections at RATE, cycling through the sizes and MIME sets
+static bool
+plan_synthetic(struct mock *mock)
+{
+    mock->plan = calloc(mock->count, sizeof(*mock->plan));
+    if (!mock->plan) {
+        return false;
+    }
+
+    mock->burst = mock->rate <= 0;
+    mock->speed = 1;
+    for (uint32_t i = 0; i < mock->count; i++) {
+        struct planned_selection *planned = &mock->plan[i];
+        const struct mime_set *set = &mock->sets[i % mock->set_count];
+        planned->at_ns = mock->burst ? 0 : i * 1e9 / mock->rate;
+        planned->size = mock->sizes[i % mock->size_count];
+        planned->content = i;
+        planned->mime_types = (char **)set->types;
+        planned->mime_count = set->count;
+    }
+    return true;
+}
+
+static int
+compare_by_hash(const void *a, const void *b)
+{
+    const struct planned_selection *x = *(struct planned_selection *const *)a;
+    const struct planned_selection *y = *(struct planned_selection *const *)b;
+
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return x->content < y->content ? -1 : x->content > y->content;
+}
+
+// Selections with the same payload hash share the first one's content
+static bool
+share_repeated_content(struct mock *mock)
+{
+    struct planned_selection **order = malloc(mock->count * sizeof(*order));
+    if (!order) {
+        return false;
+    }
+    for (uint32_t i = 0; i < mock->count; i++) {
+        order[i] = &mock->plan[i];
+    }
+    qsort(order, mock->count, sizeof(*order), compare_by_hash);
+    for (uint32_t i = 1; i < mock->count; i++) {
+        if (order[i]->hash != 0 && order[i]->hash == order[i - 1]->hash) {
+            order[i]->content = order[i - 1]->content;
+        }
+    }
+    free(order);
+    return true;
+}
+
+static bool
+plan_recording(struct mock *mock, const char *path)
+{
+    struct recording_event event;
+    uint64_t *fetch_seqs = NULL; // Capture seq to selection, -1 if none
+    uint32_t fetch_count = 0;
+    uint32_t capacity = 0;
+    uint64_t first_ns = 0;
+    int ret;
+
+    mock->recording = recording_reader_open(path);
+    if (!mock->recording) {
+        return false;
+    }
+
+    mock->count = 0;
+    while ((ret = recording_reader_next(mock->recording, &event)) == 1) {
+        if (event.type == RECORDING_SELECTION) {
+            if (mock->count == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                struct planned_selection *grown = realloc(mock->plan, capacity * sizeof(*grown));
+                if (!grown) {
+                    return false;
+                }
+                mock->plan = grown;
+            }
+            if (mock->count == 0) {
+                first_ns = event.time_ns;
+            }
+            struct planned_selection *planned = &mock->plan[mock->count];
+            memset(planned, 0, sizeof(*planned));
+            planned->at_ns = event.time_ns - first_ns;
+            planned->content = mock->count++;
+            planned->mime_types = malloc(event.mime_count * sizeof(char *));
+            if (event.mime_count > 0 && !planned->mime_types) {
+                return false;
+            }
+            memcpy(planned->mime_types, event.mime_types, event.mime_count * sizeof(char *));
+            planned->mime_count = event.mime_count;
+        } else if (event.type == RECORDING_FETCH && event.selection >= 1 &&
+                   event.selection <= mock->count) {
+            // Seqs grow with every capture, the table is indexed by them
+            if (event.seq >= fetch_count) {
+                uint32_t new_count = event.seq + 1024;
+                uint64_t *grown = realloc(fetch_seqs, new_count * sizeof(*grown));
+                if (!grown) {
+                    free(fetch_seqs);
+                    return false;
+                }
+                memset(grown + fetch_count, 0xff, (new_count - fetch_count) * sizeof(*grown));
+                fetch_seqs = grown;
+                fetch_count = new_count;
+            }
+            fetch_seqs[event.seq] = event.selection - 1;
+        } else if (event.type == RECORDING_PAYLOAD && event.seq < fetch_count &&
+                   fetch_seqs[event.seq] != UINT64_MAX) {
+            struct planned_selection *planned = &mock->plan[fetch_seqs[event.seq]];
+            planned->size = event.size;
+            planned->hash = event.hash;
+        }
+    }
+    free(fetch_seqs);
+    if (ret == -1 || mock->count == 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < mock->count; i++) {
+        // Never captured while recording, all we know is it was offered
+        if (mock->plan[i].size == 0) {
+            mock->plan[i].size = mock->sizes[0];
+        }
+    }
+    mock->burst = mock->speed <= 0;
+    return share_repeated_content(mock);
+}
+
+static void
+report_oneshot(struct mock *mock)
+{
+    const struct histogram *h = &mock->cold_start;
+    const struct rusage *usage = &mock->child_usage;
+    double cpu = usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6 +
+                 usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+
+    printf("runs       %8d              %8llu printed the selection\n", mock->oneshot_runs,
+           (unsigned long long)mock->delivered_count);
+    if (h->count > 0) {
+        printf("cold start ms p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+               histogram_percentile(h, 0.5) / 1e6, histogram_percentile(h, 0.9) / 1e6,
+               histogram_percentile(h, 0.99) / 1e6, h->max / 1e6);
+        printf("client cpu %8.1f us per run  max rss %ld KiB\n", cpu * 1e6 / h->count,
+               usage->ru_maxrss);
+    }
+}
+
+// Start the one-shot client again and again, timing each run to its exit
+static void
+run_oneshot(struct mock *mock, const char *socket, char **argv)
+{
+    for (int run = 0; run < mock->oneshot_runs; run++) {
+        struct rusage usage;
+        int status;
+
+        mock->device_count = 0;
+        mock->delivered[0] = false;
+        mock->carry_len = 0;
+        mock->finished = false;
+        uint64_t start_ns = clock_ns(CLOCK_MONOTONIC);
+        mock->child = spawn_monitor(mock, socket, argv);
+        if (mock->child == -1) {
+            fprintf(stderr, "Failed to start %s: %s\n", argv[0], strerror(errno));
+            return;
+        }
+        while (!mock->finished) {
+            wl_display_flush_clients(mock->display);
+            wl_event_loop_dispatch(mock->loop, -1);
+        }
+        wait4(mock->child, &status, 0, &usage);
+        histogram_record(&mock->cold_start, clock_ns(CLOCK_MONOTONIC) - start_ns);
+
+        timeradd(&mock->child_usage.ru_utime, &usage.ru_utime, &mock->child_usage.ru_utime);
+        timeradd(&mock->child_usage.ru_stime, &usage.ru_stime, &mock->child_usage.ru_stime);
+        if (usage.ru_maxrss > mock->child_usage.ru_maxrss) {
+            mock->child_usage.ru_maxrss = usage.ru_maxrss;
+        }
+        // Let the server side of the client go before the next one
+        wl_display_flush_clients(mock->display);
+        wl_event_loop_dispatch(mock->loop, 0);
+    }
+}
+
+static void
+report(struct mock *mock)
+{
+    const struct histogram *h = &mock->latency;
+    double seconds = (mock->last_activity_ns - mock->start_ns) / 1e9;
+    uint64_t lost = 0;
+
+    for (uint32_t i = 0; i < mock->count; i++) {
+        lost += mock->wanted[i] && !mock->delivered[i];
+    }
+
+    printf("selections %8u sent  %8llu fetched  %8llu coalesced or dropped\n",
+           mock->sent, (unsigned long long)mock->unique_fetches,
+           (unsigned long long)(mock->sent - mock->unique_fetches));
+    printf("delivered  %8llu       %8llu lost     %8llu duplicates  %llu transfers cut\n",
+           (unsigned long long)mock->delivered_count,
+           (unsigned long long)lost,
+           (unsigned long long)mock->duplicates, (unsigned long long)mock->writes_failed);
+    if (seconds > 0) {
+        printf("served     %10.1f MiB in %.3f s  %8.1f MiB/s  %8.1f selections/s delivered\n",
+               mock->bytes_served / 1048576.0, seconds,
+               mock->bytes_served / 1048576.0 / seconds, mock->delivered_count / seconds);
+    }
+    if (h->count > 0) {
+        printf("latency ms p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+               histogram_percentile(h, 0.5) / 1e6, histogram_percentile(h, 0.9) / 1e6,
+               histogram_percentile(h, 0.99) / 1e6, histogram_percentile(h, 0.999) / 1e6,
+               h->max / 1e6);
+    }
+
+    const struct rusage *usage = &mock->child_usage;
+    double user = usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6;
+    double system = usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+    if (mock->sent > 0) {
+        printf("monitor cpu %8.3f s user  %.3f s system  %8.1f us per selection  max rss %ld KiB\n",
+               user, system, (user + system) * 1e6 / mock->sent, usage->ru_maxrss);
+    }
+}
+
+static void
+print_usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] -- MONITOR [ARGS...]\n", program_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n COUNT  Selections to play (default 1000)\n");
+    fprintf(stderr, "  -r RATE   Selections per second (default 0 = %d per millisecond)\n", BURST_PER_MS);
+    fprintf(stderr, "  -s SIZES  Payload sizes to cycle through, comma separated (default 4K); when\n");
+    fprintf(stderr, "            replaying, the size of selections never captured while recording\n");
+    fprintf(stderr, "  -M SETS   MIME sets to cycle through, sets space separated and types comma\n");
+    fprintf(stderr, "            separated (default \"text/plain;charset=utf-8,text/plain\")\n");
+    fprintf(stderr, "  -p FILE   Replay a session recorded by the monitor's -R instead\n");
+    fprintf(stderr, "  -x SPEED  Replay time scale (default 1, 0 = back to back)\n");
+    fprintf(stderr, "  -w MS     Wait after the monitor binds before the storm (default 50)\n");
+    fprintf(stderr, "  -i MS     Quiet time after the storm before stopping the monitor (default 1000)\n");
+    fprintf(stderr, "  -o RUNS   Time RUNS starts of a one-shot client that prints the selection and exits\n");
+    fprintf(stderr, "  -h        Show this help message\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    static char default_sizes[] = "4K";
+    static char default_mimes[] = "text/plain;charset=utf-8,text/plain";
+    struct mock mock = {
+        .count = 1000,
+        .warmup_ms = 50,
+        .idle_ms = 1000,
+        .speed = 1,
+    };
+    const char *replay_path = NULL;
+    char *sizes = default_sizes;
+    char *mimes = default_mimes;
+    char runtime_dir[] = "/tmp/zcbench-XXXXXX";
+    bool own_runtime_dir = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+n:r:s:M:p:x:w:i:o:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                mock.count = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                mock.rate = strtod(optarg, NULL);
+                break;
+            case 's':
+                sizes = optarg;
+                break;
+            case 'M':
+                mimes = optarg;
+                break;
+            case 'p':
+                replay_path = optarg;
+                break;
+            case 'x':
+                mock.speed = strtod(optarg, NULL);
+                break;
+            case 'w':
+                mock.warmup_ms = atoi(optarg);
+                break;
+            case 'i':
+                mock.idle_ms = atoi(optarg);
+                break;
+            case 'o':
+                mock.oneshot_runs = atoi(optarg);
+                mock.count = 1;
+                break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || mock.count == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!parse_sizes(&mock, sizes)) {
+        fprintf(stderr, "Invalid sizes: %s\n", sizes);
+        return 1;
+    }
+    if (!parse_mime_sets(&mock, mimes)) {
+        fprintf(stderr, "Invalid MIME sets: %s\n", mimes);
+        return 1;
+    }
+    if (replay_path ? !plan_recording(&mock, replay_path) : !plan_synthetic(&mock)) {
+        fprintf(stderr, "Failed to plan the storm%s%s: %s\n", replay_path ? " from " : "",
+                replay_path ? replay_path : "", strerror(errno));
+        return 1;
+    }
+    for (uint32_t i = 0; i < mock.count; i++) {
+        if (mock.plan[i].size < HEADER_LEN) {
+            mock.plan[i].size = HEADER_LEN;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(filler); i++) {
+        // No 'z', so the filler can never look like a marker
+        filler[i] = (i % 80 == 79) ? '\n' : 'a' + i % 25;
+    }
+    histogram_reset(&mock.latency);
+    histogram_reset(&mock.cold_start);
+    mock.sent_ns = calloc(mock.count, sizeof(*mock.sent_ns));
+    mock.fetched = calloc(mock.count, sizeof(*mock.fetched));
+    mock.wanted = calloc(mock.count, sizeof(*mock.wanted));
+    mock.delivered = calloc(mock.count, sizeof(*mock.delivered));
+    if (!mock.sent_ns || !mock.fetched || !mock.wanted || !mock.delivered) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!getenv("XDG_RUNTIME_DIR")) {
+        if (!mkdtemp(runtime_dir)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        setenv("XDG_RUNTIME_DIR", runtime_dir, 1);
+        own_runtime_dir = true;
+    }
+
+    mock.display = wl_display_create();
+    if (!mock.display) {
+        fprintf(stderr, "Failed to create display\n");
+        return 1;
+    }
+    mock.loop = wl_display_get_event_loop(mock.display);
+    const char *socket = wl_display_add_socket_auto(mock.display);
+    if (!socket) {
+        fprintf(stderr, "Failed to add socket: %s\n", strerror(errno));
+        return 1;
+    }
+    wl_global_create(mock.display, &wl_seat_interface, 1, &mock, bind_seat);
+    wl_global_create(mock.display, &zwlr_data_control_manager_v1_interface, 2, &mock,
+                     bind_manager);
+    mock.storm_timer = wl_event_loop_add_timer(mock.loop, handle_storm, &mock);
+    mock.idle_timer = wl_event_loop_add_timer(mock.loop, handle_idle, &mock);
+
+    if (mock.oneshot_runs > 0) {
+        run_oneshot(&mock, socket, argv + optind);
+        report_oneshot(&mock);
+        wl_display_destroy_clients(mock.display);
+        wl_display_destroy(mock.display);
+        if (own_runtime_dir) {
+            rmdir(runtime_dir);
+        }
+        return mock.delivered_count == (uint64_t)mock.oneshot_runs ? 0 : 1;
+    }
+
+    mock.child = spawn_monitor(&mock, socket, argv + optind);
+    if (mock.child == -1) {
+        fprintf(stderr, "Failed to start %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    while (!mock.finished) {
+        wl_display_flush_clients(mock.display);
+        wl_event_loop_dispatch(mock.loop, -1);
+    }
+
+    int status;
+    wait4(mock.child, &status, 0, &mock.child_usage);
+    if (!mock.stopping) {
+        fprintf(stderr, "Monitor exited before the storm was over\n");
+    }
+    report(&mock);
+
+    wl_display_destroy_clients(mock.display);
+    wl_display_destroy(mock.display);
+    if (own_runtime_dir) {
+        rmdir(runtime_dir);
+    }
+    free(mock.sent_ns);
+    free(mock.fetched);
+    free(mock.wanted);
+    free(mock.delivered);
+    if (mock.recording) {
+        for (uint32_t i = 0; i < mock.count; i++) {
+            free(mock.plan[i].mime_types);
+        }
+        recording_reader_close(mock.recording);
+    }
+    free(mock.plan);
+    return mock.stopping ? 0 : 1;
+}
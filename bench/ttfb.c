@@ -0,0 +1,180 @@
+/**
+ * Time-to-first-byte benchmark for buffered and streaming output
+ *
+ * A producer thread plays the source client and writes a payload into an
+ * offer pipe, the main thread runs the monitor's transfer and output path
+ * and a consumer thread timestamps the first byte reaching the other end
+ * of stdout. With -S the first byte should show up after one chunk no
+ * matter how large the clip is.
+ *
+ *   cc -O2 -pthread -Isrc bench/ttfb.c src/event-loop.c src/json.c \
+ *       src/mem.c src/output.c src/payload.c src/sink.c src/timer-wheel.c \
+ *       src/transfer.c -o ttfb-bench
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "event-loop.h"
+#include "output.h"
+#include "payload.h"
+#include "sink.h"
+#include "transfer.h"
+#include "util.h"
+
+struct run {
+    size_t size;
+    bool stream;
+    int source_fd;   // Producer end of the offer pipe
+    int consumer_fd; // Reader end of our stdout
+    uint64_t start_ns;
+    uint64_t first_byte_ns;
+    uint64_t last_byte_ns;
+
+    struct output output;
+    bool done;
+};
+
+static void *
+produce(void *data)
+{
+    struct run *run = data;
+    static char block[65536];
+
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = 'a' + i % 26;
+    }
+
+    for (size_t left = run->size; left > 0;) {
+        size_t n = left < sizeof(block) ? left : sizeof(block);
+        ssize_t w = write(run->source_fd, block, n);
+        if (w <= 0) {
+            break;
+        }
+        left -= w;
+    }
+    close(run->source_fd);
+    return NULL;
+}
+
+static void *
+consume(void *data)
+{
+    struct run *run = data;
+    static char buffer[1 << 20];
+    size_t expected = run->size + 1; // Raw framing adds the newline
+    size_t total = 0;
+
+    while (total < expected) {
+        ssize_t n = read(run->consumer_fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        if (total == 0) {
+            run->first_byte_ns = clock_ns(CLOCK_MONOTONIC);
+        }
+        total += n;
+    }
+    run->last_byte_ns = clock_ns(CLOCK_MONOTONIC);
+    return NULL;
+}
+
+static void
+handle_data(void *data, struct transfer *transfer, size_t offset, size_t len)
+{
+    struct run *run = data;
+
+    if (run->stream) {
+        output_write_chunk(&run->output, transfer->payload, offset, len);
+    }
+}
+
+static void
+handle_done(void *data, struct transfer *transfer, int error)
+{
+    struct run *run = data;
+
+    if (run->stream) {
+        output_write_end(&run->output, transfer->payload, error == 0);
+    } else {
+        output_write_payload(&run->output, transfer->payload);
+    }
+    transfer_destroy(transfer);
+    run->done = true;
+}
+
+static const struct transfer_handler handler = {
+    .data = handle_data,
+    .done = handle_done,
+};
+
+static void
+measure(size_t size, bool stream)
+{
+    struct run run = { .size = size, .stream = stream };
+    int offer[2], out[2];
+
+    if (pipe2(offer, O_CLOEXEC) == -1 || pipe2(out, O_CLOEXEC) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    fcntl(offer[0], F_SETFL, O_NONBLOCK);
+    fcntl(out[0], F_SETPIPE_SZ, 1 << 20);
+    run.source_fd = offer[1];
+    run.consumer_fd = out[0];
+
+    struct event_loop *loop = event_loop_create();
+    struct sink sink;
+    sink_init(&sink, loop, out[1], 64 << 20);
+    output_init(&run.output, &sink, OUTPUT_RAW);
+
+    struct transfer_manager transfers;
+    transfer_manager_init(&transfers, loop, NULL);
+
+    struct payload *payload = payload_create("text/plain");
+    struct transfer_limits limits = { 0 };
+    transfer_create(&transfers, offer[0], payload, &limits, &handler, &run);
+
+    pthread_t producer, consumer;
+    run.start_ns = clock_ns(CLOCK_MONOTONIC);
+    pthread_create(&consumer, NULL, consume, &run);
+    pthread_create(&producer, NULL, produce, &run);
+
+    while (!run.done || sink_backlogged(&sink)) {
+        event_loop_dispatch(loop, 100);
+    }
+
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    printf("%9zu KiB  %-9s  ttfb %10.3f ms  total %10.3f ms\n",
+           size >> 10, stream ? "streaming" : "buffered",
+           (run.first_byte_ns - run.start_ns) / 1e6,
+           (run.last_byte_ns - run.start_ns) / 1e6);
+
+    transfer_manager_finish(&transfers);
+    output_finish(&run.output);
+    sink_finish(&sink);
+    event_loop_destroy(loop);
+    close(out[1]);
+    close(out[0]);
+}
+
+int
+main(void)
+{
+    static const size_t sizes[] = {
+        4 << 10, 64 << 10, 1 << 20, 16 << 20, 64 << 20, 256 << 20,
+    };
+
+    for (size_t i = 0; i < ARRAY_LENGTH(sizes); i++) {
+        measure(sizes[i], false);
+        measure(sizes[i], true);
+    }
+    return 0;
+}
@@ -22,4 +22,309 @@ pub fn build(b: *std.Build) void {
 
     const run_step = b.step("run", "Run the app");
     run_step.dependOn(&run_cmd.step);
+
+    // The capture engine both the monitor and libzigclip are built on
+    const engine_sources = [_][]const u8{
+        "src/coalesce.c",
+        "src/display-reader.c",
+        "src/event-loop.c",
+        "src/evtrace.c",
+        "src/hash.c",
+        "src/history.c",
+        "src/log.c",
+        "src/mem.c",
+        "src/metrics.c",
+        "src/offer.c",
+        "src/payload.c",
+        "src/pipeline.c",
+        "src/queue.c",
+        "src/timer-wheel.c",
+        "src/transfer.c",
+        "src/utf8.c",
+        "src/wlr-data-control-protocol.c",
+    };
+
+    // Monitor features, each on unless switched off with -D<name>=false.
+    // What is off is compiled out, see src/build-features.h.
+    var features: Features = .{};
+    inline for (@typeInfo(Features).@"struct".fields) |field| {
+        if (field.type == bool) {
+            if (b.option(bool, field.name, "Compile in the monitor's " ++ field.name ++ " feature (default: true)")) |enabled| {
+                @field(features, field.name) = enabled;
+            }
+        }
+    }
+    features.format = b.option(OutputFormat, "format", "Fix the monitor's output framing at build time");
+
+    const monitor = addMonitor(b, target, optimize, "zigclip-monitor", &engine_sources, features);
+    b.installArtifact(monitor);
+
+    // Prints the clipboard once and exits, for scripts
+    const paste = b.addExecutable(.{
+        .name = "zigclip-paste",
+        .target = target,
+        .optimize = optimize,
+    });
+    paste.addCSourceFiles(.{
+        .files = &.{ "src/paste.c", "src/wlr-data-control-protocol.c" },
+        .flags = &.{"-std=gnu11"},
+    });
+    paste.addIncludePath(b.path("src"));
+    paste.linkSystemLibrary("wayland-client");
+    paste.linkLibC();
+    b.installArtifact(paste);
+
+    // zig build variants: the configured monitor next to the smallest one,
+    // streaming raw text to stdout and nothing else. Their cost per event
+    // comes from running both under bench/mock-compositor.
+    const variants_step = b.step("variants", "Build specialized monitors and report their sizes");
+    const minimal = addMonitor(b, target, optimize, "zigclip-minimal", &engine_sources, Features.minimal);
+    variants_step.dependOn(&b.addInstallArtifact(monitor, .{}).step);
+    variants_step.dependOn(&b.addInstallArtifact(minimal, .{}).step);
+    variants_step.dependOn(&SizeReport.create(b, &.{ monitor, minimal }).step);
+
+    // libzigclip, static and shared. Only the zigclip_* functions of
+    // include/zigclip.h are exported.
+    const lib_flags = &.{ "-std=gnu11", "-fvisibility=hidden", "-DZIGCLIP_BUILD" };
+    const static_lib = b.addStaticLibrary(.{
+        .name = "zigclip",
+        .target = target,
+        .optimize = optimize,
+    });
+    const shared_lib = b.addSharedLibrary(.{
+        .name = "zigclip",
+        .target = target,
+        .optimize = optimize,
+        .version = .{ .major = 1, .minor = 0, .patch = 0 },
+    });
+    for ([_]*std.Build.Step.Compile{ static_lib, shared_lib }) |lib| {
+        lib.addCSourceFiles(.{ .files = &engine_sources, .flags = lib_flags });
+        lib.addCSourceFiles(.{ .files = &.{"src/zigclip.c"}, .flags = lib_flags });
+        lib.addIncludePath(b.path("src"));
+        lib.addIncludePath(b.path("include"));
+        lib.linkSystemLibrary("wayland-client");
+        lib.linkLibC();
+        lib.installHeader(b.path("include/zigclip.h"), "zigclip.h");
+        b.installArtifact(lib);
+    }
+
+    // zig build lite: the monitor on the native wire client of
+    // src/wire.zig. Without libwayland-client or libc it is fully static.
+    const lite = b.addExecutable(.{
+        .name = "zigclip-lite",
+        .root_source_file = b.path("src/lite.zig"),
+        .target = target,
+        .optimize = optimize,
+        .single_threaded = true,
+    });
+    const lite_step = b.step("lite", "Build zigclip-lite, a static monitor without libwayland");
+    lite_step.dependOn(&b.addInstallArtifact(lite, .{}).step);
+
+    // Benchmarks are plain C against the sources they measure. They are
+    // always optimized, a Debug build would only measure assertions.
+    const bench_optimize: std.builtin.OptimizeMode = if (optimize == .Debug) .ReleaseFast else optimize;
+    const bench_step = b.step("bench", "Build the benchmarks and run the microbenchmark suite");
+
+    const micro = addBench(b, bench_step, target, bench_optimize, "micro-bench", &.{
+        "bench/micro.c",
+        "src/event-loop.c",
+        "src/hash.c",
+        "src/history.c",
+        "src/json.c",
+        "src/mem.c",
+        "src/output.c",
+        "src/payload.c",
+        "src/sink.c",
+    });
+    _ = addBench(b, bench_step, target, bench_optimize, "json-escape-bench", &.{
+        "bench/json-escape.c",
+        "src/json.c",
+    });
+    _ = addBench(b, bench_step, target, bench_optimize, "ttfb-bench", &.{
+        "bench/ttfb.c",
+        "src/event-loop.c",
+        "src/json.c",
+        "src/mem.c",
+        "src/output.c",
+        "src/payload.c",
+        "src/sink.c",
+        "src/timer-wheel.c",
+        "src/transfer.c",
+    });
+    const mock = addBench(b, bench_step, target, bench_optimize, "mock-compositor", &.{
+        "bench/mock-compositor.c",
+        "src/histogram.c",
+        "src/mem.c",
+        "src/recording.c",
+        "src/wlr-data-control-protocol.c",
+    });
+    mock.linkSystemLibrary("wayland-server");
+
+    // zig build bench -- -r 20 -j results.json -b baseline.json
+    const run_micro = b.addRunArtifact(micro);
+    if (b.args) |args| {
+        run_micro.addArgs(args);
+    }
+    bench_step.dependOn(&run_micro.step);
+
+    // Cold start to exit of zigclip-paste, the mock compositor starts it
+    // over and over with a selection already current
+    const run_paste = b.addRunArtifact(mock);
+    run_paste.addArgs(&.{ "-o", "200", "-s", "4K", "--" });
+    run_paste.addArtifactArg(paste);
+    bench_step.dependOn(&run_paste.step);
+
+    // Offline helpers for files the monitor writes
+    const tools_step = b.step("tools", "Build the trace decoder");
+    _ = addBench(b, tools_step, target, optimize, "trace-decode", &.{
+        "tools/trace-decode.c",
+        "src/evtrace.c",
+        "src/mem.c",
+    });
+}
+
+fn addBench(
+    b: *std.Build,
+    step: *std.Build.Step,
+    target: std.Build.ResolvedTarget,
+    optimize: std.builtin.OptimizeMode,
+    name: []const u8,
+    files: []const []const u8,
+) *std.Build.Step.Compile {
+    const exe = b.addExecutable(.{
+        .name = name,
+        .target = target,
+        .optimize = optimize,
+    });
+    exe.addCSourceFiles(.{ .files = files, .flags = &.{"-std=gnu11"} });
+    exe.addIncludePath(b.path("src"));
+    exe.linkLibC();
+    step.dependOn(&b.addInstallArtifact(exe, .{}).step);
+    return exe;
 }
+
+// Monitor features selected at build time, passed to the C sources as
+// ZIGCLIP_FEATURE_* and ZIGCLIP_OUTPUT_FORMAT
+const Features = struct {
+    share: bool = true,
+    lazy: bool = true,
+    stream: bool = true,
+    history: bool = true,
+    latency: bool = true,
+    metrics: bool = true,
+    recording: bool = true,
+    evtrace: bool = true,
+    coalesce: bool = true,
+    deadlines: bool = true,
+    reconnect: bool = true,
+    format: ?OutputFormat = null,
+
+    const minimal: Features = .{
+        .share = false,
+        .lazy = false,
+        .stream = false,
+        .history = false,
+        .latency = false,
+        .metrics = false,
+        .recording = false,
+        .evtrace = false,
+        .coalesce = false,
+        .deadlines = false,
+        .reconnect = false,
+        .format = .raw,
+    };
+
+    fn cflags(self: Features, b: *std.Build) []const []const u8 {
+        var flags = std.ArrayList([]const u8).init(b.allocator);
+        flags.append("-std=gnu11") catch @panic("OOM");
+        inline for (@typeInfo(Features).@"struct".fields) |field| {
+            if (field.type == bool) {
+                flags.append(b.fmt("-DZIGCLIP_FEATURE_{s}={d}", .{
+                    upper(b, field.name),
+                    @intFromBool(@field(self, field.name)),
+                })) catch @panic("OOM");
+            }
+        }
+        if (self.format) |format| {
+            flags.append(b.fmt("-DZIGCLIP_OUTPUT_FORMAT=OUTPUT_{s}", .{upper(b, @tagName(format))})) catch @panic("OOM");
+        }
+        return flags.items;
+    }
+
+    fn upper(b: *std.Build, name: []const u8) []const u8 {
+        return std.ascii.allocUpperString(b.allocator, name) catch @panic("OOM");
+    }
+};
+
+const OutputFormat = enum { raw, nul, binary, ndjson };
+
+fn addMonitor(
+    b: *std.Build,
+    target: std.Build.ResolvedTarget,
+    optimize: std.builtin.OptimizeMode,
+    name: []const u8,
+    engine_sources: []const []const u8,
+    features: Features,
+) *std.Build.Step.Compile {
+    const exe = b.addExecutable(.{
+        .name = name,
+        .target = target,
+        .optimize = optimize,
+    });
+    const flags = features.cflags(b);
+    exe.addCSourceFiles(.{ .files = engine_sources, .flags = flags });
+    exe.addCSourceFiles(.{
+        .files = &.{
+            "src/main.c",
+            "src/histogram.c",
+            "src/json.c",
+            "src/latency.c",
+            "src/output.c",
+            "src/recording.c",
+            "src/share.c",
+            "src/sink.c",
+        },
+        .flags = flags,
+    });
+    exe.addIncludePath(b.path("src"));
+    exe.linkSystemLibrary("wayland-client");
+    exe.linkLibC();
+    // Code only a compiled out feature called is dropped at link time
+    exe.link_function_sections = true;
+    exe.link_data_sections = true;
+    exe.link_gc_sections = true;
+    return exe;
+}
+
+// Prints the size of each artifact once it is built
+const SizeReport = struct {
+    step: std.Build.Step,
+    artifacts: []const *std.Build.Step.Compile,
+
+    fn create(b: *std.Build, artifacts: []const *std.Build.Step.Compile) *SizeReport {
+        const report = b.allocator.create(SizeReport) catch @panic("OOM");
+        report.* = .{
+            .step = std.Build.Step.init(.{
+                .id = .custom,
+                .name = "report sizes",
+                .owner = b,
+                .makeFn = make,
+            }),
+            .artifacts = b.allocator.dupe(*std.Build.Step.Compile, artifacts) catch @panic("OOM"),
+        };
+        for (artifacts) |artifact| {
+            report.step.dependOn(&artifact.step);
+        }
+        return report;
+    }
+
+    fn make(step: *std.Build.Step, options: std.Build.Step.MakeOptions) anyerror!void {
+        _ = options;
+        const report: *SizeReport = @fieldParentPtr("step", step);
+        for (report.artifacts) |artifact| {
+            const path = artifact.getEmittedBin().getPath2(step.owner, step);
+            const stat = try std.fs.cwd().statFile(path);
+            std.debug.print("{s:<20} {d:>10} bytes\n", .{ artifact.name, stat.size });
+        }
+    }
+};
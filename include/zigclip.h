@@ -0,0 +1,121 @@
+/**
+ * libzigclip
+ *
+ * The capture engine of the monitor as a library, for programs that want
+ * clipboard contents in-process instead of spawning the monitor and
+ * parsing its output. It connects to a wlroots compositor through
+ * wlr-data-control, fetches every selection in the preferred MIME type
+ * it offers and keeps a history of the captures that can be restored as
+ * the selection later.
+ *
+ * A handle belongs to one thread: all calls on it, and the callbacks it
+ * makes, happen on the thread running zigclip_dispatch(). The Wayland
+ * socket is read and payloads are hashed on threads of the library's own.
+ *
+ * The ABI is kept stable. Structs a caller passes in start with their
+ * size, so fields can be added at the end without breaking programs built
+ * against an older header, and ZIGCLIP_ABI_VERSION only changes when
+ * something existing does.
+ */
+
+#ifndef ZIGCLIP_H
+#define ZIGCLIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZIGCLIP_ABI_VERSION 1
+
+#if defined(ZIGCLIP_BUILD) && defined(__GNUC__)
+#define ZIGCLIP_EXPORT __attribute__((visibility("default")))
+#else
+#define ZIGCLIP_EXPORT
+#endif
+
+struct zigclip;
+
+enum zigclip_flags {
+    ZIGCLIP_DEDUP = 1 << 0, // No callback for a capture identical to one in history
+};
+
+struct zigclip_options {
+    size_t size;               // sizeof(struct zigclip_options)
+    int workers;               // Hashing threads, -1 for one per core but one, 0 inline
+    int history;               // Captures kept, 0 for 100
+    uint32_t coalesce_ms;      // Fetch only once no newer selection came for this long
+    uint32_t first_byte_ms;    // Give up on a silent source, 0 for 5000
+    uint32_t total_ms;         // Give up on a transfer still running, 0 for 60000
+    uint64_t max_bytes;        // Give up on larger payloads, 0 for unlimited
+    uint32_t flags;            // enum zigclip_flags
+    // NULL terminated, most wanted first; NULL for UTF-8 text
+    const char *const *mime_types;
+};
+
+// A capture. The pointers stay valid until the next zigclip_dispatch().
+struct zigclip_entry {
+    uint64_t seq;          // Increases with every capture
+    uint64_t timestamp_ns; // CLOCK_REALTIME of the selection
+    const char *mime_type;
+    const void *data;      // NULL when size is 0
+    size_t size;
+    uint64_t hash;
+    int fd;                // Sealed memfd with the bytes, owned by the library
+};
+
+struct zigclip_stats {
+    size_t size;               // sizeof(struct zigclip_stats), set by the caller
+    uint64_t selections;       // Selection events seen
+    uint64_t coalesced;        // Replaced before they were fetched
+    uint64_t unsupported;      // Offering none of the wanted MIME types
+    uint64_t captures;         // Payloads captured
+    uint64_t duplicates;       // Captures identical to one in history
+    uint64_t failed;           // Transfers that failed or hit a limit
+    uint64_t bytes;            // Payload bytes captured
+    uint64_t restores;         // Entries set as the selection
+    int history_count;
+    uint64_t history_bytes;
+    int live_offers;           // Offers held, stays flat unless they leak
+};
+
+// Called for every new capture
+typedef void (*zigclip_callback_t)(void *data, const struct zigclip_entry *entry);
+
+// ZIGCLIP_ABI_VERSION of the library loaded
+ZIGCLIP_EXPORT uint32_t zigclip_abi_version(void);
+
+// display NULL uses WAYLAND_DISPLAY, options NULL the defaults. Returns
+// NULL with errno set, EPROTONOSUPPORT without wlr-data-control.
+ZIGCLIP_EXPORT struct zigclip *zigclip_connect(const char *display,
+                                               const struct zigclip_options *options);
+ZIGCLIP_EXPORT void zigclip_disconnect(struct zigclip *zc);
+
+// Readable whenever zigclip_dispatch() has work, for the caller's poll loop
+ZIGCLIP_EXPORT int zigclip_get_fd(struct zigclip *zc);
+// Wait up to timeout_ms (-1 blocks, 0 polls) and run whatever is due.
+// Returns -1 once the compositor connection is lost.
+ZIGCLIP_EXPORT int zigclip_dispatch(struct zigclip *zc, int timeout_ms);
+
+// Returns an id for zigclip_unsubscribe(), -1 when out of slots
+ZIGCLIP_EXPORT int zigclip_subscribe(struct zigclip *zc, zigclip_callback_t callback,
+                                     void *data);
+ZIGCLIP_EXPORT void zigclip_unsubscribe(struct zigclip *zc, int id);
+
+// Newest capture, or by age with 0 the newest. -1 with ENOENT past the end.
+ZIGCLIP_EXPORT int zigclip_get_current(struct zigclip *zc, struct zigclip_entry *entry);
+ZIGCLIP_EXPORT int zigclip_get_entry(struct zigclip *zc, int age, struct zigclip_entry *entry);
+
+// Make the history entry with this seq the selection again. The library
+// serves it until another client takes the selection.
+ZIGCLIP_EXPORT int zigclip_restore(struct zigclip *zc, uint64_t seq);
+
+ZIGCLIP_EXPORT void zigclip_get_stats(struct zigclip *zc, struct zigclip_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * Build-time feature selection
+ *
+ * build.zig passes these as -D flags to build monitors specialized for
+ * one job. Each defaults to on. A feature switched off has its option
+ * rejected, and every check for it folds to a constant false, so the
+ * compiler drops the branch together with the code behind it and the
+ * linker drops the functions only that code called.
+ */
+
+#ifndef ZIG_CLIP_BUILD_FEATURES_H
+#define ZIG_CLIP_BUILD_FEATURES_H
+
+// -s: share payloads as memfds over a Unix socket
+#ifndef ZIGCLIP_FEATURE_SHARE
+#define ZIGCLIP_FEATURE_SHARE 1
+#endif
+
+// -L: announce selections, fetch them when a subscriber asks
+#ifndef ZIGCLIP_FEATURE_LAZY
+#define ZIGCLIP_FEATURE_LAZY 1
+#endif
+
+// -S: forward payload bytes while the transfer is still running
+#ifndef ZIGCLIP_FEATURE_STREAM
+#define ZIGCLIP_FEATURE_STREAM 1
+#endif
+
+// -H and -d: keep captures in memory and skip duplicates
+#ifndef ZIGCLIP_FEATURE_HISTORY
+#define ZIGCLIP_FEATURE_HISTORY 1
+#endif
+
+// -l: per stage latency histograms
+#ifndef ZIGCLIP_FEATURE_LATENCY
+#define ZIGCLIP_FEATURE_LATENCY 1
+#endif
+
+// -P: Prometheus endpoint and the sharded counters behind it
+#ifndef ZIGCLIP_FEATURE_METRICS
+#define ZIGCLIP_FEATURE_METRICS 1
+#endif
+
+// -R: session recording for replay
+#ifndef ZIGCLIP_FEATURE_RECORDING
+#define ZIGCLIP_FEATURE_RECORDING 1
+#endif
+
+// -E: binary event trace
+#ifndef ZIGCLIP_FEATURE_EVTRACE
+#define ZIGCLIP_FEATURE_EVTRACE 1
+#endif
+
+// -c and -C: hold back selection storms, fetch each selection at once without
+#ifndef ZIGCLIP_FEATURE_COALESCE
+#define ZIGCLIP_FEATURE_COALESCE 1
+#endif
+
+// -t and -T: transfer time limits and the timer wheel behind them
+#ifndef ZIGCLIP_FEATURE_DEADLINES
+#define ZIGCLIP_FEATURE_DEADLINES 1
+#endif
+
+// Wait for a restarted compositor unless -x, exit with the first one without
+#ifndef ZIGCLIP_FEATURE_RECONNECT
+#define ZIGCLIP_FEATURE_RECONNECT 1
+#endif
+
+// ZIGCLIP_OUTPUT_FORMAT, when defined, fixes the framing to one enum
+// output_format value and -f accepts only that one.
+
+#endif
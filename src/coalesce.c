@@ -0,0 +1,105 @@
+/**
+ * Selection storm coalescing
+ */
+
+#include <string.h>
+
+#include "coalesce.h"
+#include "event-loop.h"
+#include "util.h"
+
+static void
+fire(struct coalescer *coalescer)
+{
+    void *item = coalescer->pending;
+
+    coalescer->pending = NULL;
+    coalescer->fetched++;
+    coalescer->handler->fire(coalescer->data, item, coalescer->pending_timestamp_ns);
+}
+
+static void
+handle_timer(void *data)
+{
+    struct coalescer *coalescer = data;
+
+    if (coalescer->pending) {
+        fire(coalescer);
+    }
+}
+
+int
+coalescer_init(struct coalescer *coalescer, struct event_loop *loop,
+               uint64_t window_ns, uint64_t max_delay_ns,
+               const struct coalesce_handler *handler, void *data)
+{
+    memset(coalescer, 0, sizeof(*coalescer));
+    coalescer->window_ns = window_ns;
+    coalescer->max_delay_ns = max_delay_ns < window_ns ? window_ns : max_delay_ns;
+    coalescer->handler = handler;
+    coalescer->data = data;
+
+    if (window_ns > 0) {
+        coalescer->timer = event_loop_add_timer(loop, handle_timer, coalescer);
+        if (!coalescer->timer) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+coalescer_reset(struct coalescer *coalescer)
+{
+    if (coalescer->pending) {
+        coalescer->handler->discard(coalescer->data, coalescer->pending);
+        coalescer->pending = NULL;
+    }
+    if (coalescer->timer) {
+        event_source_timer_update(coalescer->timer, 0);
+    }
+}
+
+void
+coalescer_finish(struct coalescer *coalescer)
+{
+    coalescer_reset(coalescer);
+    if (coalescer->timer) {
+        event_source_remove(coalescer->timer);
+        coalescer->timer = NULL;
+    }
+}
+
+void
+coalescer_push(struct coalescer *coalescer, void *item, uint64_t timestamp_ns)
+{
+    coalescer->seen++;
+
+    if (coalescer->window_ns == 0) {
+        coalescer->fetched++;
+        coalescer->handler->fire(coalescer->data, item, timestamp_ns);
+        return;
+    }
+
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    if (coalescer->pending) {
+        coalescer->coalesced++;
+        coalescer->handler->discard(coalescer->data, coalescer->pending);
+    } else {
+        coalescer->burst_start_ns = now;
+    }
+    coalescer->pending = item;
+    coalescer->pending_timestamp_ns = timestamp_ns;
+
+    // Restart the quiet period, but do not let a storm push it out forever
+    uint64_t deadline = now + coalescer->window_ns;
+    uint64_t latest = coalescer->burst_start_ns + coalescer->max_delay_ns;
+    if (deadline > latest) {
+        deadline = latest;
+    }
+    if (deadline <= now) {
+        fire(coalescer);
+        return;
+    }
+    event_source_timer_update(coalescer->timer, deadline - now);
+}
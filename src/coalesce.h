@@ -0,0 +1,52 @@
+/**
+ * Selection storm coalescing
+ *
+ * Some clients set the selection dozens of times per second. With a
+ * window configured, a selection is only passed on once no newer one has
+ * arrived for that long, and never later than max_delay after the first
+ * selection of the burst. Superseded selections are discarded unread.
+ */
+
+#ifndef ZIG_CLIP_COALESCE_H
+#define ZIG_CLIP_COALESCE_H
+
+#include <stdint.h>
+
+struct event_loop;
+struct event_source;
+
+struct coalesce_handler {
+    // The newest selection of a burst is due for fetching
+    void (*fire)(void *data, void *item, uint64_t timestamp_ns);
+    // A newer selection replaced this one before it was fetched
+    void (*discard)(void *data, void *item);
+};
+
+struct coalescer {
+    uint64_t window_ns;    // Quiet time before fetching, 0 fetches at once
+    uint64_t max_delay_ns; // Bound on the wait since the burst started
+
+    struct event_source *timer;
+    const struct coalesce_handler *handler;
+    void *data;
+
+    void *pending;
+    uint64_t pending_timestamp_ns;
+    uint64_t burst_start_ns;
+
+    uint64_t seen;
+    uint64_t fetched;
+    uint64_t coalesced;
+};
+
+int coalescer_init(struct coalescer *coalescer, struct event_loop *loop,
+                   uint64_t window_ns, uint64_t max_delay_ns,
+                   const struct coalesce_handler *handler, void *data);
+void coalescer_finish(struct coalescer *coalescer);
+// Discard the selection waiting out its window, if any, and stay usable
+void coalescer_reset(struct coalescer *coalescer);
+
+// A new selection, timestamp_ns is when it was announced (CLOCK_REALTIME)
+void coalescer_push(struct coalescer *coalescer, void *item, uint64_t timestamp_ns);
+
+#endif
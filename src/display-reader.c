@@ -0,0 +1,206 @@
+/**
+ * Dedicated Wayland reader thread
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <wayland-client.h>
+
+#include "display-reader.h"
+#include "event-loop.h"
+#include "evtrace.h"
+#include "mem.h"
+#include "metrics.h"
+
+struct display_reader {
+    struct wl_display *display;
+    pthread_t thread;
+
+    int wake_fd;   // Event loop -> reader: stop or flush
+    int notify_fd; // Reader -> event loop: events were read
+    struct event_source *source;
+    display_reader_func_t func;
+    void *data;
+
+    atomic_bool stopping;
+    atomic_bool failed;
+    int error; // errno of the call that failed, set before failed
+};
+
+static void
+notify(struct display_reader *reader)
+{
+    uint64_t one = 1;
+    write(reader->notify_fd, &one, sizeof(one));
+}
+
+static void *
+reader_main(void *data)
+{
+    struct display_reader *reader = data;
+    struct wl_display *display = reader->display;
+    struct pollfd fds[2] = {
+        { .fd = wl_display_get_fd(display) },
+        { .fd = reader->wake_fd, .events = POLLIN },
+    };
+
+    if (ZIGCLIP_FEATURE_METRICS)
+        metrics_thread_register();
+    if (ZIGCLIP_FEATURE_EVTRACE)
+        evtrace_thread_register("reader");
+    while (!atomic_load(&reader->stopping)) {
+        // Registry and seat events live on the default queue, served here
+        while (wl_display_prepare_read(display) != 0) {
+            if (wl_display_dispatch_pending(display) == -1)
+                goto fail;
+        }
+
+        fds[0].events = POLLIN;
+        if (wl_display_flush(display) == -1) {
+            if (errno != EAGAIN) {
+                wl_display_cancel_read(display);
+                goto fail;
+            }
+            fds[0].events |= POLLOUT;
+        }
+
+        if (poll(fds, 2, -1) == -1) {
+            wl_display_cancel_read(display);
+            if (errno == EINTR)
+                continue;
+            goto fail;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            read(reader->wake_fd, &count, sizeof(count));
+        }
+
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            if (wl_display_read_events(display) == -1)
+                goto fail;
+            metrics_add(METRICS_DISPLAY_READS, 1);
+            evtrace(EVTRACE_DISPLAY_READ, NULL, 0, 0);
+            notify(reader);
+        } else {
+            wl_display_cancel_read(display);
+        }
+    }
+    goto out;
+
+fail:
+    reader->error = errno;
+    atomic_store(&reader->failed, true);
+    notify(reader);
+out:
+    // The next reader, after a reconnect, takes over the ring and shard
+    if (ZIGCLIP_FEATURE_METRICS)
+        metrics_thread_unregister();
+    if (ZIGCLIP_FEATURE_EVTRACE)
+        evtrace_thread_unregister();
+    return NULL;
+}
+
+static void
+handle_notify(void *data, int fd, uint32_t mask)
+{
+    struct display_reader *reader = data;
+    uint64_t count;
+
+    read(fd, &count, sizeof(count));
+    reader->func(reader->data);
+}
+
+struct display_reader *
+display_reader_start(struct wl_display *display, struct event_loop *loop,
+                     display_reader_func_t func, void *data)
+{
+    struct display_reader *reader = mem_calloc(MEM_LOOP, 1, sizeof(*reader));
+    if (!reader) {
+        return NULL;
+    }
+    reader->display = display;
+    reader->func = func;
+    reader->data = data;
+    atomic_init(&reader->stopping, false);
+    atomic_init(&reader->failed, false);
+
+    reader->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    reader->notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (reader->wake_fd == -1 || reader->notify_fd == -1) {
+        goto err;
+    }
+
+    reader->source = event_loop_add_fd(loop, reader->notify_fd, EVENT_LOOP_READABLE,
+                                       handle_notify, reader);
+    if (!reader->source) {
+        goto err;
+    }
+
+    // Signals are for the event loop thread, keep them off the reader
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int ret = pthread_create(&reader->thread, NULL, reader_main, reader);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        event_source_remove(reader->source);
+        goto err;
+    }
+    return reader;
+
+err:
+    if (reader->wake_fd != -1)
+        close(reader->wake_fd);
+    if (reader->notify_fd != -1)
+        close(reader->notify_fd);
+    mem_free(MEM_LOOP, reader);
+    return NULL;
+}
+
+void
+display_reader_stop(struct display_reader *reader)
+{
+    if (!reader) {
+        return;
+    }
+
+    atomic_store(&reader->stopping, true);
+    uint64_t one = 1;
+    write(reader->wake_fd, &one, sizeof(one));
+    pthread_join(reader->thread, NULL);
+
+    event_source_remove(reader->source);
+    close(reader->wake_fd);
+    close(reader->notify_fd);
+    mem_free(MEM_LOOP, reader);
+}
+
+void
+display_reader_flush(struct display_reader *reader)
+{
+    if (wl_display_flush(reader->display) == -1 && errno == EAGAIN) {
+        uint64_t one = 1;
+        write(reader->wake_fd, &one, sizeof(one));
+    }
+}
+
+bool
+display_reader_failed(struct display_reader *reader)
+{
+    return atomic_load(&reader->failed);
+}
+
+int
+display_reader_error(struct display_reader *reader)
+{
+    return atomic_load(&reader->failed) ? reader->error : 0;
+}
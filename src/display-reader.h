@@ -0,0 +1,36 @@
+/**
+ * Dedicated Wayland reader thread
+ *
+ * One thread owns wl_display_prepare_read()/wl_display_read_events() and
+ * keeps the socket drained no matter how long capture work takes. It
+ * dispatches the default queue (registry and seat traffic) itself and
+ * pokes the event loop whenever new events were read, so the owner of a
+ * private queue can dispatch it on its own thread.
+ */
+
+#ifndef ZIG_CLIP_DISPLAY_READER_H
+#define ZIG_CLIP_DISPLAY_READER_H
+
+#include <stdbool.h>
+
+struct event_loop;
+struct display_reader;
+struct wl_display;
+
+// Called on the event loop thread after events were read or the
+// connection failed (display_reader_failed() tells which)
+typedef void (*display_reader_func_t)(void *data);
+
+struct display_reader *display_reader_start(struct wl_display *display, struct event_loop *loop,
+                                            display_reader_func_t func, void *data);
+void display_reader_stop(struct display_reader *reader);
+
+// Send queued requests; if the socket is full the reader thread finishes
+// the job once the compositor catches up
+void display_reader_flush(struct display_reader *reader);
+
+bool display_reader_failed(struct display_reader *reader);
+// Why the connection failed, the errno of the read or flush; 0 before
+int display_reader_error(struct display_reader *reader);
+
+#endif
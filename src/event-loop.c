@@ -0,0 +1,218 @@
+/**
+ * Minimal epoll based event loop
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "event-loop.h"
+#include "mem.h"
+
+struct event_source {
+    struct event_loop *loop;
+    int fd;
+    event_loop_fd_func_t func;
+    event_loop_timer_func_t timer_func; // Timers own their timerfd
+    void *timer_data;
+    void *data;
+    struct event_source *next_destroyed;
+};
+
+struct event_loop {
+    int epoll_fd;
+    // Sources removed during a dispatch are freed once the batch is done
+    struct event_source *destroyed;
+
+    event_loop_timer_func_t turn_func;
+    void *turn_data;
+};
+
+static uint32_t
+mask_to_epoll(uint32_t mask)
+{
+    uint32_t events = 0;
+    if (mask & EVENT_LOOP_READABLE)
+        events |= EPOLLIN;
+    if (mask & EVENT_LOOP_WRITABLE)
+        events |= EPOLLOUT;
+    return events;
+}
+
+static uint32_t
+epoll_to_mask(uint32_t events)
+{
+    uint32_t mask = 0;
+    if (events & EPOLLIN)
+        mask |= EVENT_LOOP_READABLE;
+    if (events & EPOLLOUT)
+        mask |= EVENT_LOOP_WRITABLE;
+    if (events & EPOLLHUP)
+        mask |= EVENT_LOOP_HANGUP;
+    if (events & EPOLLERR)
+        mask |= EVENT_LOOP_ERROR;
+    return mask;
+}
+
+struct event_loop *
+event_loop_create(void)
+{
+    struct event_loop *loop = mem_calloc(MEM_LOOP, 1, sizeof(*loop));
+    if (!loop) {
+        return NULL;
+    }
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1) {
+        mem_free(MEM_LOOP, loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+static void
+free_destroyed(struct event_loop *loop)
+{
+    while (loop->destroyed) {
+        struct event_source *source = loop->destroyed;
+        loop->destroyed = source->next_destroyed;
+        mem_free(MEM_LOOP, source);
+    }
+}
+
+void
+event_loop_destroy(struct event_loop *loop)
+{
+    free_destroyed(loop);
+    close(loop->epoll_fd);
+    mem_free(MEM_LOOP, loop);
+}
+
+struct event_source *
+event_loop_add_fd(struct event_loop *loop, int fd, uint32_t mask,
+                  event_loop_fd_func_t func, void *data)
+{
+    struct event_source *source = mem_calloc(MEM_LOOP, 1, sizeof(*source));
+    if (!source) {
+        return NULL;
+    }
+
+    source->loop = loop;
+    source->fd = fd;
+    source->func = func;
+    source->data = data;
+
+    struct epoll_event ev = { .events = mask_to_epoll(mask), .data.ptr = source };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        mem_free(MEM_LOOP, source);
+        return NULL;
+    }
+
+    return source;
+}
+
+int
+event_source_update(struct event_source *source, uint32_t mask)
+{
+    struct epoll_event ev = { .events = mask_to_epoll(mask), .data.ptr = source };
+    return epoll_ctl(source->loop->epoll_fd, EPOLL_CTL_MOD, source->fd, &ev);
+}
+
+void
+event_source_remove(struct event_source *source)
+{
+    struct event_loop *loop = source->loop;
+
+    // The fd is still open here, the owner closes it after removal
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    if (source->timer_func) {
+        close(source->fd);
+    }
+    source->fd = -1;
+    source->next_destroyed = loop->destroyed;
+    loop->destroyed = source;
+}
+
+static void
+handle_timer(void *data, int fd, uint32_t mask)
+{
+    struct event_source *source = data;
+    uint64_t expirations;
+
+    if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        source->timer_func(source->timer_data);
+    }
+}
+
+struct event_source *
+event_loop_add_timer(struct event_loop *loop, event_loop_timer_func_t func, void *data)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct event_source *source = event_loop_add_fd(loop, fd, EVENT_LOOP_READABLE,
+                                                    handle_timer, NULL);
+    if (!source) {
+        close(fd);
+        return NULL;
+    }
+    source->data = source;
+    source->timer_func = func;
+    source->timer_data = data;
+    return source;
+}
+
+int
+event_source_timer_update(struct event_source *source, uint64_t delay_ns)
+{
+    struct itimerspec its = {
+        .it_value = {
+            .tv_sec = delay_ns / 1000000000ull,
+            .tv_nsec = delay_ns % 1000000000ull,
+        },
+    };
+    return timerfd_settime(source->fd, 0, &its, NULL);
+}
+
+void
+event_loop_set_turn_func(struct event_loop *loop, event_loop_timer_func_t func, void *data)
+{
+    loop->turn_func = func;
+    loop->turn_data = data;
+}
+
+int
+event_loop_get_fd(struct event_loop *loop)
+{
+    return loop->epoll_fd;
+}
+
+int
+event_loop_dispatch(struct event_loop *loop, int timeout_ms)
+{
+    struct epoll_event events[32];
+
+    int count = epoll_wait(loop->epoll_fd, events, 32, timeout_ms);
+    if (count == -1) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct event_source *source = events[i].data.ptr;
+        if (source->fd == -1) {
+            continue; // Removed by an earlier callback in this batch
+        }
+        source->func(source->data, source->fd, epoll_to_mask(events[i].events));
+    }
+    if (loop->turn_func) {
+        loop->turn_func(loop->turn_data);
+    }
+
+    free_destroyed(loop);
+    return count;
+}
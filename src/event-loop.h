@@ -0,0 +1,54 @@
+/**
+ * Minimal epoll based event loop
+ *
+ * The monitor multiplexes the Wayland socket, the offer pipes and any
+ * client sockets on a single thread. Sources are plain file descriptors
+ * with a callback; removing a source from inside a callback is safe.
+ */
+
+#ifndef ZIG_CLIP_EVENT_LOOP_H
+#define ZIG_CLIP_EVENT_LOOP_H
+
+#include <stdint.h>
+
+enum {
+    EVENT_LOOP_READABLE = 0x01,
+    EVENT_LOOP_WRITABLE = 0x02,
+    EVENT_LOOP_HANGUP   = 0x04,
+    EVENT_LOOP_ERROR    = 0x08,
+};
+
+struct event_loop;
+struct event_source;
+
+typedef void (*event_loop_fd_func_t)(void *data, int fd, uint32_t mask);
+typedef void (*event_loop_timer_func_t)(void *data);
+
+struct event_loop *event_loop_create(void);
+void event_loop_destroy(struct event_loop *loop);
+
+struct event_source *event_loop_add_fd(struct event_loop *loop, int fd, uint32_t mask,
+                                       event_loop_fd_func_t func, void *data);
+int event_source_update(struct event_source *source, uint32_t mask);
+void event_source_remove(struct event_source *source);
+
+// One-shot timers on CLOCK_MONOTONIC, created disarmed
+struct event_source *event_loop_add_timer(struct event_loop *loop,
+                                          event_loop_timer_func_t func, void *data);
+// Fire after delay_ns, 0 disarms
+int event_source_timer_update(struct event_source *source, uint64_t delay_ns);
+
+// Run func once per dispatch, after the callbacks of all ready sources.
+// Lets a consumer of several sources order the work they flagged.
+void event_loop_set_turn_func(struct event_loop *loop, event_loop_timer_func_t func,
+                              void *data);
+
+// Readable whenever a dispatch would find work, for nesting the loop in
+// another one
+int event_loop_get_fd(struct event_loop *loop);
+
+// Wait up to timeout_ms (-1 blocks) and run the callbacks of ready sources.
+// Returns 0 when interrupted by a signal, -1 on error.
+int event_loop_dispatch(struct event_loop *loop, int timeout_ms);
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * Binary event trace
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evtrace.h"
+#include "mem.h"
+
+// Threads with a ring of their own: dispatch, reader and the workers
+#define EVTRACE_MAX_THREADS 64
+#define EVTRACE_MAX_ATOMS 1024
+
+_Thread_local struct evtrace_ring *evtrace_local_ring;
+
+static bool enabled;
+static size_t ring_size;
+static struct evtrace_ring rings[EVTRACE_MAX_THREADS];
+static int ring_count;
+static bool released[EVTRACE_MAX_THREADS]; // Owner gone, free for a thread of its name
+
+// Clock pairs to convert ticks, TSC rates are not known up front
+static uint64_t start_ticks;
+static uint64_t start_ns;
+
+static char *atoms[EVTRACE_MAX_ATOMS];
+static uint32_t atom_count;
+
+static const char *const id_names[EVTRACE_ID_COUNT] = {
+    [EVTRACE_DATA_OFFER] = "data_offer",
+    [EVTRACE_OFFER_MIME] = "offer_mime",
+    [EVTRACE_SELECTION] = "selection",
+    [EVTRACE_COALESCED] = "coalesced",
+    [EVTRACE_FETCH] = "fetch",
+    [EVTRACE_RECEIVE] = "receive",
+    [EVTRACE_DATA] = "data",
+    [EVTRACE_DONE] = "done",
+    [EVTRACE_FAILED] = "failed",
+    [EVTRACE_STAGES_BEGIN] = "stages_begin",
+    [EVTRACE_STAGES_END] = "stages_end",
+    [EVTRACE_PROCESSED] = "processed",
+    [EVTRACE_OUTPUT] = "output",
+    [EVTRACE_DISPLAY_READ] = "display_read",
+};
+
+int
+evtrace_init(size_t events)
+{
+    ring_size = 64;
+    while (ring_size < events) {
+        ring_size *= 2;
+    }
+    start_ticks = evtrace_ticks();
+    start_ns = clock_ns(CLOCK_MONOTONIC);
+    enabled = true;
+    return 0;
+}
+
+void
+evtrace_thread_register(const char *name)
+{
+    if (!enabled) {
+        return;
+    }
+
+    // A thread started again, like the reader after a reconnect, carries
+    // on in the ring of the one before it
+    int count = __atomic_load_n(&ring_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count && i < EVTRACE_MAX_THREADS; i++) {
+        if (__atomic_load_n(&released[i], __ATOMIC_ACQUIRE) &&
+            strcmp(rings[i].name, name) == 0 &&
+            __atomic_exchange_n(&released[i], false, __ATOMIC_ACQUIRE)) {
+            evtrace_local_ring = &rings[i];
+            return;
+        }
+    }
+
+    int index = __atomic_fetch_add(&ring_count, 1, __ATOMIC_RELAXED);
+    if (index >= EVTRACE_MAX_THREADS) {
+        return;
+    }
+
+    struct evtrace_ring *ring = &rings[index];
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    ring->mask = ring_size - 1;
+    // Touched here rather than by the first events, a page fault is no few ns
+    struct evtrace_event *events = mem_calloc(MEM_TELEMETRY, ring_size, sizeof(*events));
+    if (events) {
+        // The dump skips rings until their events are published
+        __atomic_store_n(&ring->events, events, __ATOMIC_RELEASE);
+        evtrace_local_ring = ring;
+    }
+}
+
+void
+evtrace_thread_unregister(void)
+{
+    struct evtrace_ring *ring = evtrace_local_ring;
+
+    if (ring) {
+        evtrace_local_ring = NULL;
+        __atomic_store_n(&released[ring - rings], true, __ATOMIC_RELEASE);
+    }
+}
+
+uint32_t
+evtrace_atom(const char *string)
+{
+    if (!enabled) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < atom_count; i++) {
+        if (strcmp(atoms[i], string) == 0) {
+            return i + 1;
+        }
+    }
+    if (atom_count == EVTRACE_MAX_ATOMS) {
+        return 0;
+    }
+    atoms[atom_count] = mem_strdup(MEM_TELEMETRY, string);
+    return atoms[atom_count] ? ++atom_count : 0;
+}
+
+const char *
+evtrace_id_name(enum evtrace_id id)
+{
+    if ((int)id <= 0 || id >= EVTRACE_ID_COUNT) {
+        return "unknown";
+    }
+    return id_names[id];
+}
+
+// Copy out what a ring still holds, racing its owner
+static size_t
+snapshot(const struct evtrace_ring *ring, struct evtrace_event *out, uint64_t *lost)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > ring_size ? head - ring_size : 0;
+
+    for (uint64_t i = first; i < head; i++) {
+        out[i - first] = ring->events[i & ring->mask];
+    }
+
+    // Slots the owner got to meanwhile, and the one it may be writing, are torn
+    uint64_t now = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t valid = now + 1 > ring_size ? now + 1 - ring_size : 0;
+    uint64_t skip = valid > first ? valid - first : 0;
+    if (skip > head - first) {
+        skip = head - first;
+    }
+    memmove(out, out + skip, (head - first - skip) * sizeof(*out));
+    *lost = first + skip;
+    return head - first - skip;
+}
+
+int
+evtrace_dump(const char *path)
+{
+    if (!enabled) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct evtrace_event *events = mem_alloc(MEM_TELEMETRY, ring_size * sizeof(*events));
+    FILE *file = fopen(path, "we");
+    if (!events || !file) {
+        goto fail;
+    }
+
+    // Rings still registering are left out, consistently in header and body
+    struct evtrace_ring *ready[EVTRACE_MAX_THREADS];
+    int count = __atomic_load_n(&ring_count, __ATOMIC_RELAXED);
+    int threads = 0;
+    for (int i = 0; i < count && i < EVTRACE_MAX_THREADS; i++) {
+        if (__atomic_load_n(&rings[i].events, __ATOMIC_ACQUIRE)) {
+            ready[threads++] = &rings[i];
+        }
+    }
+
+    uint64_t elapsed_ticks = evtrace_ticks() - start_ticks;
+    uint64_t elapsed_ns = clock_ns(CLOCK_MONOTONIC) - start_ns;
+    struct evtrace_file_header header = {
+        .magic = EVTRACE_MAGIC,
+        .version = EVTRACE_VERSION,
+        .thread_count = threads,
+        .atom_count = atom_count,
+        .ticks_per_sec = elapsed_ns ? (uint64_t)((double)elapsed_ticks * 1e9 / elapsed_ns)
+                                    : 1000000000ull,
+        .start_ticks = start_ticks,
+    };
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (uint32_t i = 0; i < atom_count; i++) {
+        uint16_t len = strlen(atoms[i]);
+        fwrite(&len, sizeof(len), 1, file);
+        fwrite(atoms[i], 1, len, file);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        struct evtrace_file_thread thread = { 0 };
+        memcpy(thread.name, ready[i]->name, sizeof(thread.name));
+        thread.count = snapshot(ready[i], events, &thread.lost);
+        fwrite(&thread, sizeof(thread), 1, file);
+        fwrite(events, sizeof(*events), thread.count, file);
+    }
+
+    if (ferror(file)) {
+        goto fail;
+    }
+    mem_free(MEM_TELEMETRY, events);
+    return fclose(file);
+
+fail:
+    if (file) {
+        fclose(file);
+    }
+    mem_free(MEM_TELEMETRY, events);
+    return -1;
+}
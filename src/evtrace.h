@@ -0,0 +1,138 @@
+/**
+ * Binary event trace
+ *
+ * Every thread that registers gets a ring of fixed size 32 byte events:
+ * what happened, the offer or payload it happened to, a MIME atom and one
+ * size or count. Writing one is a timestamp read and a few stores into
+ * memory no other thread writes, so trace points can stay in the hot
+ * paths. Without -E no ring exists and a trace point is a single branch.
+ *
+ * Rings overwrite their oldest events. A dump writes what they still hold
+ * to a file, read back by tools/trace-decode.c into one merged timeline:
+ *
+ *   header     struct evtrace_file_header
+ *   atoms      atom_count times a u16 length and the bytes, ids from 1
+ *   threads    thread_count times struct evtrace_file_thread and its events
+ */
+
+#ifndef ZIG_CLIP_EVTRACE_H
+#define ZIG_CLIP_EVTRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "build-features.h"
+#include "util.h"
+
+#define EVTRACE_MAGIC 0x4352545au // "ZTRC" little-endian
+#define EVTRACE_VERSION 1
+#define EVTRACE_THREAD_NAME 16
+
+enum evtrace_id {
+    EVTRACE_DATA_OFFER = 1, // ptr offer
+    EVTRACE_OFFER_MIME,     // ptr offer, atom MIME type
+    EVTRACE_SELECTION,      // ptr offer or 0 when cleared, arg MIME types offered
+    EVTRACE_COALESCED,      // ptr offer dropped for a newer one
+    EVTRACE_FETCH,          // ptr current offer, atom MIME type, arg seq asked for
+    EVTRACE_RECEIVE,        // ptr payload, atom MIME type, arg seq
+    EVTRACE_DATA,           // ptr payload, arg bytes read
+    EVTRACE_DONE,           // ptr payload, arg size
+    EVTRACE_FAILED,         // ptr payload, arg errno, else the limit hit
+    EVTRACE_STAGES_BEGIN,   // ptr payload, arg size, on a worker
+    EVTRACE_STAGES_END,     // ptr payload, arg hash
+    EVTRACE_PROCESSED,      // ptr payload, arg seq
+    EVTRACE_OUTPUT,         // ptr payload, arg stdout bytes accepted so far
+    EVTRACE_DISPLAY_READ,   // Wayland socket read, on the reader thread
+    EVTRACE_ID_COUNT,
+};
+
+struct evtrace_event {
+    uint64_t ticks;
+    uint64_t ptr;
+    uint64_t arg;
+    uint32_t atom;
+    uint16_t id;
+    uint16_t reserved;
+};
+
+struct evtrace_ring {
+    uint64_t head; // Events ever written, only the owner stores it
+    uint64_t mask;
+    struct evtrace_event *events;
+    char name[EVTRACE_THREAD_NAME];
+};
+
+struct evtrace_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t thread_count;
+    uint32_t atom_count;
+    uint32_t reserved;
+    uint64_t ticks_per_sec;
+    uint64_t start_ticks; // When tracing began
+};
+
+struct evtrace_file_thread {
+    char name[EVTRACE_THREAD_NAME];
+    uint64_t count;
+    uint64_t lost; // Overwritten before the dump
+};
+
+extern _Thread_local struct evtrace_ring *evtrace_local_ring;
+
+// Turn tracing on with rings of at least this many events. Call before
+// any thread registers.
+int evtrace_init(size_t events);
+// Give the calling thread a ring, if tracing is on. A ring given up by a
+// thread of the same name is taken over, events and all.
+void evtrace_thread_register(const char *name);
+// Give up the calling thread's ring before the thread exits
+void evtrace_thread_unregister(void);
+
+// Id for a string, 0 when the table is full. Dispatch thread only.
+uint32_t evtrace_atom(const char *string);
+
+// Write every ring to a file, from the dispatch thread
+int evtrace_dump(const char *path);
+
+const char *evtrace_id_name(enum evtrace_id id);
+
+static inline uint64_t
+evtrace_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return clock_ns(CLOCK_MONOTONIC);
+#endif
+}
+
+#if ZIGCLIP_FEATURE_EVTRACE
+static inline void
+evtrace(enum evtrace_id id, const void *ptr, uint32_t atom, uint64_t arg)
+{
+    struct evtrace_ring *ring = evtrace_local_ring;
+
+    if (__builtin_expect(!ring, 1)) {
+        return;
+    }
+    struct evtrace_event *event = &ring->events[ring->head & ring->mask];
+    event->ticks = evtrace_ticks();
+    event->ptr = (uintptr_t)ptr;
+    event->arg = arg;
+    event->atom = atom;
+    event->id = id;
+    // A dump reading concurrently only trusts slots behind the head
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+#else
+// Compiled out along with its arguments, which is why they must not have
+// side effects. sizeof keeps them referenced without evaluating them.
+#define evtrace(id, ptr, atom, arg) ((void)sizeof((void)(id), (void)(ptr), (void)(atom), (arg)))
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+/**
+ * Length-prefixed binary output framing (-f binary)
+ *
+ * Every record on stdout starts with a struct zc_frame_header in host byte
+ * order, followed by mime_len bytes of MIME type (not NUL terminated) and
+ * size bytes of payload. header_size covers the fixed header plus the MIME
+ * type, so readers can skip fields added by later versions.
+ *
+ * In streaming mode (-S) a payload is sent as CHUNK records as the bytes
+ * arrive, offset giving their position, and closed by an END record with
+ * no data whose offset is the total size. Records of one payload share
+ * its seq.
+ *
+ * In metadata-only mode (-L) a selection is announced by an OFFER record
+ * with no MIME type whose data is the offered MIME types, each NUL
+ * terminated. A payload fetched for it later reuses its seq.
+ */
+
+#ifndef ZIG_CLIP_FRAME_PROTOCOL_H
+#define ZIG_CLIP_FRAME_PROTOCOL_H
+
+#include <stdint.h>
+
+#define ZC_FRAME_MAGIC 0x4d52465au // "ZFRM" little-endian
+
+enum zc_frame_type {
+    ZC_FRAME_PAYLOAD = 1, // A complete clipboard payload
+    ZC_FRAME_CHUNK = 2,   // Part of a streamed payload
+    ZC_FRAME_END = 3,     // A streamed payload is complete
+    ZC_FRAME_OFFER = 4,   // A selection was announced but not fetched
+};
+
+enum zc_frame_flags {
+    ZC_FRAME_INCOMPLETE = 1 << 0, // END: the transfer failed, data is truncated
+};
+
+struct zc_frame_header {
+    uint32_t magic;
+    uint32_t header_size;  // sizeof(struct zc_frame_header) + mime_len
+    uint16_t type;         // enum zc_frame_type
+    uint16_t mime_len;
+    uint32_t flags;        // enum zc_frame_flags
+    uint64_t seq;          // Capture sequence number
+    uint64_t timestamp_ns; // CLOCK_REALTIME of the selection change
+    uint64_t offset;       // CHUNK: position in the payload, END: total size
+    uint64_t size;         // Payload bytes following the header
+};
+
+#endif
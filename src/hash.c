@@ -0,0 +1,85 @@
+/**
+ * Fast non-cryptographic 64-bit hash for payload deduplication
+ *
+ * A wyhash style multiply-fold over three independent lanes. Matches are
+ * always confirmed byte for byte, the hash only has to be quick and
+ * spread well.
+ */
+
+#include <string.h>
+
+#include "hash.h"
+
+static const uint64_t P0 = 0xa0761d6478bd642full;
+static const uint64_t P1 = 0xe7037ed1a0b428dbull;
+static const uint64_t P2 = 0x8ebc6af09c88c6e3ull;
+static const uint64_t P3 = 0x589965cc75374cc3ull;
+
+static inline uint64_t
+mix(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t
+read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t
+read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t
+hash64(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = data;
+    size_t left = len;
+    uint64_t a, b;
+
+    seed ^= mix(seed ^ P0, P1);
+
+    if (left <= 16) {
+        if (left >= 4) {
+            a = read32(p) << 32 | read32(p + ((left >> 3) << 2));
+            b = read32(p + left - 4) << 32 | read32(p + left - 4 - ((left >> 3) << 2));
+        } else if (left > 0) {
+            a = (uint64_t)p[0] << 16 | (uint64_t)p[left >> 1] << 8 | p[left - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        if (left > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = mix(read64(p) ^ P1, read64(p + 8) ^ seed);
+                see1 = mix(read64(p + 16) ^ P2, read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ P3, read64(p + 40) ^ see2);
+                p += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (left > 16) {
+            seed = mix(read64(p) ^ P1, read64(p + 8) ^ seed);
+            p += 16;
+            left -= 16;
+        }
+        a = read64(p + left - 16);
+        b = read64(p + left - 8);
+    }
+
+    a ^= P1;
+    b ^= seed;
+    __uint128_t r = (__uint128_t)a * b;
+    return mix((uint64_t)r ^ P0 ^ len, (uint64_t)(r >> 64) ^ P1);
+}
@@ -0,0 +1,13 @@
+/**
+ * Fast non-cryptographic 64-bit hash for payload deduplication
+ */
+
+#ifndef ZIG_CLIP_HASH_H
+#define ZIG_CLIP_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+#endif
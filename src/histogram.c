@@ -0,0 +1,75 @@
+/**
+ * HDR style latency histogram
+ */
+
+#include <string.h>
+
+#include "histogram.h"
+
+#define SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HALF_COUNT (SUB_COUNT / 2)
+
+int
+histogram_bucket(uint64_t value)
+{
+    if (value < SUB_COUNT) {
+        return value;
+    }
+    // Scale into [HALF_COUNT, SUB_COUNT) and stack one half range per power of two
+    int shift = 63 - __builtin_clzll(value) - (HISTOGRAM_SUB_BITS - 1);
+    return shift * HALF_COUNT + (int)(value >> shift);
+}
+
+uint64_t
+histogram_bucket_top(int bucket)
+{
+    if (bucket < SUB_COUNT) {
+        return bucket;
+    }
+    int shift = bucket / HALF_COUNT - 1;
+    uint64_t sub = bucket % HALF_COUNT + HALF_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+void
+histogram_reset(struct histogram *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->min = UINT64_MAX;
+}
+
+void
+histogram_record(struct histogram *histogram, uint64_t value)
+{
+    histogram->counts[histogram_bucket(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+uint64_t
+histogram_percentile(const struct histogram *histogram, double fraction)
+{
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(fraction * histogram->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > histogram->count)
+        rank = histogram->count;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t top = histogram_bucket_top(i);
+            return top < histogram->max ? top : histogram->max;
+        }
+    }
+    return histogram->max;
+}
@@ -0,0 +1,37 @@
+/**
+ * HDR style latency histogram
+ *
+ * Log-linear buckets: every power of two is split into 64 linear
+ * sub-buckets, so any recorded value is known to within 1/64 (about 1.6%)
+ * across the whole 64-bit range. Recording is a couple of shifts and an
+ * increment.
+ */
+
+#ifndef ZIG_CLIP_HISTOGRAM_H
+#define ZIG_CLIP_HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 7
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 2) << (HISTOGRAM_SUB_BITS - 1))
+
+struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+void histogram_reset(struct histogram *histogram);
+void histogram_record(struct histogram *histogram, uint64_t value);
+
+// Smallest value at or above the given fraction (0..1) of recorded values,
+// reported as the top of its bucket
+uint64_t histogram_percentile(const struct histogram *histogram, double fraction);
+
+// Bucket layout, for exporting the raw counts
+int histogram_bucket(uint64_t value);
+uint64_t histogram_bucket_top(int bucket);
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ * In-memory capture history
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+#include "mem.h"
+#include "payload.h"
+
+int
+history_init(struct history *history, int capacity)
+{
+    memset(history, 0, sizeof(*history));
+    if (capacity <= 0) {
+        return 0; // History disabled
+    }
+
+    // Keep the index at most half full so probe chains stay short
+    size_t index_size = 4;
+    while (index_size < (size_t)capacity * 2) {
+        index_size <<= 1;
+    }
+
+    history->entries = mem_calloc(MEM_HISTORY, capacity, sizeof(*history->entries));
+    history->index = mem_alloc(MEM_INDEX, index_size * sizeof(*history->index));
+    if (!history->entries || !history->index) {
+        mem_free(MEM_HISTORY, history->entries);
+        mem_free(MEM_INDEX, history->index);
+        return -1;
+    }
+    memset(history->index, -1, index_size * sizeof(*history->index));
+    history->index_mask = index_size - 1;
+    history->capacity = capacity;
+    return 0;
+}
+
+void
+history_finish(struct history *history)
+{
+    for (int i = 0; i < history->count; i++) {
+        payload_unref(history->entries[(history->head + i) % history->capacity].payload);
+    }
+    mem_free(MEM_HISTORY, history->entries);
+    mem_free(MEM_INDEX, history->index);
+    memset(history, 0, sizeof(*history));
+}
+
+static void
+index_insert(struct history *history, int slot)
+{
+    size_t i = history->entries[slot].hash & history->index_mask;
+    while (history->index[i] != -1) {
+        i = (i + 1) & history->index_mask;
+    }
+    history->index[i] = slot;
+}
+
+// Linear probing removal with backward shift, no tombstones to clean up
+static void
+index_remove(struct history *history, int slot)
+{
+    size_t mask = history->index_mask;
+    size_t i = history->entries[slot].hash & mask;
+    while (history->index[i] != slot) {
+        i = (i + 1) & mask;
+    }
+
+    for (size_t j = (i + 1) & mask; history->index[j] != -1; j = (j + 1) & mask) {
+        size_t home = history->entries[history->index[j]].hash & mask;
+        // Move j into the hole unless its home lies cyclically in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            history->index[i] = history->index[j];
+            i = j;
+        }
+    }
+    history->index[i] = -1;
+}
+
+struct history_entry *
+history_find(struct history *history, const struct payload *payload)
+{
+    if (history->capacity == 0) {
+        return NULL;
+    }
+
+    for (size_t i = payload->hash & history->index_mask; history->index[i] != -1;
+         i = (i + 1) & history->index_mask) {
+        struct history_entry *entry = &history->entries[history->index[i]];
+        if (entry->hash == payload->hash && entry->payload->size == payload->size &&
+            strcmp(entry->payload->mime_type, payload->mime_type) == 0 &&
+            (payload->size == 0 ||
+             memcmp(entry->payload->data, payload->data, payload->size) == 0)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+struct history_entry *
+history_append(struct history *history, struct payload *payload)
+{
+    if (history->capacity == 0) {
+        return NULL;
+    }
+
+    if (history->count == history->capacity) {
+        struct history_entry *oldest = &history->entries[history->head];
+        index_remove(history, history->head);
+        history->bytes -= oldest->payload->size;
+        payload_unref(oldest->payload);
+        history->head = (history->head + 1) % history->capacity;
+        history->count--;
+    }
+
+    int slot = (history->head + history->count) % history->capacity;
+    history->entries[slot] = (struct history_entry){
+        .payload = payload_ref(payload),
+        .hash = payload->hash,
+    };
+    index_insert(history, slot);
+    history->count++;
+    history->bytes += payload->size;
+    return &history->entries[slot];
+}
+
+struct history_entry *
+history_get(struct history *history, int age)
+{
+    if (age < 0 || age >= history->count) {
+        return NULL;
+    }
+    return &history->entries[(history->head + history->count - 1 - age) % history->capacity];
+}
@@ -0,0 +1,49 @@
+/**
+ * In-memory capture history
+ *
+ * A ring of the most recent payloads with a hash index in front of it, so
+ * a new capture can be matched against everything we still remember in
+ * O(1). Entries hold a payload reference; the bytes stay in their sealed
+ * memfds.
+ */
+
+#ifndef ZIG_CLIP_HISTORY_H
+#define ZIG_CLIP_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct payload;
+
+struct history_entry {
+    struct payload *payload;
+    uint64_t hash;
+    uint64_t hits; // Later captures that were identical
+};
+
+struct history {
+    struct history_entry *entries;
+    int capacity;
+    int head;  // Oldest entry
+    int count;
+
+    // Open addressing index of entry slots keyed by hash, -1 when empty
+    int *index;
+    size_t index_mask;
+
+    size_t bytes; // Payload bytes held
+};
+
+int history_init(struct history *history, int capacity);
+void history_finish(struct history *history);
+
+// Entry with the same bytes as payload, which must carry its hash
+struct history_entry *history_find(struct history *history, const struct payload *payload);
+
+// Remember payload (takes a reference), evicting the oldest entry if full
+struct history_entry *history_append(struct history *history, struct payload *payload);
+
+// Entry by age, 0 is the most recent
+struct history_entry *history_get(struct history *history, int age);
+
+#endif
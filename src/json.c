@@ -0,0 +1,223 @@
+/**
+ * JSON string encoding for the NDJSON output format
+ *
+ * Clips are mostly runs of plain bytes separated by the odd newline or
+ * quote, so the escaper copies clean runs a vector at a time and only
+ * drops to the scalar path for the byte that needs escaping. On x86 the
+ * widest of AVX2 and SSE2 is picked at runtime; other targets use the
+ * scalar loop.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define JSON_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#include "json.h"
+
+typedef size_t (*copy_clean_func_t)(char *dst, const char *src, size_t len);
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static inline bool
+needs_escape(unsigned char ch)
+{
+    return ch < 0x20 || ch == '"' || ch == '\\';
+}
+
+// Copy bytes up to the first one needing an escape, returns bytes copied
+static size_t
+copy_clean_scalar(char *dst, const char *src, size_t len)
+{
+    size_t i = 0;
+    for (; i < len && !needs_escape(src[i]); i++) {
+        dst[i] = src[i];
+    }
+    return i;
+}
+
+#ifdef JSON_HAVE_X86
+static size_t
+copy_clean_sse2(char *dst, const char *src, size_t len)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        // max(v, 0x1f) == 0x1f is an unsigned v <= 0x1f
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        unsigned mask = _mm_movemask_epi8(special);
+        if (mask) {
+            size_t n = __builtin_ctz(mask);
+            memcpy(dst + i, src + i, n);
+            return i + n;
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+
+    return i + copy_clean_scalar(dst + i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+copy_clean_avx2(char *dst, const char *src, size_t len)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+            _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control));
+        unsigned mask = _mm256_movemask_epi8(special);
+        if (mask) {
+            size_t n = __builtin_ctz(mask);
+            memcpy(dst + i, src + i, n);
+            return i + n;
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+
+    return i + copy_clean_sse2(dst + i, src + i, len - i);
+}
+#endif
+
+static copy_clean_func_t copy_clean;
+static const char *copy_clean_isa;
+
+// Pick the widest implementation once, racing threads agree on the result
+static void
+resolve_copy_clean(void)
+{
+#ifdef JSON_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        copy_clean_isa = "avx2";
+        copy_clean = copy_clean_avx2;
+        return;
+    }
+    copy_clean_isa = "sse2";
+    copy_clean = copy_clean_sse2;
+#else
+    copy_clean_isa = "scalar";
+    copy_clean = copy_clean_scalar;
+#endif
+}
+
+const char *
+json_escape_isa(void)
+{
+    if (!copy_clean) {
+        resolve_copy_clean();
+    }
+    return copy_clean_isa;
+}
+
+// Write the escape sequence for ch, returns 0 when it does not fit
+static size_t
+escape_byte(char *dst, size_t room, unsigned char ch)
+{
+    char short_escape = 0;
+
+    switch (ch) {
+        case '"':  short_escape = '"'; break;
+        case '\\': short_escape = '\\'; break;
+        case '\b': short_escape = 'b'; break;
+        case '\f': short_escape = 'f'; break;
+        case '\n': short_escape = 'n'; break;
+        case '\r': short_escape = 'r'; break;
+        case '\t': short_escape = 't'; break;
+    }
+
+    if (short_escape) {
+        if (room < 2)
+            return 0;
+        dst[0] = '\\';
+        dst[1] = short_escape;
+        return 2;
+    }
+
+    if (room < 6)
+        return 0;
+    dst[0] = '\\';
+    dst[1] = 'u';
+    dst[2] = '0';
+    dst[3] = '0';
+    dst[4] = hex_digits[ch >> 4];
+    dst[5] = hex_digits[ch & 0xf];
+    return 6;
+}
+
+size_t
+json_escape(char *dst, size_t dst_size, const char *src, size_t len,
+            size_t *consumed)
+{
+    if (!copy_clean) {
+        resolve_copy_clean();
+    }
+
+    size_t out = 0;
+    size_t i = 0;
+
+    while (i < len && out < dst_size) {
+        size_t room = dst_size - out;
+        size_t n = len - i < room ? len - i : room;
+
+        size_t copied = copy_clean(dst + out, src + i, n);
+        i += copied;
+        out += copied;
+        if (copied == n) {
+            continue; // Input done or output full
+        }
+
+        size_t escaped = escape_byte(dst + out, dst_size - out, src[i]);
+        if (escaped == 0) {
+            break;
+        }
+        out += escaped;
+        i++;
+    }
+
+    *consumed = i;
+    return out;
+}
+
+size_t
+json_base64(char *dst, const unsigned char *src, size_t len)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t out = 0;
+    size_t i = 0;
+
+    for (; i + 3 <= len; i += 3) {
+        unsigned int v = src[i] << 16 | src[i + 1] << 8 | src[i + 2];
+        dst[out++] = alphabet[v >> 18];
+        dst[out++] = alphabet[(v >> 12) & 0x3f];
+        dst[out++] = alphabet[(v >> 6) & 0x3f];
+        dst[out++] = alphabet[v & 0x3f];
+    }
+
+    if (i < len) {
+        unsigned int v = src[i] << 16;
+        if (i + 1 < len)
+            v |= src[i + 1] << 8;
+        dst[out++] = alphabet[v >> 18];
+        dst[out++] = alphabet[(v >> 12) & 0x3f];
+        dst[out++] = i + 1 < len ? alphabet[(v >> 6) & 0x3f] : '=';
+        dst[out++] = '=';
+    }
+
+    return out;
+}
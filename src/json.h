@@ -0,0 +1,30 @@
+/**
+ * JSON string encoding for the NDJSON output format
+ */
+
+#ifndef ZIG_CLIP_JSON_H
+#define ZIG_CLIP_JSON_H
+
+#include <stddef.h>
+
+// Escape len bytes of src for use inside a JSON string. Writes at most
+// dst_size bytes and returns how many were written; *consumed receives the
+// number of input bytes handled, which is less than len when dst filled up.
+// Quotes, backslashes and control characters are escaped, all other bytes
+// are copied as they are. Clean runs are copied with SSE2/AVX2 on x86.
+size_t json_escape(char *dst, size_t dst_size, const char *src, size_t len,
+                   size_t *consumed);
+
+// Name of the instruction set json_escape() dispatched to
+const char *json_escape_isa(void);
+
+// Standard base64 used for payloads that are not text
+static inline size_t
+json_base64_size(size_t len)
+{
+    return (len + 2) / 3 * 4;
+}
+
+size_t json_base64(char *dst, const unsigned char *src, size_t len);
+
+#endif
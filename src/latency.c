@@ -0,0 +1,125 @@
+/**
+ * Capture latency tracing
+ */
+
+#include <stdlib.h>
+
+#include "latency.h"
+#include "mem.h"
+#include "util.h"
+
+static const char *stage_names[LATENCY_STAGE_COUNT] = {
+    [LATENCY_STAGE_QUEUE] = "queue",
+    [LATENCY_STAGE_SOURCE] = "source",
+    [LATENCY_STAGE_TRANSFER] = "transfer",
+    [LATENCY_STAGE_PROCESS] = "process",
+    [LATENCY_STAGE_OUTPUT] = "output",
+    [LATENCY_STAGE_TOTAL] = "total",
+};
+
+struct latency *
+latency_create(void)
+{
+    struct latency *latency = mem_calloc(MEM_TELEMETRY, 1, sizeof(*latency));
+    if (!latency) {
+        return NULL;
+    }
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        histogram_reset(&latency->stages[i]);
+    }
+    return latency;
+}
+
+void
+latency_destroy(struct latency *latency)
+{
+    mem_free(MEM_TELEMETRY, latency);
+}
+
+const char *
+latency_stage_name(enum latency_stage stage)
+{
+    return stage_names[stage];
+}
+
+// Marks are 0 where a step did not happen, such as a failed transfer
+static void
+record_gap(struct latency *latency, enum latency_stage stage, uint64_t from, uint64_t to)
+{
+    if (from && to >= from) {
+        histogram_record(&latency->stages[stage], to - from);
+    }
+}
+
+void
+latency_record_capture(struct latency *latency, const uint64_t *marks)
+{
+    record_gap(latency, LATENCY_STAGE_QUEUE, marks[LATENCY_SELECTED], marks[LATENCY_REQUESTED]);
+    record_gap(latency, LATENCY_STAGE_SOURCE, marks[LATENCY_REQUESTED], marks[LATENCY_FIRST_BYTE]);
+    record_gap(latency, LATENCY_STAGE_TRANSFER, marks[LATENCY_FIRST_BYTE], marks[LATENCY_EOF]);
+    record_gap(latency, LATENCY_STAGE_PROCESS, marks[LATENCY_EOF], marks[LATENCY_PROCESSED]);
+}
+
+static void
+flushed(struct latency *latency, const struct latency_flush *flush, uint64_t now)
+{
+    record_gap(latency, LATENCY_STAGE_OUTPUT, flush->last_ns, now);
+    record_gap(latency, LATENCY_STAGE_TOTAL, flush->selected_ns, now);
+}
+
+void
+latency_record_output(struct latency *latency, const uint64_t *marks,
+                      uint64_t position, uint64_t written)
+{
+    // Streamed payloads go out before they are processed
+    struct latency_flush flush = {
+        .position = position,
+        .selected_ns = marks[LATENCY_SELECTED],
+        .last_ns = marks[LATENCY_PROCESSED] ? marks[LATENCY_PROCESSED] : marks[LATENCY_EOF],
+    };
+
+    if (written >= position) {
+        flushed(latency, &flush, clock_ns(CLOCK_MONOTONIC));
+        return;
+    }
+
+    if (latency->flush_count == LATENCY_FLUSH_MAX) {
+        latency->flush_head = (latency->flush_head + 1) % LATENCY_FLUSH_MAX;
+        latency->flush_count--;
+        latency->flush_dropped++;
+    }
+    int tail = (latency->flush_head + latency->flush_count) % LATENCY_FLUSH_MAX;
+    latency->flush[tail] = flush;
+    latency->flush_count++;
+}
+
+void
+latency_output_progress(struct latency *latency, uint64_t written)
+{
+    uint64_t now = 0;
+
+    while (latency->flush_count > 0 &&
+           latency->flush[latency->flush_head].position <= written) {
+        if (!now)
+            now = clock_ns(CLOCK_MONOTONIC);
+        flushed(latency, &latency->flush[latency->flush_head], now);
+        latency->flush_head = (latency->flush_head + 1) % LATENCY_FLUSH_MAX;
+        latency->flush_count--;
+    }
+}
+
+void
+latency_print(const struct latency *latency, FILE *out)
+{
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        const struct histogram *h = &latency->stages[i];
+        fprintf(out, "latency %-8s n=%llu p50=%.3fms p99=%.3fms p999=%.3fms max=%.3fms\n",
+                stage_names[i], (unsigned long long)h->count,
+                histogram_percentile(h, 0.5) / 1e6, histogram_percentile(h, 0.99) / 1e6,
+                histogram_percentile(h, 0.999) / 1e6, h->max / 1e6);
+    }
+    if (latency->flush_dropped) {
+        fprintf(out, "latency output marks dropped: %llu\n",
+                (unsigned long long)latency->flush_dropped);
+    }
+}
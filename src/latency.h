@@ -0,0 +1,73 @@
+/**
+ * Capture latency tracing
+ *
+ * Each payload carries CLOCK_MONOTONIC marks for the points it passes on
+ * its way from the selection event to our stdout. The gaps between them
+ * are aggregated into one histogram per stage. Tracing is off unless
+ * enabled, and then costs a clock read per mark.
+ */
+
+#ifndef ZIG_CLIP_LATENCY_H
+#define ZIG_CLIP_LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "histogram.h"
+
+enum latency_mark {
+    LATENCY_SELECTED,   // data_device_selection, or the fetch request in -L mode
+    LATENCY_REQUESTED,  // Receive request flushed to the compositor
+    LATENCY_FIRST_BYTE,
+    LATENCY_EOF,        // Source closed the pipe
+    LATENCY_PROCESSED,  // Pipeline done
+    LATENCY_MARK_COUNT,
+};
+
+enum latency_stage {
+    LATENCY_STAGE_QUEUE,    // Selected to requested: coalescing and queueing
+    LATENCY_STAGE_SOURCE,   // Requested to first byte: the source client
+    LATENCY_STAGE_TRANSFER, // First byte to EOF
+    LATENCY_STAGE_PROCESS,  // EOF to processed
+    LATENCY_STAGE_OUTPUT,   // Last step before the record went out to flushed
+    LATENCY_STAGE_TOTAL,    // Selected to flushed
+    LATENCY_STAGE_COUNT,
+};
+
+// Records written to the sink but still queued behind a slow reader
+#define LATENCY_FLUSH_MAX 256
+
+struct latency_flush {
+    uint64_t position; // Sink byte position at the end of the record
+    uint64_t selected_ns;
+    uint64_t last_ns;  // Start of the output stage
+};
+
+struct latency {
+    struct histogram stages[LATENCY_STAGE_COUNT];
+
+    struct latency_flush flush[LATENCY_FLUSH_MAX];
+    int flush_head;
+    int flush_count;
+    uint64_t flush_dropped;
+};
+
+struct latency *latency_create(void);
+void latency_destroy(struct latency *latency);
+
+const char *latency_stage_name(enum latency_stage stage);
+
+// A payload made it through the pipeline
+void latency_record_capture(struct latency *latency, const uint64_t *marks);
+
+// The payload's last record was handed to the sink and ends at byte
+// position; written is how far the sink has got
+void latency_record_output(struct latency *latency, const uint64_t *marks,
+                           uint64_t position, uint64_t written);
+// The sink wrote more of its backlog
+void latency_output_progress(struct latency *latency, uint64_t written);
+
+// p50/p99/p999/max per stage in milliseconds
+void latency_print(const struct latency *latency, FILE *out);
+
+#endif
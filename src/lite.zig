@@ -0,0 +1,221 @@
+//! zigclip-lite: a clipboard monitor on the native wire client.
+//!
+//! Prints every text selection to stdout followed by a newline, like the
+//! monitor's raw output. Without libwayland-client or libc it links into
+//! a small static binary that starts without loading anything.
+
+const std = @import("std");
+const protocol = @import("protocol.zig");
+const wire = @import("wire.zig");
+
+const posix = std.posix;
+
+// Most wanted first
+const text_types = [_][:0]const u8{
+    "text/plain;charset=utf-8",
+    "text/plain",
+    "UTF8_STRING",
+    "STRING",
+    "TEXT",
+};
+const no_text = text_types.len;
+
+// Offers announced but not selected yet, a handful at most
+const max_offers = 8;
+
+// The monitor's default transfer limits: a source that sends nothing, or
+// never closes its end, is given up on instead of stalling every later
+// selection
+const first_byte_ms = 5000;
+const total_ms = 60000;
+
+const Offer = struct {
+    object: wire.Object = .none,
+    // Index into text_types of the best type offered
+    rank: usize = no_text,
+};
+
+const Monitor = struct {
+    registry: wire.Object = .none,
+    seat: wire.Object = .none,
+    manager: wire.Object = .none,
+    offers: [max_offers]Offer = [_]Offer{.{}} ** max_offers,
+    // Newest selection, fetched once the batch it came in is dispatched
+    selection: ?Offer = null,
+    finished: bool = false,
+
+    pub fn wl_registry(self: *Monitor, conn: *wire.Connection, object: wire.Object, event: protocol.WlRegistry.Event) !void {
+        const global = switch (event) {
+            .global => |e| e,
+            .global_remove => return,
+        };
+        if (self.seat == .none and std.mem.eql(u8, global.interface, "wl_seat")) {
+            const seat = try conn.create(.wl_seat);
+            try conn.send(object, .wl_registry, .{ .bind = .{
+                .name = global.name,
+                .id = .{ .interface = "wl_seat", .version = 1, .id = seat.object() },
+            } });
+            self.seat = seat.object();
+        } else if (self.manager == .none and std.mem.eql(u8, global.interface, "zwlr_data_control_manager_v1")) {
+            const manager = try conn.create(.zwlr_data_control_manager_v1);
+            try conn.send(object, .wl_registry, .{ .bind = .{
+                .name = global.name,
+                .id = .{ .interface = "zwlr_data_control_manager_v1", .version = 1, .id = manager.object() },
+            } });
+            self.manager = manager.object();
+        }
+    }
+
+    pub fn zwlr_data_control_device_v1(self: *Monitor, conn: *wire.Connection, _: wire.Object, event: protocol.DataControlDevice.Event) !void {
+        switch (event) {
+            .data_offer => |e| {
+                const offer = self.slot(.none) orelse {
+                    // Out of slots, the compositor floods us with offers
+                    try conn.destroy(e.id.object(), .zwlr_data_control_offer_v1);
+                    return;
+                };
+                offer.* = .{ .object = e.id.object() };
+            },
+            .selection => |e| {
+                if (self.selection) |previous| {
+                    try conn.destroy(previous.object, .zwlr_data_control_offer_v1);
+                }
+                self.selection = null;
+                if (e.id == .none) {
+                    return;
+                }
+                const offer = self.slot(e.id) orelse {
+                    // Not tracked, the offer came while the slots were full
+                    if (conn.alive(e.id)) {
+                        try conn.destroy(e.id, .zwlr_data_control_offer_v1);
+                    }
+                    return;
+                };
+                self.selection = offer.*;
+                offer.* = .{};
+            },
+            .primary_selection => |e| {
+                if (e.id != .none) {
+                    if (self.slot(e.id)) |offer| {
+                        offer.* = .{};
+                    }
+                    if (conn.alive(e.id)) {
+                        try conn.destroy(e.id, .zwlr_data_control_offer_v1);
+                    }
+                }
+            },
+            .finished => self.finished = true,
+        }
+    }
+
+    pub fn zwlr_data_control_offer_v1(self: *Monitor, _: *wire.Connection, object: wire.Object, event: protocol.DataControlOffer.Event) !void {
+        const offer = self.slot(object) orelse return;
+        for (text_types[0..offer.rank], 0..) |mime_type, rank| {
+            if (std.mem.eql(u8, event.offer.mime_type, mime_type)) {
+                offer.rank = rank;
+                break;
+            }
+        }
+    }
+
+    fn slot(self: *Monitor, object: wire.Object) ?*Offer {
+        for (&self.offers) |*offer| {
+            if (offer.object == object) {
+                return offer;
+            }
+        }
+        return null;
+    }
+
+    // Receive the selection into a pipe and copy it to stdout
+    fn capture(self: *Monitor, conn: *wire.Connection) !void {
+        const offer = self.selection orelse return;
+        if (offer.rank == no_text) {
+            return;
+        }
+
+        const pipe = try posix.pipe2(.{ .CLOEXEC = true });
+        defer posix.close(pipe[0]);
+        {
+            defer posix.close(pipe[1]);
+            try conn.send(offer.object, .zwlr_data_control_offer_v1, .{ .receive = .{
+                .mime_type = text_types[offer.rank],
+                .fd = @enumFromInt(pipe[1]),
+            } });
+            try conn.flush();
+        }
+
+        const start = try std.time.Instant.now();
+        var received: usize = 0;
+        var buf: [16384]u8 = undefined;
+        while (true) {
+            const limit_ms: u64 = if (received == 0) first_byte_ms else total_ms;
+            const elapsed_ms = (try std.time.Instant.now()).since(start) / std.time.ns_per_ms;
+            if (elapsed_ms >= limit_ms) {
+                std.log.warn("selection cut: {s} limit", .{if (received == 0) "first byte" else "total"});
+                // Close a record already started, like the monitor does
+                if (received == 0) {
+                    return;
+                }
+                break;
+            }
+            var fds = [_]posix.pollfd{.{ .fd = pipe[0], .events = posix.POLL.IN, .revents = 0 }};
+            if (try posix.poll(&fds, @intCast(limit_ms - elapsed_ms)) == 0) {
+                continue;
+            }
+            const n = try posix.read(pipe[0], &buf);
+            if (n == 0) {
+                break;
+            }
+            received += n;
+            try writeAll(buf[0..n]);
+        }
+        try writeAll("\n");
+    }
+};
+
+fn writeAll(bytes: []const u8) !void {
+    var written: usize = 0;
+    while (written < bytes.len) {
+        written += try posix.write(posix.STDOUT_FILENO, bytes[written..]);
+    }
+}
+
+pub fn main() !u8 {
+    var conn: wire.Connection = undefined;
+    conn.connect() catch |err| {
+        std.log.err("cannot connect to the compositor: {s}", .{@errorName(err)});
+        return 1;
+    };
+    defer conn.close();
+
+    var monitor = Monitor{};
+    const registry = try conn.create(.wl_registry);
+    try conn.send(wire.display, .wl_display, .{ .get_registry = .{ .registry = registry } });
+    monitor.registry = registry.object();
+    try conn.roundtrip(&monitor);
+
+    if (monitor.seat == .none or monitor.manager == .none) {
+        std.log.err("the compositor does not support wlr-data-control", .{});
+        return 1;
+    }
+    const device = try conn.create(.zwlr_data_control_device_v1);
+    try conn.send(monitor.manager, .zwlr_data_control_manager_v1, .{ .get_data_device = .{
+        .id = device,
+        .seat = monitor.seat,
+    } });
+    try conn.flush();
+
+    // Selections replaced within one read are never fetched
+    while (!monitor.finished) {
+        try conn.read();
+        try conn.dispatch(&monitor);
+        try monitor.capture(&conn);
+        if (monitor.selection) |offer| {
+            try conn.destroy(offer.object, .zwlr_data_control_offer_v1);
+            monitor.selection = null;
+        }
+        try conn.flush();
+    }
+    return 0;
+}
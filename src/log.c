@@ -0,0 +1,265 @@
+/**
+ * Asynchronous logging
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "mem.h"
+#include "queue.h"
+#include "util.h"
+
+// Records in flight at most, 256 bytes each
+#define LOG_RECORDS 1024
+#define LOG_TEXT_MAX 240
+// Formatted lines are collected up to this much before a write
+#define LOG_BATCH_SIZE 16384
+
+struct log_record {
+    uint64_t time_ns; // CLOCK_REALTIME
+    int level;
+    int len;
+    char text[LOG_TEXT_MAX];
+};
+
+int log_threshold = LOG_ERROR;
+
+static const char *const level_names[] = {
+    [LOG_ERROR] = "error",
+    [LOG_WARN] = "warn",
+    [LOG_INFO] = "info",
+    [LOG_DEBUG] = "debug",
+};
+
+static struct {
+    bool running;
+    pthread_t thread;
+    struct log_record *records;
+    struct queue free_records;
+    struct queue ready;
+    sem_t wake;
+    atomic_bool sleeping; // Writer waits on wake, the next producer posts it
+    atomic_bool stopping;
+    atomic_uint_fast64_t dropped;
+
+    char batch[LOG_BATCH_SIZE];
+    size_t batch_len;
+} logger;
+
+void
+log_set_level(enum log_level level)
+{
+    __atomic_store_n(&log_threshold, level, __ATOMIC_RELAXED);
+}
+
+enum log_level
+log_get_level(void)
+{
+    return __atomic_load_n(&log_threshold, __ATOMIC_RELAXED);
+}
+
+bool
+log_parse_level(const char *name, enum log_level *level)
+{
+    for (size_t i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        if (strcmp(name, level_names[i]) == 0) {
+            *level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *
+log_level_name(enum log_level level)
+{
+    return level <= LOG_DEBUG ? level_names[level] : "unknown";
+}
+
+static void
+flush_batch(void)
+{
+    size_t written = 0;
+
+    while (written < logger.batch_len) {
+        ssize_t n = write(STDERR_FILENO, logger.batch + written, logger.batch_len - written);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break; // Nowhere to report it, the lines are lost
+        }
+        written += n;
+    }
+    logger.batch_len = 0;
+}
+
+// HH:MM:SS.uuuuuu level text
+static void
+append_line(uint64_t time_ns, int level, const char *text, int len)
+{
+    char stamp[32];
+    time_t seconds = time_ns / 1000000000ull;
+    struct tm tm;
+
+    localtime_r(&seconds, &tm);
+    snprintf(stamp, sizeof(stamp), "%02d:%02d:%02d.%06u", tm.tm_hour, tm.tm_min, tm.tm_sec,
+             (unsigned)(time_ns % 1000000000ull / 1000));
+
+    size_t needed = strlen(stamp) + len + 16;
+    if (logger.batch_len + needed > sizeof(logger.batch)) {
+        flush_batch();
+    }
+    logger.batch_len += snprintf(logger.batch + logger.batch_len,
+                                 sizeof(logger.batch) - logger.batch_len, "%s %-5s %.*s\n",
+                                 stamp, level_names[level], len, text);
+}
+
+static void *
+writer_main(void *data)
+{
+    for (;;) {
+        struct log_record *record = queue_pop(&logger.ready);
+
+        if (!record) {
+            flush_batch();
+            if (atomic_load(&logger.stopping)) {
+                return NULL;
+            }
+            atomic_store(&logger.sleeping, true);
+            // A producer may have pushed before it could see the flag
+            record = queue_pop(&logger.ready);
+            if (!record) {
+                while (sem_wait(&logger.wake) == -1 && errno == EINTR)
+                    ;
+                continue;
+            }
+            atomic_store(&logger.sleeping, false);
+        }
+
+        uint64_t dropped = atomic_exchange(&logger.dropped, 0);
+        if (dropped) {
+            char text[64];
+            int len = snprintf(text, sizeof(text), "%llu log messages dropped",
+                               (unsigned long long)dropped);
+            append_line(record->time_ns, LOG_WARN, text, len);
+        }
+        append_line(record->time_ns, record->level, record->text, record->len);
+
+        // Sized for every record, returning one cannot fail
+        queue_push(&logger.free_records, record);
+    }
+}
+
+int
+log_start(enum log_level level)
+{
+    log_set_level(level);
+
+    logger.records = mem_calloc(MEM_TELEMETRY, LOG_RECORDS, sizeof(*logger.records));
+    if (!logger.records) {
+        return -1;
+    }
+    if (queue_init(&logger.free_records, LOG_RECORDS) == -1) {
+        goto fail_records;
+    }
+    if (queue_init(&logger.ready, LOG_RECORDS) == -1) {
+        goto fail_free;
+    }
+    for (int i = 0; i < LOG_RECORDS; i++) {
+        queue_push(&logger.free_records, &logger.records[i]);
+    }
+    if (sem_init(&logger.wake, 0, 0) == -1) {
+        goto fail_ready;
+    }
+    atomic_init(&logger.sleeping, false);
+    atomic_init(&logger.stopping, false);
+    atomic_init(&logger.dropped, 0);
+
+    int error = pthread_create(&logger.thread, NULL, writer_main, NULL);
+    if (error) {
+        errno = error;
+        goto fail_sem;
+    }
+    logger.running = true;
+    return 0;
+
+fail_sem:
+    sem_destroy(&logger.wake);
+fail_ready:
+    queue_finish(&logger.ready);
+fail_free:
+    queue_finish(&logger.free_records);
+fail_records:
+    mem_free(MEM_TELEMETRY, logger.records);
+    logger.records = NULL;
+    return -1;
+}
+
+void
+log_stop(void)
+{
+    if (!logger.running) {
+        return;
+    }
+    logger.running = false;
+    atomic_store(&logger.stopping, true);
+    sem_post(&logger.wake);
+    pthread_join(logger.thread, NULL);
+
+    sem_destroy(&logger.wake);
+    queue_finish(&logger.ready);
+    queue_finish(&logger.free_records);
+    mem_free(MEM_TELEMETRY, logger.records);
+    logger.records = NULL;
+}
+
+void
+log_write(enum log_level level, const char *fmt, ...)
+{
+    va_list args;
+
+    if (!logger.running) {
+        // Before log_start() or after log_stop(), nothing to keep waiting
+        char text[LOG_TEXT_MAX];
+        va_start(args, fmt);
+        int len = vsnprintf(text, sizeof(text), fmt, args);
+        va_end(args);
+        fprintf(stderr, "%s\n", len < 0 ? fmt : text);
+        return;
+    }
+
+    struct log_record *record = queue_pop(&logger.free_records);
+    if (!record) {
+        atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    record->time_ns = clock_ns(CLOCK_REALTIME);
+    record->level = level;
+    va_start(args, fmt);
+    int len = vsnprintf(record->text, sizeof(record->text), fmt, args);
+    va_end(args);
+    if (len < 0) {
+        len = 0;
+    } else if (len >= (int)sizeof(record->text)) {
+        len = sizeof(record->text) - 1;
+        memcpy(record->text + len - 3, "...", 3);
+    }
+    record->len = len;
+
+    queue_push(&logger.ready, record);
+    if (atomic_exchange(&logger.sleeping, false)) {
+        sem_post(&logger.wake);
+    }
+}
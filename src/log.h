@@ -0,0 +1,64 @@
+/**
+ * Asynchronous logging
+ *
+ * Callbacks on the dispatch thread must not block on a terminal or a full
+ * pipe, so a log call only renders its message into a fixed size record
+ * from a preallocated pool and pushes it onto a lock-free queue. A
+ * background thread stamps, formats and writes the records to stderr.
+ * Producers only make a system call to wake that thread when it went to
+ * sleep on an empty queue, so a burst costs one wakeup.
+ *
+ * When the pool runs dry messages are dropped and counted; the writer
+ * reports the count with the next record it gets. Messages below the
+ * current level cost one relaxed load, and the level can be changed at
+ * any time.
+ */
+
+#ifndef ZIG_CLIP_LOG_H
+#define ZIG_CLIP_LOG_H
+
+#include <stdbool.h>
+
+enum log_level {
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+};
+
+extern int log_threshold;
+
+// Start the writer thread, logging at level and above. If it cannot be
+// started the level still applies and messages go straight to stderr.
+int log_start(enum log_level level);
+// Write out what is queued and stop the writer. Messages logged after this
+// go straight to stderr.
+void log_stop(void);
+
+void log_set_level(enum log_level level);
+enum log_level log_get_level(void);
+bool log_parse_level(const char *name, enum log_level *level);
+const char *log_level_name(enum log_level level);
+
+// Cheap enough to guard work done only for a message
+static inline bool
+log_enabled(enum log_level level)
+{
+    return (int)level <= __atomic_load_n(&log_threshold, __ATOMIC_RELAXED);
+}
+
+void log_write(enum log_level level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#define log_at(level, ...)                 \
+    do {                                   \
+        if (log_enabled(level))            \
+            log_write(level, __VA_ARGS__); \
+    } while (0)
+
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_WARN, __VA_ARGS__)
+#define log_info(...) log_at(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+
+#endif
@@ -5,6 +5,7 @@
  * Works with wlroots-based compositors like Sway.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,12 +14,72 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <pthread.h>
+#include <limits.h>
 #include <time.h>
+#include <sys/inotify.h>
 #include <wayland-client.h>
 
 // Include the wlr-data-control protocol
 #include "wlr-data-control-protocol.h"
 
+#include "build-features.h"
+#include "coalesce.h"
+#include "display-reader.h"
+#include "event-loop.h"
+#include "evtrace.h"
+#include "history.h"
+#include "latency.h"
+#include "log.h"
+#include "mem.h"
+#include "metrics.h"
+#include "offer.h"
+#include "output.h"
+#include "payload.h"
+#include "pipeline.h"
+#include "recording.h"
+#include "share.h"
+#include "sink.h"
+#include "timer-wheel.h"
+#include "transfer.h"
+#include "util.h"
+
+// Selections that arrive while a transfer is running wait here
+#define MAX_PENDING_CAPTURES 16
+
+// Offer pipes drained at the same time
+#define MAX_ACTIVE_TRANSFERS 4
+
+// Most pipeline workers -w takes, far past any gain on the queue
+#define MAX_WORKERS 256
+
+// MIME types with a captured bytes series of their own, later ones share
+// "other" so sources cannot grow the scrape without bound
+#define METRICS_MIME_LABELS 16
+
+// Events each thread's trace ring holds, 2 MiB at 32 bytes each
+#define EVTRACE_EVENTS 65536
+
+// Resolution of transfer deadlines
+#define TIMER_TICK_NS (10 * 1000000ull)
+
+// Wait between attempts to reach a restarted compositor, doubling up to the max
+#define RECONNECT_MIN_NS (10 * 1000000ull)
+#define RECONNECT_MAX_NS (1000 * 1000000ull)
+
+struct pending_capture {
+    struct offer *offer;
+    uint64_t timestamp_ns;
+    uint64_t seq; // Announced in metadata-only mode, else assigned on fetch
+    uint64_t selected_ns; // Latency trace start
+    char mime_type[PAYLOAD_MIME_MAX];
+};
+
+struct mime_bytes {
+    char mime_type[PAYLOAD_MIME_MAX];
+    uint64_t bytes;
+};
+
 struct client_state {
     struct wl_display *display;
     struct wl_registry *registry;
@@ -26,84 +87,712 @@ struct client_state {
     // wlr-data-control specific objects
     struct zwlr_data_control_manager_v1 *data_control_manager;
     struct zwlr_data_control_device_v1 *data_control_device;
-    struct zwlr_data_control_offer_v1 *current_offer;
     struct wl_seat *seat;
+
+    struct event_loop *loop;
+    struct display_reader *reader; // Thread keeping the socket drained
+    struct wl_event_queue *device_queue; // Data-control events, dispatched here
+    struct sink sink; // Non-blocking stdout
+    struct output output; // Framed payloads on stdout
+    struct share *share; // Optional memfd hand-off to subscribers
+    uint64_t seq;
+
+    struct offer_manager offers; // Every offer the device introduced and not destroyed
+    struct coalescer coalescer; // Debounces selection storms
+    struct transfer_manager transfers; // Offer pipes being drained
+    int max_transfers;
+    struct timer_wheel wheel; // Transfer deadlines
+    struct transfer_limits limits;
+    uint64_t limit_hits[TRANSFER_LIMIT_COUNT];
+    struct pending_capture pending[MAX_PENDING_CAPTURES];
+    int pending_head;
+    int pending_count;
+    uint64_t pending_dropped;
+    bool stream; // Forward bytes as they arrive instead of whole payloads
+
+    bool lazy; // Announce selections, fetch only when a subscriber asks
+    struct offer *lazy_offer; // Newest selection, alive until replaced
+    uint64_t lazy_seq;
+    uint64_t lazy_timestamp_ns;
+    uint64_t lazy_fetches;
+
+    struct pipeline *pipeline; // Hashing and classification off this thread
+    struct history history;
+    bool dedup; // Drop captures identical to one still in history
+    uint64_t dedup_hits;
+    struct latency *latency; // NULL unless tracing
+    struct metrics_server *metrics;
+    struct mime_bytes mime_bytes[METRICS_MIME_LABELS]; // Captured bytes by negotiated type
+    int mime_bytes_count;
+    uint64_t mime_bytes_other; // Types past the labelled ones
+    struct recorder *recorder; // NULL unless recording the session
+    const char *evtrace_path; // Event trace dump, NULL unless tracing
+    uint64_t payloads;
+    uint64_t allocs_mark;   // mem_alloc_count() when the last capture finished
+    uint64_t capture_allocs; // Allocations between the last two captures
+    uint64_t capture_allocs_max;
+
+    bool reconnect; // Wait for a restarted compositor instead of exiting
+    struct event_source *reconnect_timer;
+    uint64_t reconnect_delay_ns;
+    uint64_t disconnected_ns; // CLOCK_MONOTONIC when the compositor went away, 0 while connected
+    uint64_t reconnects;
+    int socket_watch; // inotify on the socket's directory while disconnected, else -1
+    struct event_source *socket_watch_source;
+    char socket_name[NAME_MAX + 1];
     
     bool running;
-    bool verbose; // Toggle for verbose output
 };
 
-// Global state for signal handling
-static struct client_state *global_state = NULL;
+static volatile sig_atomic_t exit_signal = 0;
+static volatile sig_atomic_t stats_requested = 0;
+static volatile sig_atomic_t dump_requested = 0;
+
+// Signal handler for clean exit, the main loop does the rest
+static void
+handle_signal(int signum)
+{
+    exit_signal = signum;
+}
+
+// Helper threads are started with these blocked: a signal taken by one of
+// them would not interrupt the main loop's wait
+static void
+block_signals(bool block)
+{
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(block ? SIG_BLOCK : SIG_UNBLOCK, &signals, NULL);
+}
 
-// Signal handler for clean exit
+// SIGUSR1 asks for a statistics report on stderr
 static void
-handle_signal(int signum) {
-    if (global_state && global_state->verbose) {
-        printf("\nReceived signal %d, exiting...\n", signum);
+handle_stats_signal(int signum)
+{
+    stats_requested = 1;
+}
+
+// SIGUSR2 asks for the event trace to be written out
+static void
+handle_dump_signal(int signum)
+{
+    dump_requested = 1;
+}
+
+static void
+dump_evtrace(struct client_state *state)
+{
+    if (evtrace_dump(state->evtrace_path) == -1) {
+        log_error("Failed to write %s: %s", state->evtrace_path, strerror(errno));
+    } else {
+        log_info("Event trace written to %s", state->evtrace_path);
     }
-    
-    if (global_state) {
-        global_state->running = false;
-        wl_display_flush(global_state->display);
+}
+
+static void
+print_stats(struct client_state *state)
+{
+    const struct sink_stats *sink = &state->sink.stats;
+
+    fprintf(stderr, "payloads: %llu\n", (unsigned long long)state->seq);
+    fprintf(stderr, "selections: %llu seen, %llu fetched, %llu coalesced\n",
+            (unsigned long long)state->coalescer.seen,
+            (unsigned long long)state->coalescer.fetched,
+            (unsigned long long)state->coalescer.coalesced);
+    if (ZIGCLIP_FEATURE_LAZY && state->lazy) {
+        fprintf(stderr, "fetch requests: %llu\n", (unsigned long long)state->lazy_fetches);
+    }
+    fprintf(stderr, "offers: %d live (%d introduced, %d selected), %llu stale, %llu records allocated, %llu reused\n",
+            offer_manager_live_count(&state->offers),
+            state->offers.live_count[OFFER_INTRODUCED], state->offers.live_count[OFFER_SELECTED],
+            (unsigned long long)state->offers.stale, (unsigned long long)state->offers.created,
+            (unsigned long long)state->offers.reused);
+    fprintf(stderr, "pending captures: %d (%llu dropped)\n", state->pending_count,
+            (unsigned long long)state->pending_dropped);
+    fprintf(stderr, "transfers: %d running, bytes %llu text, %llu rich-text, %llu image, %llu other\n",
+            state->transfers.count,
+            (unsigned long long)state->transfers.bytes[TRANSFER_CLASS_TEXT],
+            (unsigned long long)state->transfers.bytes[TRANSFER_CLASS_RICH_TEXT],
+            (unsigned long long)state->transfers.bytes[TRANSFER_CLASS_IMAGE],
+            (unsigned long long)state->transfers.bytes[TRANSFER_CLASS_OTHER]);
+    fprintf(stderr, "transfers cut: %llu first-byte, %llu total, %llu size\n",
+            (unsigned long long)state->limit_hits[TRANSFER_LIMIT_FIRST_BYTE],
+            (unsigned long long)state->limit_hits[TRANSFER_LIMIT_TOTAL],
+            (unsigned long long)state->limit_hits[TRANSFER_LIMIT_SIZE]);
+    fprintf(stderr, "compositor: %s, %llu reconnects\n",
+            state->display ? "connected" : "disconnected", (unsigned long long)state->reconnects);
+    fprintf(stderr, "output queue: %zu bytes (peak %zu)\n", sink->queued_bytes, sink->queued_peak);
+    fprintf(stderr, "output spill: %llu bytes pending, %llu bytes total\n",
+            (unsigned long long)sink->spill_pending, (unsigned long long)sink->spilled_total);
+    fprintf(stderr, "output stalls: %llu\n", (unsigned long long)sink->stalls);
+    if (ZIGCLIP_FEATURE_HISTORY) {
+        fprintf(stderr, "history: %d entries, %zu bytes, %llu duplicates\n", state->history.count,
+                state->history.bytes, (unsigned long long)state->dedup_hits);
+    }
+    pipeline_print_stats(state->pipeline, stderr);
+    if (ZIGCLIP_FEATURE_LATENCY && state->latency) {
+        latency_print(state->latency, stderr);
+    }
+    if (ZIGCLIP_FEATURE_SHARE && state->share) {
+        fprintf(stderr, "subscribers: %d (%llu dropped)\n", share_subscriber_count(state->share),
+                (unsigned long long)share_dropped_count(state->share));
     }
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        struct mem_stats mem;
+        mem_get_stats(i, &mem);
+        fprintf(stderr, "memory %-9s %10llu live, %10llu peak, %8llu allocs, %8llu frees\n",
+                mem_tag_name(i), (unsigned long long)mem.live, (unsigned long long)mem.peak,
+                (unsigned long long)mem.allocs, (unsigned long long)mem.frees);
+    }
+    fprintf(stderr, "allocations per capture: %llu last, %llu max\n",
+            (unsigned long long)state->capture_allocs,
+            (unsigned long long)state->capture_allocs_max);
 }
 
-// Handle clipboard text content
+// Latency trace points cost nothing unless tracing is on
+static void
+trace_mark(struct client_state *state, struct payload *payload, enum latency_mark mark)
+{
+    if (ZIGCLIP_FEATURE_LATENCY && state->latency) {
+        payload->marks_ns[mark] = clock_ns(CLOCK_MONOTONIC);
+    }
+}
+
+// The payload's last record is with the sink, note when it gets out
 static void
-receive_clipboard_data(struct client_state *state, const char *mime_type)
+trace_output(struct client_state *state, const struct payload *payload)
 {
-    if (!state->current_offer) {
+    evtrace(EVTRACE_OUTPUT, payload, 0, state->sink.stats.accepted);
+    if (ZIGCLIP_FEATURE_LATENCY && state->latency) {
+        latency_record_output(state->latency, payload->marks_ns, state->sink.stats.accepted,
+                              state->sink.stats.written);
+    }
+}
+
+static void
+handle_sink_progress(void *data)
+{
+    struct client_state *state = data;
+    latency_output_progress(state->latency, state->sink.stats.written);
+}
+
+static void
+count_mime_bytes(struct client_state *state, const char *mime_type, uint64_t bytes)
+{
+    for (int i = 0; i < state->mime_bytes_count; i++) {
+        if (strcmp(state->mime_bytes[i].mime_type, mime_type) == 0) {
+            state->mime_bytes[i].bytes += bytes;
+            return;
+        }
+    }
+    // A type literally named "other" would clash with the shared series
+    if (state->mime_bytes_count == METRICS_MIME_LABELS || strcmp(mime_type, "other") == 0) {
+        state->mime_bytes_other += bytes;
         return;
     }
-    
+    struct mime_bytes *entry = &state->mime_bytes[state->mime_bytes_count++];
+    snprintf(entry->mime_type, sizeof(entry->mime_type), "%s", mime_type);
+    entry->bytes = bytes;
+}
+
+// A label value as the exposition format wants it, the source picks the
+// MIME type and may put anything in it
+static void
+format_mime_label(char *labels, size_t size, const char *mime_type)
+{
+    size_t len = snprintf(labels, size, "mime=\"");
+    for (const char *c = mime_type; *c && len + 4 < size; c++) {
+        if (*c == '\\' || *c == '"' || *c == '\n') {
+            labels[len++] = '\\';
+        }
+        labels[len++] = *c == '\n' ? 'n' : *c;
+    }
+    snprintf(labels + len, size - len, "\"");
+}
+
+// Everything the dispatch thread counts anyway, read at scrape time
+static void
+collect_metrics(void *data, struct metrics_writer *w)
+{
+    struct client_state *state = data;
+    const struct sink_stats *sink = &state->sink.stats;
+    char labels[16 + PAYLOAD_MIME_MAX * 2];
+
+    metrics_family(w, "zigclip_selections_total", "counter", "Selection changes seen");
+    metrics_sample(w, "zigclip_selections_total", NULL, state->coalescer.seen);
+    metrics_family(w, "zigclip_selections_coalesced_total", "counter",
+                   "Selections replaced before they were fetched");
+    metrics_sample(w, "zigclip_selections_coalesced_total", NULL, state->coalescer.coalesced);
+    metrics_family(w, "zigclip_payloads_total", "counter", "Payloads captured and processed");
+    metrics_sample(w, "zigclip_payloads_total", NULL, state->payloads);
+    metrics_family(w, "zigclip_dedup_hits_total", "counter",
+                   "Captures identical to one still in history");
+    metrics_sample(w, "zigclip_dedup_hits_total", NULL, state->dedup_hits);
+
+    metrics_family(w, "zigclip_captured_bytes_total", "counter",
+                   "Bytes of finished transfers by negotiated MIME type");
+    for (int i = 0; i < state->mime_bytes_count; i++) {
+        format_mime_label(labels, sizeof(labels), state->mime_bytes[i].mime_type);
+        metrics_sample(w, "zigclip_captured_bytes_total", labels, state->mime_bytes[i].bytes);
+    }
+    metrics_sample(w, "zigclip_captured_bytes_total", "mime=\"other\"", state->mime_bytes_other);
+    metrics_family(w, "zigclip_transfer_bytes_total", "counter",
+                   "Bytes read from sources by scheduling class, as they arrive");
+    for (int i = 0; i < TRANSFER_CLASS_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "class=\"%s\"", transfer_class_name(i));
+        metrics_sample(w, "zigclip_transfer_bytes_total", labels, state->transfers.bytes[i]);
+    }
+    metrics_family(w, "zigclip_transfers_in_flight", "gauge", "Offer pipes being drained");
+    metrics_sample(w, "zigclip_transfers_in_flight", NULL, state->transfers.count);
+    metrics_family(w, "zigclip_transfer_limit_hits_total", "counter",
+                   "Transfers cut short by a limit");
+    for (int i = TRANSFER_LIMIT_NONE + 1; i < TRANSFER_LIMIT_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "limit=\"%s\"", transfer_limit_name(i));
+        metrics_sample(w, "zigclip_transfer_limit_hits_total", labels, state->limit_hits[i]);
+    }
+
+    metrics_family(w, "zigclip_offers_live", "gauge", "Offers not destroyed yet");
+    for (int i = 0; i < OFFER_STATE_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "state=\"%s\"", offer_state_name(i));
+        metrics_sample(w, "zigclip_offers_live", labels, state->offers.live_count[i]);
+    }
+    metrics_family(w, "zigclip_offers_stale_total", "counter",
+                   "Offers introduced and never selected");
+    metrics_sample(w, "zigclip_offers_stale_total", NULL, state->offers.stale);
+    metrics_family(w, "zigclip_offer_records_allocated_total", "counter",
+                   "Offer records allocated rather than reused");
+    metrics_sample(w, "zigclip_offer_records_allocated_total", NULL, state->offers.created);
+
+    metrics_family(w, "zigclip_pending_captures", "gauge", "Selections waiting for a transfer");
+    metrics_sample(w, "zigclip_pending_captures", NULL, state->pending_count);
+    metrics_family(w, "zigclip_pending_dropped_total", "counter",
+                   "Selections dropped from a full wait queue");
+    metrics_sample(w, "zigclip_pending_dropped_total", NULL, state->pending_dropped);
+    metrics_family(w, "zigclip_pipeline_depth", "gauge", "Payloads in the processing pipeline");
+    metrics_sample(w, "zigclip_pipeline_depth", NULL, pipeline_depth(state->pipeline));
+
+    metrics_family(w, "zigclip_compositor_connected", "gauge",
+                   "Whether the compositor connection is up");
+    metrics_sample(w, "zigclip_compositor_connected", NULL, state->display != NULL);
+    metrics_family(w, "zigclip_reconnects_total", "counter",
+                   "Connections made again after the compositor went away");
+    metrics_sample(w, "zigclip_reconnects_total", NULL, state->reconnects);
+
+    metrics_family(w, "zigclip_output_queued_bytes", "gauge", "Output waiting in memory");
+    metrics_sample(w, "zigclip_output_queued_bytes", NULL, sink->queued_bytes);
+    metrics_family(w, "zigclip_output_spill_bytes", "gauge", "Output waiting on disk");
+    metrics_sample(w, "zigclip_output_spill_bytes", NULL, sink->spill_pending);
+    metrics_family(w, "zigclip_output_written_bytes_total", "counter", "Bytes written to stdout");
+    metrics_sample(w, "zigclip_output_written_bytes_total", NULL, sink->written);
+    metrics_family(w, "zigclip_output_stalls_total", "counter",
+                   "Writes that found the reader not ready");
+    metrics_sample(w, "zigclip_output_stalls_total", NULL, sink->stalls);
+
+    if (ZIGCLIP_FEATURE_HISTORY) {
+        metrics_family(w, "zigclip_history_entries", "gauge", "Captures kept in history");
+        metrics_sample(w, "zigclip_history_entries", NULL, state->history.count);
+        metrics_family(w, "zigclip_history_bytes", "gauge", "Payload bytes kept in history");
+        metrics_sample(w, "zigclip_history_bytes", NULL, state->history.bytes);
+    }
+
+    if (ZIGCLIP_FEATURE_SHARE && state->share) {
+        metrics_family(w, "zigclip_subscribers", "gauge", "Share socket subscribers");
+        metrics_sample(w, "zigclip_subscribers", NULL, share_subscriber_count(state->share));
+        metrics_family(w, "zigclip_subscriber_drops_total", "counter",
+                       "Payloads a slow subscriber missed");
+        metrics_sample(w, "zigclip_subscriber_drops_total", NULL,
+                       share_dropped_count(state->share));
+    }
+
+    struct mem_stats mem[MEM_TAG_COUNT];
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        mem_get_stats(i, &mem[i]);
+    }
+    metrics_family(w, "zigclip_memory_live_bytes", "gauge", "Heap and memfd bytes held per subsystem");
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "subsystem=\"%s\"", mem_tag_name(i));
+        metrics_sample(w, "zigclip_memory_live_bytes", labels, mem[i].live);
+    }
+    metrics_family(w, "zigclip_memory_peak_bytes", "gauge", "Most bytes ever held per subsystem");
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "subsystem=\"%s\"", mem_tag_name(i));
+        metrics_sample(w, "zigclip_memory_peak_bytes", labels, mem[i].peak);
+    }
+    metrics_family(w, "zigclip_allocations_total", "counter", "Heap allocations per subsystem");
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "subsystem=\"%s\"", mem_tag_name(i));
+        metrics_sample(w, "zigclip_allocations_total", labels, mem[i].allocs);
+    }
+    metrics_family(w, "zigclip_capture_allocations", "gauge",
+                   "Heap allocations between the last two captures");
+    metrics_sample(w, "zigclip_capture_allocations", NULL, state->capture_allocs);
+
+    if (ZIGCLIP_FEATURE_LATENCY && state->latency) {
+        static const double quantiles[] = { 0.5, 0.99, 0.999 };
+        metrics_family(w, "zigclip_latency_seconds", "summary", "Capture latency per stage");
+        for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+            const struct histogram *h = &state->latency->stages[i];
+            const char *stage = latency_stage_name(i);
+            for (size_t q = 0; q < ARRAY_LENGTH(quantiles); q++) {
+                snprintf(labels, sizeof(labels), "stage=\"%s\",quantile=\"%g\"",
+                         stage, quantiles[q]);
+                metrics_sample(w, "zigclip_latency_seconds", labels,
+                               histogram_percentile(h, quantiles[q]) / 1e9);
+            }
+            snprintf(labels, sizeof(labels), "stage=\"%s\"", stage);
+            metrics_sample(w, "zigclip_latency_seconds_sum", labels, h->sum / 1e9);
+            metrics_sample(w, "zigclip_latency_seconds_count", labels, h->count);
+        }
+    }
+}
+
+static void
+handle_output_error(struct client_state *state)
+{
+    log_warn("write: %s", strerror(errno));
+    if (errno == EPIPE) state->running = false; // Nobody reads us anymore
+}
+
+static void start_next_capture(struct client_state *state);
+
+// New bytes in the pipe, only forwarded right away when streaming
+static void
+handle_transfer_data(void *data, struct transfer *transfer, size_t offset, size_t len)
+{
+    struct client_state *state = data;
+
+    evtrace(EVTRACE_DATA, transfer->payload, 0, len);
+    if (offset == 0) {
+        trace_mark(state, transfer->payload, LATENCY_FIRST_BYTE);
+    }
+    if (ZIGCLIP_FEATURE_STREAM && state->stream &&
+        output_write_chunk(&state->output, transfer->payload, offset, len) == -1) {
+        handle_output_error(state);
+    }
+}
+
+// Payload made it through the pipeline, back on the dispatch thread
+static void
+handle_payload_processed(void *data, struct payload *payload)
+{
+    struct client_state *state = data;
+    struct history_entry *entry =
+        ZIGCLIP_FEATURE_HISTORY ? history_find(&state->history, payload) : NULL;
+
+    state->payloads++;
+    uint64_t allocs = mem_alloc_count();
+    if (state->payloads > 1) {
+        // The first capture pays for buffers that are reused from then on
+        state->capture_allocs = allocs - state->allocs_mark;
+        if (state->capture_allocs > state->capture_allocs_max) {
+            state->capture_allocs_max = state->capture_allocs;
+        }
+    }
+    state->allocs_mark = allocs;
+    if (ZIGCLIP_FEATURE_RECORDING && state->recorder) {
+        recorder_payload(state->recorder, payload->seq, payload->size, payload->hash);
+    }
+    evtrace(EVTRACE_PROCESSED, payload, 0, payload->seq);
+    trace_mark(state, payload, LATENCY_PROCESSED);
+    if (ZIGCLIP_FEATURE_LATENCY && state->latency) {
+        latency_record_capture(state->latency, payload->marks_ns);
+    }
+
+    if (entry) {
+        entry->hits++;
+        state->dedup_hits++;
+    } else if (ZIGCLIP_FEATURE_HISTORY) {
+        history_append(&state->history, payload);
+    }
+
+    if (!entry || !state->dedup) {
+        // Emit one record in the selected framing, queued if stdout is slow
+        if (!ZIGCLIP_FEATURE_STREAM || !state->stream) {
+            if (output_write_payload(&state->output, payload) == -1) {
+                handle_output_error(state);
+            } else {
+                trace_output(state, payload);
+            }
+        }
+        
+        if (ZIGCLIP_FEATURE_SHARE && state->share) {
+            share_broadcast(state->share, payload);
+        }
+    }
+
+    start_next_capture(state);
+}
+
+static void
+handle_transfer_done(void *data, struct transfer *transfer, int error)
+{
+    struct client_state *state = data;
+    struct payload *payload = transfer->payload;
+
+    if (ZIGCLIP_FEATURE_METRICS) {
+        count_mime_bytes(state, payload->mime_type, payload->size);
+    }
+    if (transfer->exceeded) {
+        state->limit_hits[transfer->exceeded]++;
+        log_warn("transfer %llu cut: %s limit", (unsigned long long)payload->seq,
+                 transfer_limit_name(transfer->exceeded));
+    }
+
+    if (error || transfer->exceeded) {
+        evtrace(EVTRACE_FAILED, payload, 0, error ? error : (int)transfer->exceeded);
+    } else {
+        evtrace(EVTRACE_DONE, payload, 0, payload->size);
+    }
+
+    if (error) {
+        log_warn("read: %s", strerror(error));
+        // Close the record so a streaming reader is not left hanging
+        if (ZIGCLIP_FEATURE_STREAM && state->stream && payload->size > 0 &&
+            output_write_end(&state->output, payload, false) == -1) {
+            handle_output_error(state);
+        }
+    } else if (payload->size > 0) {
+        trace_mark(state, payload, LATENCY_EOF);
+        // Streamed bytes are out already, only the trailing record is left
+        if (ZIGCLIP_FEATURE_STREAM && state->stream) {
+            if (output_write_end(&state->output, payload, true) == -1) {
+                handle_output_error(state);
+            } else {
+                trace_output(state, payload);
+            }
+        }
+        // Capacity was checked before the transfer started
+        pipeline_submit(state->pipeline, payload);
+    } else {
+        log_debug("(empty clipboard)");
+    }
+
+    transfer_destroy(transfer);
+    start_next_capture(state);
+}
+
+static const struct transfer_handler transfer_handler = {
+    .data = handle_transfer_data,
+    .done = handle_transfer_done,
+};
+
+// Handle clipboard text content
+static void
+receive_clipboard_data(struct client_state *state, const struct pending_capture *capture)
+{
     // Create pipes for reading data
     int pipefd[2];
-    if (pipe(pipefd) == -1) {
-        if (state->verbose) perror("pipe");
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        log_warn("pipe: %s", strerror(errno));
         return;
     }
+    // Only our end is non-blocking, the source may well expect to block
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
     
     // Send the request to read the data
-    zwlr_data_control_offer_v1_receive(state->current_offer, mime_type, pipefd[1]);
+    zwlr_data_control_offer_v1_receive(capture->offer->proxy, capture->mime_type, pipefd[1]);
     close(pipefd[1]); // Close write end immediately after request
     
-    // Dispatch events to ensure the data is sent through the pipe
-    wl_display_flush(state->display);
-    wl_display_dispatch(state->display);
+    // The source writes straight into the pipe, we only need the request out
+    display_reader_flush(state->reader);
     
-    // Read the data from the pipe
-    char buffer[4096];
-    ssize_t bytes_read = read(pipefd[0], buffer, sizeof(buffer) - 1);
-    close(pipefd[0]);
+    // The pipe drains into a memfd from the event loop, the only copy of
+    // the bytes we ever make
+    struct payload *payload = payload_create(capture->mime_type);
+    if (!payload) {
+        log_warn("memfd_create: %s", strerror(errno));
+        close(pipefd[0]);
+        return;
+    }
+    payload->seq = capture->seq ? capture->seq : ++state->seq;
+    evtrace(EVTRACE_RECEIVE, payload, evtrace_atom(capture->mime_type), payload->seq);
+    if (ZIGCLIP_FEATURE_RECORDING && state->recorder) {
+        recorder_fetch(state->recorder, capture->offer->record_id, capture->mime_type,
+                       payload->seq);
+    }
+    payload->timestamp_ns = capture->timestamp_ns;
+    payload->marks_ns[LATENCY_SELECTED] = capture->selected_ns;
+    trace_mark(state, payload, LATENCY_REQUESTED);
     
-    if (bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-        
-        // Just print the clipboard text, nothing else
-        printf("%s\n", buffer);
-        
-        // Flush stdout to ensure immediate output
-        fflush(stdout);
-    } else if (bytes_read == 0 && state->verbose) {
-        printf("(empty clipboard)\n");
-    } else if (state->verbose) {
-        perror("read");
+    struct transfer *transfer = transfer_create(&state->transfers, pipefd[0], payload,
+                                                &state->limits, &transfer_handler, state);
+    if (!transfer) {
+        log_warn("transfer: %s", strerror(errno));
+        payload_unref(payload);
+        close(pipefd[0]);
+    }
+}
+
+// Take the capture to start next: best MIME class, then the newest selection
+static struct pending_capture
+take_pending(struct client_state *state)
+{
+    int best = 0;
+    enum transfer_class best_class = TRANSFER_CLASS_COUNT;
+
+    for (int i = 0; i < state->pending_count; i++) {
+        const struct pending_capture *capture =
+            &state->pending[(state->pending_head + i) % MAX_PENDING_CAPTURES];
+        enum transfer_class class = transfer_class_for_mime(capture->mime_type);
+        if (class <= best_class) {
+            best = i;
+            best_class = class;
+        }
+    }
+
+    struct pending_capture capture = state->pending[(state->pending_head + best) % MAX_PENDING_CAPTURES];
+    for (int i = best; i + 1 < state->pending_count; i++) {
+        state->pending[(state->pending_head + i) % MAX_PENDING_CAPTURES] =
+            state->pending[(state->pending_head + i + 1) % MAX_PENDING_CAPTURES];
+    }
+    state->pending_count--;
+    return capture;
+}
+
+static void
+start_next_capture(struct client_state *state)
+{
+    // Every running transfer needs a pipeline slot once it completes, so a
+    // nearly full pipeline holds back new ones and selections wait in the FIFO
+    while (state->transfers.count < state->max_transfers && state->pending_count > 0 &&
+           pipeline_room(state->pipeline) > state->transfers.count) {
+        struct pending_capture capture = take_pending(state);
+
+        receive_clipboard_data(state, &capture);
+        // The pipe keeps the transfer going, the offer is of no further use
+        // unless it is the one kept around for fetch requests
+        if (capture.offer != state->lazy_offer) {
+            offer_destroy(capture.offer);
+        }
+    }
+}
+
+static void
+queue_capture(struct client_state *state, const struct pending_capture *capture)
+{
+    if (state->pending_count == MAX_PENDING_CAPTURES) {
+        // Falling this far behind, the oldest selection is the least useful
+        struct offer *oldest = state->pending[state->pending_head].offer;
+        if (oldest != state->lazy_offer) {
+            offer_destroy(oldest);
+        }
+        state->pending_head = (state->pending_head + 1) % MAX_PENDING_CAPTURES;
+        state->pending_count--;
+        state->pending_dropped++;
     }
+
+    int tail = (state->pending_head + state->pending_count) % MAX_PENDING_CAPTURES;
+    state->pending[tail] = *capture;
+    state->pending_count++;
+
+    start_next_capture(state);
 }
 
-// Data offer event handlers
+// Metadata-only mode: remember the selection and tell everyone what it offers
 static void
-data_offer_offer(void *data, struct zwlr_data_control_offer_v1 *offer, const char *mime_type)
+announce_selection(struct client_state *state, struct offer *offer, uint64_t timestamp_ns)
+{
+    if (state->lazy_offer) {
+        // Fetches already started hold their pipe, queued ones go stale
+        int kept = 0;
+        for (int i = 0; i < state->pending_count; i++) {
+            struct pending_capture *capture =
+                &state->pending[(state->pending_head + i) % MAX_PENDING_CAPTURES];
+            if (capture->offer != state->lazy_offer) {
+                state->pending[(state->pending_head + kept++) % MAX_PENDING_CAPTURES] = *capture;
+            }
+        }
+        state->pending_count = kept;
+        offer_destroy(state->lazy_offer);
+    }
+
+    state->lazy_offer = offer;
+    state->lazy_seq = ++state->seq;
+    state->lazy_timestamp_ns = timestamp_ns;
+
+    if (output_write_offer(&state->output, state->lazy_seq, timestamp_ns,
+                           offer->mime_types, offer->mime_count) == -1) {
+        handle_output_error(state);
+    }
+    if (ZIGCLIP_FEATURE_SHARE && state->share) {
+        share_broadcast_offer(state->share, state->lazy_seq, timestamp_ns,
+                              offer->mime_types, offer->mime_count);
+    }
+}
+
+// A subscriber wants the bytes of an announced selection
+static void
+handle_fetch_request(void *data, uint64_t seq, const char *mime_type)
 {
     struct client_state *state = data;
-    if (state->verbose) {
-        printf("Data offer with MIME type: %s\n", mime_type);
+    struct offer *offer = state->lazy_offer;
+
+    evtrace(EVTRACE_FETCH, offer, evtrace_atom(mime_type), seq);
+    if (!offer || seq != state->lazy_seq) {
+        log_info("fetch %llu: selection replaced", (unsigned long long)seq);
+        return;
     }
+
+    if (mime_type[0] == '\0') {
+        if (offer_has_mime(offer, "text/plain;charset=utf-8")) {
+            mime_type = "text/plain;charset=utf-8";
+        } else if (offer->mime_count > 0) {
+            mime_type = offer->mime_types[0];
+        }
+    }
+    if (!offer_has_mime(offer, mime_type)) {
+        log_info("fetch %llu: %s not offered", (unsigned long long)seq, mime_type);
+        return;
+    }
+
+    struct pending_capture capture = {
+        .offer = offer,
+        .timestamp_ns = state->lazy_timestamp_ns,
+        .seq = seq,
+        // The wait for a request is not ours to measure
+        .selected_ns = ZIGCLIP_FEATURE_LATENCY && state->latency ? clock_ns(CLOCK_MONOTONIC) : 0,
+    };
+    snprintf(capture.mime_type, sizeof(capture.mime_type), "%s", mime_type);
+    state->lazy_fetches++;
+    queue_capture(state, &capture);
 }
 
-static const struct zwlr_data_control_offer_v1_listener data_offer_listener = {
-    .offer = data_offer_offer
+// A selection made it through coalescing
+static void
+handle_selection_due(void *data, void *item, uint64_t timestamp_ns)
+{
+    struct client_state *state = data;
+
+    if (ZIGCLIP_FEATURE_LAZY && state->lazy) {
+        announce_selection(state, item, timestamp_ns);
+        return;
+    }
+
+    struct pending_capture capture = {
+        .offer = item,
+        .timestamp_ns = timestamp_ns,
+        .mime_type = "text/plain;charset=utf-8",
+        .selected_ns = ((struct offer *)item)->selected_ns,
+    };
+    queue_capture(state, &capture);
+}
+
+// Superseded within the coalescing window, nobody will ever read it
+static void
+discard_selection(void *data, void *item)
+{
+    evtrace(EVTRACE_COALESCED, item, 0, 0);
+    offer_destroy(item);
+}
+
+static const struct coalesce_handler coalesce_handler = {
+    .fire = handle_selection_due,
+    .discard = discard_selection,
 };
 
 // Data device event handlers
@@ -112,29 +801,49 @@ data_device_data_offer(void *data, struct zwlr_data_control_device_v1 *device,
                      struct zwlr_data_control_offer_v1 *offer)
 {
     struct client_state *state = data;
-    if (state->verbose) {
-        printf("New data offer received\n");
-    }
+
+    log_debug("New data offer received");
     
-    zwlr_data_control_offer_v1_add_listener(offer, &data_offer_listener, data);
+    // The record collects the offered MIME types until the selection event
+    struct offer *record = offer_create(&state->offers, offer);
+    evtrace(EVTRACE_DATA_OFFER, record, 0, 0);
 }
 
 static void
 data_device_selection(void *data, struct zwlr_data_control_device_v1 *device,
-                    struct zwlr_data_control_offer_v1 *offer)
+                    struct zwlr_data_control_offer_v1 *proxy)
 {
     struct client_state *state = data;
+    struct offer *offer = proxy ? offer_from_proxy(proxy) : NULL;
     
-    if (state->verbose) {
-        printf("Selection changed\n");
+    evtrace(EVTRACE_SELECTION, offer, 0, offer ? offer->mime_count : 0);
+    if (log_enabled(LOG_DEBUG)) {
+        log_debug("Selection changed");
+        for (int i = 0; offer && i < offer->mime_count; i++) {
+            log_debug("Data offer with MIME type: %s", offer->mime_types[i]);
+        }
     }
     
-    // Update current offer
-    state->current_offer = offer;
-    
-    if (offer) {
-        // Try to receive text data
-        receive_clipboard_data(state, "text/plain;charset=utf-8");
+    if (ZIGCLIP_FEATURE_RECORDING && state->recorder) {
+        if (offer) {
+            offer->record_id = recorder_selection(state->recorder, offer->mime_types,
+                                                  offer->mime_count);
+        } else {
+            recorder_clear(state->recorder);
+        }
+    }
+
+    if (!offer) {
+        return;
+    }
+    offer_select(offer);
+    if (ZIGCLIP_FEATURE_COALESCE) {
+        coalescer_push(&state->coalescer, offer, clock_ns(CLOCK_REALTIME));
+    } else {
+        // Without the coalescer every selection is fetched as it comes
+        state->coalescer.seen++;
+        state->coalescer.fetched++;
+        handle_selection_due(state, offer, clock_ns(CLOCK_REALTIME));
     }
 }
 
@@ -142,8 +851,9 @@ static void
 data_device_finished(void *data, struct zwlr_data_control_device_v1 *device)
 {
     struct client_state *state = data;
-    if (state->verbose) {
-        printf("Data device finished\n");
+    log_info("Data device finished");
+    if (ZIGCLIP_FEATURE_RECORDING && state->recorder) {
+        recorder_finished(state->recorder);
     }
 }
 
@@ -173,22 +883,16 @@ registry_handle_global(void *data, struct wl_registry *registry,
 {
     struct client_state *state = data;
 
-    if (state->verbose) {
-        printf("Got interface: %s (version %d)\n", interface, version);
-    }
+    log_debug("Got interface: %s (version %d)", interface, version);
 
     if (strcmp(interface, wl_seat_interface.name) == 0) {
         state->seat = wl_registry_bind(registry, id, &wl_seat_interface, 1);
         wl_seat_add_listener(state->seat, &seat_listener, state);
-        if (state->verbose) {
-            printf("Found seat\n");
-        }
+        log_debug("Found seat");
     } else if (strcmp(interface, zwlr_data_control_manager_v1_interface.name) == 0) {
         state->data_control_manager = wl_registry_bind(
             registry, id, &zwlr_data_control_manager_v1_interface, 1);
-        if (state->verbose) {
-            printf("Found wlr_data_control_manager\n");
-        }
+        log_debug("Found wlr_data_control_manager");
     }
 }
 
@@ -207,23 +911,480 @@ static const struct wl_registry_listener registry_listener = {
 void print_usage(const char *program_name) {
     fprintf(stderr, "Usage: %s [options]\n", program_name);
     fprintf(stderr, "Options:\n");
-    fprintf(stderr, "  -v    Verbose output (show debug information)\n");
+    fprintf(stderr, "  -v    Verbose output (show debug information), same as -V debug\n");
+    fprintf(stderr, "  -V LEVEL  Log level on stderr: error (default), warn, info or debug\n");
+    fprintf(stderr, "  -f FORMAT  Output framing: raw (default), nul, binary or ndjson\n");
+    fprintf(stderr, "  -S    Stream payload bytes as they arrive, closed by a trailing record\n");
+    fprintf(stderr, "  -w N  Worker threads for hashing and classification (default: cores - 1, 0 = inline)\n");
+    fprintf(stderr, "  -H N  Captures kept in memory history (default 100)\n");
+    fprintf(stderr, "  -d    Skip captures identical to one still in history\n");
+    fprintf(stderr, "  -L    Metadata only: announce selections and their MIME types, fetch on request from -s subscribers\n");
+    fprintf(stderr, "  -l    Trace capture latency per stage, percentiles are part of the SIGUSR1 report\n");
+    fprintf(stderr, "  -c MS Coalesce selection storms: fetch only once no newer selection came for MS\n");
+    fprintf(stderr, "  -C MS Longest a coalesced selection may wait (default 5x the -c window)\n");
+    fprintf(stderr, "  -t MS Give up on a source that has not sent anything after MS (default 5000, 0 = never)\n");
+    fprintf(stderr, "  -T MS Give up on a transfer still running after MS (default 60000, 0 = never)\n");
+    fprintf(stderr, "  -m SIZE  Give up on a payload larger than SIZE (default unlimited)\n");
+    fprintf(stderr, "  -q SIZE  Memory for output a slow reader has not taken yet, spills to disk beyond (default 4M)\n");
+    fprintf(stderr, "  -s PATH  Share each payload as a sealed memfd with subscribers of socket PATH\n");
+    fprintf(stderr, "  -P ADDR  Serve Prometheus metrics on a Unix socket path or loopback [HOST:]PORT\n");
+    fprintf(stderr, "  -R FILE  Record selection events, MIME types and payload sizes and hashes to FILE for replay\n");
+    fprintf(stderr, "  -E FILE  Keep a binary event trace, written to FILE on SIGUSR2 and at exit\n");
+    fprintf(stderr, "  -x    Exit when the compositor goes away instead of waiting for it to come back\n");
     fprintf(stderr, "  -h    Show this help message\n");
 }
 
+// Options of features this build was made without
+static bool
+feature_missing(bool enabled, int opt)
+{
+    if (!enabled) {
+        fprintf(stderr, "-%c is not available in this build\n", opt);
+    }
+    return !enabled;
+}
+
+// Parse a byte count with an optional K, M or G suffix
+static bool
+parse_size(const char *arg, size_t *size)
+{
+    char *end;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (end == arg) {
+        return false;
+    }
+
+    switch (*end) {
+        case 'G': case 'g': value <<= 10; // fall through
+        case 'M': case 'm': value <<= 10; // fall through
+        case 'K': case 'k': value <<= 10; end++; break;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+
+    *size = value;
+    return true;
+}
+
+// Parse a decimal count from 0 to max, durations included: in ms they
+// stay far from wrapping once scaled to ns
+static bool
+parse_count(const char *arg, long max, long *count)
+{
+    char *end;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE || value < 0 || value > max) {
+        return false;
+    }
+
+    *count = value;
+    return true;
+}
+
+static void handle_display_events(void *data);
+
+// Connect and learn the globals. Whether the ones we need are there is
+// for the caller to check.
+static int
+wayland_connect(struct client_state *state)
+{
+    state->display = wl_display_connect(NULL);
+    if (!state->display) {
+        return -1;
+    }
+
+    state->registry = wl_display_get_registry(state->display);
+    wl_registry_add_listener(state->registry, &registry_listener, state);
+
+    // Wait for the server to process the registry events
+    return wl_display_roundtrip(state->display) == -1 ? -1 : 0;
+}
+
+// Request the data device and hand the socket to the reader thread
+static int
+wayland_start(struct client_state *state)
+{
+    if (!state->seat || !state->data_control_manager) {
+        return -1;
+    }
+
+    // Create the device through a wrapper so it, and every offer it
+    // introduces, lives on our private queue from the first event on
+    state->device_queue = wl_display_create_queue(state->display);
+    struct zwlr_data_control_manager_v1 *manager =
+        wl_proxy_create_wrapper(state->data_control_manager);
+    wl_proxy_set_queue((struct wl_proxy *)manager, state->device_queue);
+    state->data_control_device = zwlr_data_control_manager_v1_get_data_device(
+        manager, state->seat);
+    wl_proxy_wrapper_destroy(manager);
+    zwlr_data_control_device_v1_add_listener(state->data_control_device,
+                                             &data_device_listener, state);
+
+    // From here on only the reader thread reads from the Wayland socket
+    block_signals(true);
+    state->reader = display_reader_start(state->display, state->loop,
+                                         handle_display_events, state);
+    block_signals(false);
+    return state->reader ? 0 : -1;
+}
+
+// Let go of everything tied to the connection. Offers are proxies of it,
+// so selections not fetched yet go too; running transfers hold their own
+// pipe and finish, history and subscribers are not touched.
+static void
+wayland_disconnect(struct client_state *state)
+{
+    display_reader_stop(state->reader);
+    state->reader = NULL;
+
+    if (ZIGCLIP_FEATURE_COALESCE)
+        coalescer_reset(&state->coalescer);
+    for (int i = 0; i < state->pending_count; i++) {
+        struct offer *offer = state->pending[(state->pending_head + i) % MAX_PENDING_CAPTURES].offer;
+        if (offer != state->lazy_offer)
+            offer_destroy(offer);
+    }
+    state->pending_count = 0;
+    if (state->lazy_offer) {
+        offer_destroy(state->lazy_offer);
+        state->lazy_offer = NULL;
+    }
+    offer_manager_clear(&state->offers); // Introduced and never selected
+
+    if (state->data_control_device)
+        zwlr_data_control_device_v1_destroy(state->data_control_device);
+    if (state->device_queue)
+        wl_event_queue_destroy(state->device_queue);
+    if (state->data_control_manager)
+        zwlr_data_control_manager_v1_destroy(state->data_control_manager);
+    if (state->seat)
+        wl_seat_destroy(state->seat);
+    if (state->registry)
+        wl_registry_destroy(state->registry);
+    if (state->display)
+        wl_display_disconnect(state->display);
+    state->data_control_device = NULL;
+    state->device_queue = NULL;
+    state->data_control_manager = NULL;
+    state->seat = NULL;
+    state->registry = NULL;
+    state->display = NULL;
+}
+
+static void
+unwatch_socket(struct client_state *state)
+{
+    if (state->socket_watch_source) {
+        event_source_remove(state->socket_watch_source);
+        state->socket_watch_source = NULL;
+    }
+    if (state->socket_watch != -1) {
+        close(state->socket_watch);
+        state->socket_watch = -1;
+    }
+}
+
+static void
+try_reconnect(struct client_state *state)
+{
+    if (wayland_connect(state) == 0 && wayland_start(state) == 0) {
+        uint64_t down_ns = clock_ns(CLOCK_MONOTONIC) - state->disconnected_ns;
+        log_warn("Reconnected to the compositor after %llu ms",
+                 (unsigned long long)(down_ns / 1000000));
+        state->reconnects++;
+        state->disconnected_ns = 0;
+        event_source_timer_update(state->reconnect_timer, 0);
+        unwatch_socket(state);
+        handle_display_events(state); // Anything queued before the thread ran
+        return;
+    }
+
+    // Not up yet, or up without its globals announced
+    wayland_disconnect(state);
+    event_source_timer_update(state->reconnect_timer, state->reconnect_delay_ns);
+    state->reconnect_delay_ns *= 2;
+    if (state->reconnect_delay_ns > RECONNECT_MAX_NS) {
+        state->reconnect_delay_ns = RECONNECT_MAX_NS;
+    }
+}
+
+static void
+handle_reconnect_timer(void *data)
+{
+    try_reconnect(data);
+}
+
+// A new compositor creating its socket is worth an attempt right away,
+// whatever the backoff has grown to
+static void
+handle_socket_event(void *data, int fd, uint32_t mask)
+{
+    struct client_state *state = data;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool created = false;
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len > 0 && strcmp(event->name, state->socket_name) == 0) {
+                created = true;
+            }
+            p += sizeof(*event) + event->len;
+        }
+    }
+    if (created) {
+        state->reconnect_delay_ns = RECONNECT_MIN_NS;
+        try_reconnect(state);
+    }
+}
+
+// Watch for the socket wl_display_connect() looks for. Without the watch
+// the backoff timer still gets there, only later.
+static void
+watch_socket(struct client_state *state)
+{
+    const char *name = getenv("WAYLAND_DISPLAY");
+    char dir[PATH_MAX];
+
+    if (!name) {
+        name = "wayland-0";
+    }
+    if (name[0] == '/') {
+        snprintf(dir, sizeof(dir), "%s", name);
+        char *slash = strrchr(dir, '/');
+        slash[slash == dir ? 1 : 0] = '\0';
+        name = strrchr(name, '/') + 1;
+    } else {
+        const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+        if (!runtime_dir) {
+            return;
+        }
+        snprintf(dir, sizeof(dir), "%s", runtime_dir);
+    }
+    snprintf(state->socket_name, sizeof(state->socket_name), "%s", name);
+
+    state->socket_watch = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (state->socket_watch == -1) {
+        log_warn("inotify: %s", strerror(errno));
+        return;
+    }
+    if (inotify_add_watch(state->socket_watch, dir, IN_CREATE | IN_MOVED_TO) == -1) {
+        log_warn("Cannot watch %s: %s", dir, strerror(errno));
+        unwatch_socket(state);
+        return;
+    }
+    state->socket_watch_source = event_loop_add_fd(state->loop, state->socket_watch,
+                                                   EVENT_LOOP_READABLE,
+                                                   handle_socket_event, state);
+    if (!state->socket_watch_source) {
+        unwatch_socket(state);
+    }
+}
+
+// The compositor went away or broke the connection. History, indexes and
+// subscribers stay as they are while we wait for it to come back.
+static void
+handle_disconnect(struct client_state *state, int error)
+{
+    log_warn("Lost the compositor: %s", strerror(error));
+    wayland_disconnect(state);
+    if (ZIGCLIP_FEATURE_RECORDING && state->recorder) {
+        recorder_clear(state->recorder);
+    }
+    if (!ZIGCLIP_FEATURE_RECONNECT || !state->reconnect) {
+        state->running = false;
+        return;
+    }
+
+    state->disconnected_ns = clock_ns(CLOCK_MONOTONIC);
+    state->reconnect_delay_ns = RECONNECT_MIN_NS;
+    watch_socket(state);
+    try_reconnect(state);
+}
+
+// The reader thread queued new events, run the data-control ones here
+static void
+handle_display_events(void *data)
+{
+    struct client_state *state = data;
+
+    if (display_reader_failed(state->reader)) {
+        handle_disconnect(state, display_reader_error(state->reader));
+        return;
+    }
+    if (wl_display_dispatch_queue_pending(state->display, state->device_queue) == -1) {
+        handle_disconnect(state, errno);
+        return;
+    }
+    display_reader_flush(state->reader);
+}
+
 int
 main(int argc, char **argv)
 {
     struct client_state state = { 0 };
     state.running = true;
-    state.verbose = false;
+    state.reconnect = true;
+    enum log_level log_level = LOG_ERROR;
+    const char *share_path = NULL;
+    const char *metrics_address = NULL;
+    const char *record_path = NULL;
+    enum output_format format = OUTPUT_DEFAULT_FORMAT;
+    size_t queue_limit = 4 << 20;
+    int workers = pipeline_default_workers();
+    int history_size = 100;
+    long coalesce_ms = 0;
+    long coalesce_max_ms = -1;
+    long first_byte_ms = 5000;
+    long total_ms = 60000;
+    bool trace_latency = false;
+    long count;
     
     // Parse command line arguments
     int opt;
-    while ((opt = getopt(argc, argv, "vh")) != -1) {
+    while ((opt = getopt(argc, argv, "vV:f:SLlw:H:dc:C:t:T:m:q:s:P:R:E:xh")) != -1) {
         switch (opt) {
             case 'v':
-                state.verbose = true;
+                log_level = LOG_DEBUG;
+                break;
+            case 'V':
+                if (!log_parse_level(optarg, &log_level)) {
+                    fprintf(stderr, "Unknown log level: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'f':
+                if (output_parse_format(optarg, &format) == -1) {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S':
+                if (feature_missing(ZIGCLIP_FEATURE_STREAM, opt)) {
+                    return 1;
+                }
+                state.stream = true;
+                break;
+            case 'L':
+                if (feature_missing(ZIGCLIP_FEATURE_LAZY, opt)) {
+                    return 1;
+                }
+                state.lazy = true;
+                break;
+            case 'l':
+                if (feature_missing(ZIGCLIP_FEATURE_LATENCY, opt)) {
+                    return 1;
+                }
+                trace_latency = true;
+                break;
+            case 'w':
+                if (!parse_count(optarg, MAX_WORKERS, &count)) {
+                    fprintf(stderr, "Invalid worker count: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                workers = count;
+                break;
+            case 'H':
+                if (feature_missing(ZIGCLIP_FEATURE_HISTORY, opt)) {
+                    return 1;
+                }
+                if (!parse_count(optarg, INT_MAX, &count)) {
+                    fprintf(stderr, "Invalid history size: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                history_size = count;
+                break;
+            case 'd':
+                if (feature_missing(ZIGCLIP_FEATURE_HISTORY, opt)) {
+                    return 1;
+                }
+                state.dedup = true;
+                break;
+            case 'c':
+                if (feature_missing(ZIGCLIP_FEATURE_COALESCE, opt)) {
+                    return 1;
+                }
+                if (!parse_count(optarg, INT_MAX, &coalesce_ms)) {
+                    fprintf(stderr, "Invalid time: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'C':
+                if (feature_missing(ZIGCLIP_FEATURE_COALESCE, opt)) {
+                    return 1;
+                }
+                if (!parse_count(optarg, INT_MAX, &coalesce_max_ms)) {
+                    fprintf(stderr, "Invalid time: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                if (feature_missing(ZIGCLIP_FEATURE_DEADLINES, opt)) {
+                    return 1;
+                }
+                if (!parse_count(optarg, INT_MAX, &first_byte_ms)) {
+                    fprintf(stderr, "Invalid time: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'T':
+                if (feature_missing(ZIGCLIP_FEATURE_DEADLINES, opt)) {
+                    return 1;
+                }
+                if (!parse_count(optarg, INT_MAX, &total_ms)) {
+                    fprintf(stderr, "Invalid time: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm':
+                if (!parse_size(optarg, &state.limits.max_bytes)) {
+                    fprintf(stderr, "Invalid payload size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'q':
+                if (!parse_size(optarg, &queue_limit)) {
+                    fprintf(stderr, "Invalid queue size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                if (feature_missing(ZIGCLIP_FEATURE_SHARE, opt)) {
+                    return 1;
+                }
+                share_path = optarg;
+                break;
+            case 'P':
+                if (feature_missing(ZIGCLIP_FEATURE_METRICS, opt)) {
+                    return 1;
+                }
+                metrics_address = optarg;
+                break;
+            case 'R':
+                if (feature_missing(ZIGCLIP_FEATURE_RECORDING, opt)) {
+                    return 1;
+                }
+                record_path = optarg;
+                break;
+            case 'E':
+                if (feature_missing(ZIGCLIP_FEATURE_EVTRACE, opt)) {
+                    return 1;
+                }
+                state.evtrace_path = optarg;
+                break;
+            case 'x':
+                state.reconnect = false;
                 break;
             case 'h':
                 print_usage(argv[0]);
@@ -233,44 +1394,57 @@ main(int argc, char **argv)
                 return 1;
         }
     }
+
+    // Lazy mode fetches on request only, and only subscribers can ask
+    if (ZIGCLIP_FEATURE_LAZY && state.lazy && !share_path) {
+        fprintf(stderr, "-L needs -s: only share subscribers can request a fetch\n");
+        print_usage(argv[0]);
+        return 1;
+    }
     
-    global_state = &state;
+    if (ZIGCLIP_FEATURE_EVTRACE && state.evtrace_path) {
+        evtrace_init(EVTRACE_EVENTS);
+    }
+    if (ZIGCLIP_FEATURE_METRICS)
+        metrics_thread_register();
+    if (ZIGCLIP_FEATURE_EVTRACE)
+        evtrace_thread_register("dispatch");
     
     // Set up signal handlers for clean exit
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGUSR1, handle_stats_signal);
+    if (ZIGCLIP_FEATURE_EVTRACE && state.evtrace_path) {
+        signal(SIGUSR2, handle_dump_signal);
+    }
+
+    // Log records are written from a thread of their own
+    block_signals(true);
+    int log_error_code = log_start(log_level) == -1 ? errno : 0;
+    block_signals(false);
+    if (log_error_code) {
+        // Messages then go straight to stderr, blocking as they may
+        fprintf(stderr, "Logging synchronously, no writer thread: %s\n",
+                strerror(log_error_code));
+    }
+    signal(SIGPIPE, SIG_IGN); // A vanished reader shows up as EPIPE
+
+    offer_manager_init(&state.offers);
 
     // Connect to the Wayland display
-    state.display = wl_display_connect(NULL);
-    if (!state.display) {
+    if (wayland_connect(&state) == -1) {
         fprintf(stderr, "Failed to connect to Wayland display\n");
         return 1;
     }
     
-    if (state.verbose) {
-        printf("Connected to Wayland display\n");
-    }
+    log_info("Connected to Wayland display");
 
-    // Get the registry
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry, &registry_listener, &state);
-
-    // Wait for the server to process the registry events
-    wl_display_roundtrip(state.display);
-    
-    // Set up the data control device (for clipboard monitoring)
+    // The data control device (for clipboard monitoring) is requested
+    // once the event loop is up
     if (state.seat && state.data_control_manager) {
-        state.data_control_device = zwlr_data_control_manager_v1_get_data_device(
-            state.data_control_manager, state.seat);
-        
-        zwlr_data_control_device_v1_add_listener(state.data_control_device, 
-                                               &data_device_listener, &state);
-        
-        if (state.verbose) {
-            printf("Set up wlr-data-control for clipboard monitoring\n");
-            printf("Monitoring clipboard events. Copy text to see it appear.\n");
-            printf("Press Ctrl+C to exit.\n");
-        }
+        log_info("Set up wlr-data-control for clipboard monitoring");
+        log_info("Monitoring clipboard events. Copy text to see it appear.");
+        log_info("Press Ctrl+C to exit.");
     } else {
         if (!state.data_control_manager) {
             fprintf(stderr, "wlr-data-control protocol not supported by this compositor.\n");
@@ -283,27 +1457,152 @@ main(int argc, char **argv)
         return 1;
     }
 
+    state.loop = event_loop_create();
+    if (!state.loop) {
+        fprintf(stderr, "Failed to create event loop\n");
+        return 1;
+    }
+
+    if (ZIGCLIP_FEATURE_SHARE && share_path) {
+        state.share = share_create(state.loop, share_path);
+        if (!state.share) {
+            fprintf(stderr, "Failed to listen on %s: %s\n", share_path, strerror(errno));
+            return 1;
+        }
+        share_set_fetch_handler(state.share, handle_fetch_request, &state);
+    }
+
+    if (ZIGCLIP_FEATURE_RECORDING && record_path) {
+        state.recorder = recorder_create(record_path);
+        if (!state.recorder) {
+            fprintf(stderr, "Failed to open %s: %s\n", record_path, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (ZIGCLIP_FEATURE_METRICS && metrics_address) {
+        state.metrics = metrics_server_create(state.loop, metrics_address, collect_metrics, &state);
+        if (!state.metrics) {
+            fprintf(stderr, "Failed to serve metrics on %s: %s\n", metrics_address, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (sink_init(&state.sink, state.loop, STDOUT_FILENO, queue_limit) == -1) {
+        fprintf(stderr, "Failed to set up output: %s\n", strerror(errno));
+        return 1;
+    }
+    output_init(&state.output, &state.sink, format);
+
+    if (ZIGCLIP_FEATURE_LATENCY && trace_latency) {
+        state.latency = latency_create();
+        if (!state.latency) {
+            fprintf(stderr, "Failed to allocate latency histograms\n");
+            return 1;
+        }
+        sink_set_progress_func(&state.sink, handle_sink_progress, &state);
+    }
+
+    if (ZIGCLIP_FEATURE_HISTORY && history_init(&state.history, history_size) == -1) {
+        fprintf(stderr, "Failed to allocate history\n");
+        return 1;
+    }
+    block_signals(true);
+    state.pipeline = pipeline_create(state.loop, workers < 0 ? 0 : workers,
+                                     handle_payload_processed, &state);
+    block_signals(false);
+    if (!state.pipeline) {
+        fprintf(stderr, "Failed to start workers: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (coalesce_max_ms < 0) {
+        coalesce_max_ms = coalesce_ms * 5;
+    }
+    if (ZIGCLIP_FEATURE_COALESCE &&
+        coalescer_init(&state.coalescer, state.loop, coalesce_ms * 1000000ull,
+                       coalesce_max_ms * 1000000ull, &coalesce_handler, &state) == -1) {
+        fprintf(stderr, "Failed to create coalescing timer: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (ZIGCLIP_FEATURE_DEADLINES) {
+        if (timer_wheel_init(&state.wheel, state.loop, TIMER_TICK_NS) == -1) {
+            fprintf(stderr, "Failed to create transfer timer: %s\n", strerror(errno));
+            return 1;
+        }
+        state.limits.first_byte_ns = first_byte_ms > 0 ? first_byte_ms * 1000000ull : 0;
+        state.limits.total_ns = total_ms > 0 ? total_ms * 1000000ull : 0;
+    }
+    transfer_manager_init(&state.transfers, state.loop,
+                          ZIGCLIP_FEATURE_DEADLINES ? &state.wheel : NULL);
+    // Bare streamed chunks of two payloads would interleave on stdout
+    bool framed = format == OUTPUT_BINARY || format == OUTPUT_NDJSON;
+    state.max_transfers = ZIGCLIP_FEATURE_STREAM && state.stream && !framed ? 1 : MAX_ACTIVE_TRANSFERS;
+
+    state.socket_watch = -1;
+    if (ZIGCLIP_FEATURE_RECONNECT && state.reconnect) {
+        state.reconnect_timer = event_loop_add_timer(state.loop, handle_reconnect_timer, &state);
+        if (!state.reconnect_timer) {
+            fprintf(stderr, "Failed to create reconnect timer: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    if (wayland_start(&state) == -1) {
+        fprintf(stderr, "Failed to start Wayland reader: %s\n", strerror(errno));
+        return 1;
+    }
+    handle_display_events(&state); // Anything queued before the thread ran
+
     // Main loop
-    while (state.running) {
-        if (wl_display_dispatch(state.display) == -1) {
-            if (state.verbose) {
-                fprintf(stderr, "Error in dispatch: %s\n", strerror(errno));
-            }
+    while (state.running && !exit_signal) {
+        if (event_loop_dispatch(state.loop, -1) == -1) {
+            log_error("Error in dispatch: %s", strerror(errno));
             break;
         }
+        if (stats_requested) {
+            stats_requested = 0;
+            print_stats(&state);
+        }
+        if (ZIGCLIP_FEATURE_EVTRACE && dump_requested) {
+            dump_requested = 0;
+            dump_evtrace(&state);
+        }
+    }
+    if (ZIGCLIP_FEATURE_EVTRACE && state.evtrace_path) {
+        dump_evtrace(&state);
+    }
+
+    if (exit_signal) {
+        log_info("Received signal %d, exiting...", (int)exit_signal);
     }
 
     // Clean up
-    if (state.data_control_device)
-        zwlr_data_control_device_v1_destroy(state.data_control_device);
-    if (state.data_control_manager)
-        zwlr_data_control_manager_v1_destroy(state.data_control_manager);
-    if (state.seat)
-        wl_seat_destroy(state.seat);
-    if (state.registry)
-        wl_registry_destroy(state.registry);
-    if (state.display)
-        wl_display_disconnect(state.display);
+    wayland_disconnect(&state);
+    if (ZIGCLIP_FEATURE_RECONNECT)
+        unwatch_socket(&state);
+    if (ZIGCLIP_FEATURE_COALESCE)
+        coalescer_finish(&state.coalescer);
+    offer_manager_finish(&state.offers);
+    transfer_manager_finish(&state.transfers);
+    if (ZIGCLIP_FEATURE_DEADLINES)
+        timer_wheel_finish(&state.wheel);
+    pipeline_destroy(state.pipeline);
+    if (ZIGCLIP_FEATURE_HISTORY)
+        history_finish(&state.history);
+    if (ZIGCLIP_FEATURE_SHARE)
+        share_destroy(state.share);
+    if (ZIGCLIP_FEATURE_METRICS)
+        metrics_server_destroy(state.metrics);
+    if (ZIGCLIP_FEATURE_RECORDING)
+        recorder_destroy(state.recorder);
+    output_finish(&state.output);
+    sink_finish(&state.sink);
+    if (ZIGCLIP_FEATURE_LATENCY)
+        latency_destroy(state.latency);
+    event_loop_destroy(state.loop);
+    log_stop();
 
     return 0;
 }
@@ -0,0 +1,133 @@
+/**
+ * Tracked allocations
+ */
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+static struct mem_stats stats[MEM_TAG_COUNT];
+
+static void
+account(enum mem_tag tag, int64_t bytes, bool alloc)
+{
+    struct mem_stats *s = &stats[tag];
+    uint64_t live = __atomic_add_fetch(&s->live, bytes, __ATOMIC_RELAXED);
+    uint64_t peak = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+
+    while (live > peak && !__atomic_compare_exchange_n(&s->peak, &peak, live, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    if (alloc) {
+        __atomic_add_fetch(&s->allocs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void *
+mem_alloc(enum mem_tag tag, size_t size)
+{
+    void *ptr = malloc(size);
+
+    if (ptr) {
+        account(tag, malloc_usable_size(ptr), true);
+    }
+    return ptr;
+}
+
+void *
+mem_calloc(enum mem_tag tag, size_t count, size_t size)
+{
+    void *ptr = calloc(count, size);
+
+    if (ptr) {
+        account(tag, malloc_usable_size(ptr), true);
+    }
+    return ptr;
+}
+
+void *
+mem_realloc(enum mem_tag tag, void *ptr, size_t size)
+{
+    size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+    void *grown = realloc(ptr, size);
+
+    if (grown) {
+        account(tag, (int64_t)malloc_usable_size(grown) - (int64_t)old_size, true);
+    }
+    return grown;
+}
+
+char *
+mem_strdup(enum mem_tag tag, const char *s)
+{
+    return mem_strndup(tag, s, strlen(s));
+}
+
+char *
+mem_strndup(enum mem_tag tag, const char *s, size_t len)
+{
+    char *copy = mem_alloc(tag, len + 1);
+
+    if (copy) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void
+mem_free(enum mem_tag tag, void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    account(tag, -(int64_t)malloc_usable_size(ptr), false);
+    __atomic_add_fetch(&stats[tag].frees, 1, __ATOMIC_RELAXED);
+    free(ptr);
+}
+
+void
+mem_account(enum mem_tag tag, int64_t bytes)
+{
+    account(tag, bytes, false);
+}
+
+const char *
+mem_tag_name(enum mem_tag tag)
+{
+    static const char *const names[MEM_TAG_COUNT] = {
+        [MEM_TRANSFER] = "transfer",
+        [MEM_OFFER] = "offer",
+        [MEM_HISTORY] = "history",
+        [MEM_INDEX] = "index",
+        [MEM_OUTPUT] = "output",
+        [MEM_PIPELINE] = "pipeline",
+        [MEM_SHARE] = "share",
+        [MEM_LOOP] = "loop",
+        [MEM_TELEMETRY] = "telemetry",
+    };
+    return names[tag];
+}
+
+void
+mem_get_stats(enum mem_tag tag, struct mem_stats *out)
+{
+    out->live = __atomic_load_n(&stats[tag].live, __ATOMIC_RELAXED);
+    out->peak = __atomic_load_n(&stats[tag].peak, __ATOMIC_RELAXED);
+    out->allocs = __atomic_load_n(&stats[tag].allocs, __ATOMIC_RELAXED);
+    out->frees = __atomic_load_n(&stats[tag].frees, __ATOMIC_RELAXED);
+}
+
+uint64_t
+mem_alloc_count(void)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        total += __atomic_load_n(&stats[i].allocs, __ATOMIC_RELAXED);
+    }
+    return total;
+}
@@ -0,0 +1,55 @@
+/**
+ * Tracked allocations
+ *
+ * Every heap allocation in the monitor goes through here, tagged with the
+ * subsystem it belongs to, so live bytes, peaks and allocation counts can
+ * be reported per subsystem. Sizes come from malloc_usable_size(), so
+ * callers free without passing a size. Memory not on the heap, such as
+ * payload memfds, is added with mem_account().
+ *
+ * The counters are relaxed atomics: allocations are rare on any thread
+ * but the dispatch thread, but they may happen there.
+ */
+
+#ifndef ZIG_CLIP_MEM_H
+#define ZIG_CLIP_MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum mem_tag {
+    MEM_TRANSFER,  // Transfers, payloads and their memfd bytes
+    MEM_OFFER,     // Offer records and MIME type lists
+    MEM_HISTORY,   // History ring
+    MEM_INDEX,     // History hash index
+    MEM_OUTPUT,    // Output encoding buffers and the stdout ring
+    MEM_PIPELINE,  // Worker pipeline and its queues
+    MEM_SHARE,     // Share socket and its subscribers
+    MEM_LOOP,      // Event loop sources and the display reader
+    MEM_TELEMETRY, // Latency tracing, metrics, logging and session recording
+    MEM_TAG_COUNT,
+};
+
+struct mem_stats {
+    uint64_t live;   // Bytes
+    uint64_t peak;
+    uint64_t allocs; // Including reallocations
+    uint64_t frees;
+};
+
+void *mem_alloc(enum mem_tag tag, size_t size);
+void *mem_calloc(enum mem_tag tag, size_t count, size_t size);
+void *mem_realloc(enum mem_tag tag, void *ptr, size_t size);
+char *mem_strdup(enum mem_tag tag, const char *s);
+char *mem_strndup(enum mem_tag tag, const char *s, size_t len);
+void mem_free(enum mem_tag tag, void *ptr);
+
+// Off-heap memory owned by a subsystem, negative when released
+void mem_account(enum mem_tag tag, int64_t bytes);
+
+const char *mem_tag_name(enum mem_tag tag);
+void mem_get_stats(enum mem_tag tag, struct mem_stats *stats);
+// Allocations across all subsystems so far
+uint64_t mem_alloc_count(void);
+
+#endif
@@ -0,0 +1,457 @@
+/**
+ * Prometheus metrics
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "event-loop.h"
+#include "mem.h"
+#include "metrics.h"
+
+// Threads with a shard of their own: dispatch, reader and the workers
+#define METRICS_MAX_SHARDS 64
+#define METRICS_MAX_CLIENTS 16
+#define METRICS_REQUEST_MAX 4096
+
+_Thread_local struct metrics_shard *metrics_local_shard;
+
+static struct metrics_shard shards[METRICS_MAX_SHARDS];
+static int shard_count;
+static bool released[METRICS_MAX_SHARDS]; // Owner gone, counts kept, free to take
+static struct metrics_shard shared_shard;
+
+static const struct {
+    const char *name;
+    const char *help;
+    double scale;
+} counter_info[METRICS_COUNTER_COUNT] = {
+    [METRICS_WORKER_JOBS] = { "zigclip_pipeline_jobs_total",
+                              "Payloads hashed and classified", 1 },
+    [METRICS_WORKER_BYTES] = { "zigclip_pipeline_bytes_total",
+                               "Payload bytes hashed and classified", 1 },
+    [METRICS_WORKER_BUSY_NS] = { "zigclip_pipeline_busy_seconds_total",
+                                 "Time spent running pipeline stages", 1e-9 },
+    [METRICS_DISPLAY_READS] = { "zigclip_display_reads_total",
+                                "Reads of the Wayland socket", 1 },
+};
+
+struct metrics_client {
+    struct metrics_server *server;
+    int fd;
+    struct event_source *source;
+    char request[METRICS_REQUEST_MAX];
+    size_t request_len;
+    struct metrics_writer response;
+    size_t sent;
+};
+
+struct metrics_server {
+    struct event_loop *loop;
+    int listen_fd;
+    struct event_source *listen_source;
+    char *path; // Unix socket to unlink, NULL for TCP
+
+    metrics_collect_func_t collect;
+    void *data;
+
+    struct metrics_client *clients[METRICS_MAX_CLIENTS];
+    int client_count;
+};
+
+void
+metrics_thread_register(void)
+{
+    int count = __atomic_load_n(&shard_count, __ATOMIC_RELAXED);
+    for (int i = 0; i < count && i < METRICS_MAX_SHARDS; i++) {
+        if (__atomic_load_n(&released[i], __ATOMIC_RELAXED) &&
+            __atomic_exchange_n(&released[i], false, __ATOMIC_ACQUIRE)) {
+            metrics_local_shard = &shards[i];
+            return;
+        }
+    }
+
+    int index = __atomic_fetch_add(&shard_count, 1, __ATOMIC_RELAXED);
+    if (index < METRICS_MAX_SHARDS) {
+        metrics_local_shard = &shards[index];
+    }
+}
+
+void
+metrics_thread_unregister(void)
+{
+    struct metrics_shard *shard = metrics_local_shard;
+
+    if (shard) {
+        metrics_local_shard = NULL;
+        __atomic_store_n(&released[shard - shards], true, __ATOMIC_RELEASE);
+    }
+}
+
+void
+metrics_add_shared(enum metrics_counter counter, uint64_t value)
+{
+    __atomic_fetch_add(&shared_shard.counters[counter], value, __ATOMIC_RELAXED);
+}
+
+uint64_t
+metrics_counter_total(enum metrics_counter counter)
+{
+    int count = __atomic_load_n(&shard_count, __ATOMIC_RELAXED);
+    uint64_t total = __atomic_load_n(&shared_shard.counters[counter], __ATOMIC_RELAXED);
+
+    if (count > METRICS_MAX_SHARDS) {
+        count = METRICS_MAX_SHARDS;
+    }
+    for (int i = 0; i < count; i++) {
+        total += __atomic_load_n(&shards[i].counters[counter], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+static void
+writer_printf(struct metrics_writer *writer, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (n < 0 || writer->failed) {
+        writer->failed = true;
+        return;
+    }
+
+    if (writer->len + n + 1 > writer->size) {
+        size_t size = writer->size ? writer->size : 8192;
+        while (writer->len + n + 1 > size) {
+            size *= 2;
+        }
+        char *buf = mem_realloc(MEM_TELEMETRY, writer->buf, size);
+        if (!buf) {
+            writer->failed = true;
+            return;
+        }
+        writer->buf = buf;
+        writer->size = size;
+    }
+
+    va_start(args, fmt);
+    vsnprintf(writer->buf + writer->len, writer->size - writer->len, fmt, args);
+    va_end(args);
+    writer->len += n;
+}
+
+void
+metrics_family(struct metrics_writer *writer, const char *name, const char *type,
+               const char *help)
+{
+    writer_printf(writer, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void
+metrics_sample(struct metrics_writer *writer, const char *name, const char *labels,
+               double value)
+{
+    if (labels) {
+        writer_printf(writer, "%s{%s} %.17g\n", name, labels, value);
+    } else {
+        writer_printf(writer, "%s %.17g\n", name, value);
+    }
+}
+
+static double
+resident_bytes(void)
+{
+    FILE *f = fopen("/proc/self/statm", "re");
+    unsigned long size, resident;
+
+    if (!f) {
+        return 0;
+    }
+    int n = fscanf(f, "%lu %lu", &size, &resident);
+    fclose(f);
+    return n == 2 ? (double)resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+void
+metrics_write_builtin(struct metrics_writer *writer)
+{
+    for (int i = 0; i < METRICS_COUNTER_COUNT; i++) {
+        metrics_family(writer, counter_info[i].name, "counter", counter_info[i].help);
+        metrics_sample(writer, counter_info[i].name, NULL,
+                       metrics_counter_total(i) * counter_info[i].scale);
+    }
+    metrics_family(writer, "zigclip_resident_memory_bytes", "gauge", "Resident set size");
+    metrics_sample(writer, "zigclip_resident_memory_bytes", NULL, resident_bytes());
+}
+
+static void
+client_destroy(struct metrics_client *client)
+{
+    struct metrics_server *server = client->server;
+
+    for (int i = 0; i < server->client_count; i++) {
+        if (server->clients[i] == client) {
+            server->clients[i] = server->clients[--server->client_count];
+            break;
+        }
+    }
+
+    event_source_remove(client->source);
+    close(client->fd);
+    mem_free(MEM_TELEMETRY, client->response.buf);
+    mem_free(MEM_TELEMETRY, client);
+}
+
+static bool
+request_complete(const struct metrics_client *client)
+{
+    return memmem(client->request, client->request_len, "\r\n\r\n", 4) ||
+           memmem(client->request, client->request_len, "\n\n", 2);
+}
+
+static void
+build_response(struct metrics_client *client)
+{
+    struct metrics_server *server = client->server;
+    struct metrics_writer body = { 0 };
+
+    server->collect(server->data, &body);
+    metrics_write_builtin(&body);
+
+    if (body.failed) {
+        writer_printf(&client->response, "HTTP/1.0 500 Internal Server Error\r\n"
+                      "Content-Length: 0\r\nConnection: close\r\n\r\n");
+    } else {
+        writer_printf(&client->response, "HTTP/1.0 200 OK\r\n"
+                      "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                      "Content-Length: %zu\r\nConnection: close\r\n\r\n%.*s",
+                      body.len, (int)body.len, body.buf);
+    }
+    mem_free(MEM_TELEMETRY, body.buf);
+}
+
+static void
+handle_client_event(void *data, int fd, uint32_t mask)
+{
+    struct metrics_client *client = data;
+
+    if (mask & EVENT_LOOP_ERROR) {
+        client_destroy(client);
+        return;
+    }
+
+    if (!client->response.buf) {
+        ssize_t n = recv(fd, client->request + client->request_len,
+                         sizeof(client->request) - client->request_len, MSG_DONTWAIT);
+        if (n == -1) {
+            if (errno != EAGAIN && errno != EINTR)
+                client_destroy(client);
+            return;
+        }
+        client->request_len += n;
+        // A bare client that just connects and shuts down gets an answer too
+        if (n > 0 && !request_complete(client) &&
+            client->request_len < sizeof(client->request)) {
+            return;
+        }
+
+        build_response(client);
+        if (client->response.failed) {
+            client_destroy(client);
+            return;
+        }
+        event_source_update(client->source, EVENT_LOOP_WRITABLE);
+    }
+
+    while (client->sent < client->response.len) {
+        ssize_t n = send(fd, client->response.buf + client->sent,
+                         client->response.len - client->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EINTR)
+                return;
+            break;
+        }
+        client->sent += n;
+    }
+    client_destroy(client);
+}
+
+static void
+handle_listen_event(void *data, int fd, uint32_t mask)
+{
+    struct metrics_server *server = data;
+
+    for (;;) {
+        int client_fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (client_fd == -1) {
+            return;
+        }
+
+        // Scrapes are rare, more than a handful at once is not a scraper
+        struct metrics_client *client = NULL;
+        if (server->client_count < METRICS_MAX_CLIENTS) {
+            client = mem_calloc(MEM_TELEMETRY, 1, sizeof(*client));
+        }
+        if (!client) {
+            close(client_fd);
+            continue;
+        }
+        client->server = server;
+        client->fd = client_fd;
+        client->source = event_loop_add_fd(server->loop, client_fd, EVENT_LOOP_READABLE,
+                                           handle_client_event, client);
+        if (!client->source) {
+            close(client_fd);
+            mem_free(MEM_TELEMETRY, client);
+            continue;
+        }
+        server->clients[server->client_count++] = client;
+    }
+}
+
+static int
+listen_unix(struct metrics_server *server, const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (server->listen_fd == -1) {
+        return -1;
+    }
+
+    // Replace a stale socket left behind by a previous run, nothing else
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    mode_t old_umask = umask(0077);
+    int ret = bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+    if (ret == -1) {
+        return -1;
+    }
+    server->path = mem_strdup(MEM_TELEMETRY, path);
+    return 0;
+}
+
+static int
+listen_loopback(struct metrics_server *server, const char *address)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    const char *port = strrchr(address, ':');
+    char host[INET_ADDRSTRLEN] = "127.0.0.1";
+
+    if (port) {
+        size_t len = port - address;
+        if (len >= sizeof(host)) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (len > 0) {
+            memcpy(host, address, len);
+            host[len] = '\0';
+        }
+        port++;
+    } else {
+        port = address;
+    }
+
+    char *end;
+    long number = strtol(port, &end, 10);
+    if (*port == '\0' || *end != '\0' || number <= 0 || number > 65535 ||
+        inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Metrics say a lot about what is being copied, keep them on this host
+    if ((ntohl(addr.sin_addr.s_addr) >> 24) != 127) {
+        errno = EADDRNOTAVAIL;
+        return -1;
+    }
+    addr.sin_port = htons(number);
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (server->listen_fd == -1) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    return bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+struct metrics_server *
+metrics_server_create(struct event_loop *loop, const char *address,
+                      metrics_collect_func_t collect, void *data)
+{
+    struct metrics_server *server = mem_calloc(MEM_TELEMETRY, 1, sizeof(*server));
+    if (!server) {
+        return NULL;
+    }
+    server->loop = loop;
+    server->listen_fd = -1;
+    server->collect = collect;
+    server->data = data;
+
+    int ret = strchr(address, '/') ? listen_unix(server, address) :
+                                     listen_loopback(server, address);
+    if (ret == -1 || listen(server->listen_fd, 8) == -1) {
+        goto err;
+    }
+
+    server->listen_source = event_loop_add_fd(loop, server->listen_fd, EVENT_LOOP_READABLE,
+                                              handle_listen_event, server);
+    if (!server->listen_source) {
+        goto err;
+    }
+    return server;
+
+err:
+    if (server->listen_fd != -1) {
+        int saved = errno;
+        close(server->listen_fd);
+        errno = saved;
+    }
+    if (server->path) {
+        unlink(server->path);
+        mem_free(MEM_TELEMETRY, server->path);
+    }
+    mem_free(MEM_TELEMETRY, server);
+    return NULL;
+}
+
+void
+metrics_server_destroy(struct metrics_server *server)
+{
+    if (!server) {
+        return;
+    }
+
+    while (server->client_count > 0) {
+        client_destroy(server->clients[0]);
+    }
+    event_source_remove(server->listen_source);
+    close(server->listen_fd);
+    if (server->path) {
+        unlink(server->path);
+        mem_free(MEM_TELEMETRY, server->path);
+    }
+    mem_free(MEM_TELEMETRY, server);
+}
@@ -0,0 +1,95 @@
+/**
+ * Prometheus metrics
+ *
+ * Counters bumped off the dispatch thread live in per-thread shards, each
+ * on its own cache lines, so updating one is a plain load and store with
+ * no sharing between cores. A scrape sums the shards. Everything the
+ * dispatch thread already counts is read straight from its structures by
+ * the collect callback when a scrape comes in.
+ *
+ * The server speaks just enough HTTP/1.0 for a scraper: any request gets
+ * the text exposition format back and the connection is closed.
+ */
+
+#ifndef ZIG_CLIP_METRICS_H
+#define ZIG_CLIP_METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "build-features.h"
+#include "util.h"
+
+struct event_loop;
+struct metrics_server;
+
+enum metrics_counter {
+    METRICS_WORKER_JOBS,    // Payloads through the pipeline stages
+    METRICS_WORKER_BYTES,   // Bytes those payloads held
+    METRICS_WORKER_BUSY_NS, // Time spent running stages
+    METRICS_DISPLAY_READS,  // Reads of the Wayland socket
+    METRICS_COUNTER_COUNT,
+};
+
+struct metrics_shard {
+    _Alignas(CACHE_LINE_SIZE) uint64_t counters[METRICS_COUNTER_COUNT];
+};
+
+extern _Thread_local struct metrics_shard *metrics_local_shard;
+
+// Give the calling thread a shard of its own. Threads without one share a
+// slower atomic fallback.
+void metrics_thread_register(void);
+// Hand the shard back before the thread exits. Its counts stay in the
+// totals and the next thread to register carries on with it.
+void metrics_thread_unregister(void);
+
+void metrics_add_shared(enum metrics_counter counter, uint64_t value);
+
+static inline void
+metrics_add(enum metrics_counter counter, uint64_t value)
+{
+    if (!ZIGCLIP_FEATURE_METRICS) {
+        return;
+    }
+    struct metrics_shard *shard = metrics_local_shard;
+
+    if (!shard) {
+        metrics_add_shared(counter, value);
+        return;
+    }
+    // Only this thread writes the shard, the store just must not tear
+    __atomic_store_n(&shard->counters[counter], shard->counters[counter] + value,
+                     __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_counter_total(enum metrics_counter counter);
+
+// Text exposition being assembled for a scrape
+struct metrics_writer {
+    char *buf;
+    size_t len;
+    size_t size;
+    bool failed;
+};
+
+// # HELP and # TYPE lines, once before the samples of a metric
+void metrics_family(struct metrics_writer *writer, const char *name, const char *type,
+                    const char *help);
+// One sample; labels like `class="text"` or NULL
+void metrics_sample(struct metrics_writer *writer, const char *name, const char *labels,
+                    double value);
+
+// Samples for the sharded counters and process metrics such as RSS
+void metrics_write_builtin(struct metrics_writer *writer);
+
+typedef void (*metrics_collect_func_t)(void *data, struct metrics_writer *writer);
+
+// address is a Unix socket path (anything with a '/') or a loopback
+// [HOST:]PORT, HOST defaulting to 127.0.0.1
+struct metrics_server *metrics_server_create(struct event_loop *loop, const char *address,
+                                             metrics_collect_func_t collect, void *data);
+void metrics_server_destroy(struct metrics_server *server);
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * Data-control offers
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "evtrace.h"
+#include "mem.h"
+#include "offer.h"
+#include "util.h"
+#include "wlr-data-control-protocol.h"
+
+// Released records kept for reuse, enough for a full wait queue and the
+// transfers and coalescer beside it
+#define OFFER_POOL_MAX 32
+
+// Records whose MIME buffers grew past this are freed, not pooled
+#define OFFER_POOL_KEEP_BYTES 4096
+
+static const char *const state_names[OFFER_STATE_COUNT] = {
+    [OFFER_INTRODUCED] = "introduced",
+    [OFFER_SELECTED] = "selected",
+};
+
+const char *
+offer_state_name(enum offer_state state)
+{
+    return state_names[state];
+}
+
+static void
+set_state(struct offer *offer, enum offer_state state)
+{
+    offer->manager->live_count[offer->state]--;
+    offer->manager->live_count[state]++;
+    offer->state = state;
+}
+
+// Make room for len more bytes of MIME type names
+static bool
+reserve_names(struct offer *offer, size_t len)
+{
+    if (offer->names_len + len <= offer->names_capacity) {
+        return true;
+    }
+
+    size_t capacity = offer->names_capacity ? offer->names_capacity * 2 : 256;
+    while (capacity < offer->names_len + len) {
+        capacity *= 2;
+    }
+    char *names = mem_realloc(MEM_OFFER, offer->names, capacity);
+    if (!names) {
+        return false;
+    }
+    offer->names = names;
+    offer->names_capacity = capacity;
+
+    // The types collected so far moved with the buffer
+    char *name = names;
+    for (int i = 0; i < offer->mime_count; i++) {
+        offer->mime_types[i] = name;
+        name += strlen(name) + 1;
+    }
+    return true;
+}
+
+static void
+handle_offer(void *data, struct zwlr_data_control_offer_v1 *proxy, const char *mime_type)
+{
+    struct offer *offer = data;
+
+    evtrace(EVTRACE_OFFER_MIME, offer, evtrace_atom(mime_type), 0);
+    if (offer->mime_count == offer->mime_capacity) {
+        int capacity = offer->mime_capacity ? offer->mime_capacity * 2 : 8;
+        char **mime_types = mem_realloc(MEM_OFFER, offer->mime_types, capacity * sizeof(*mime_types));
+        if (!mime_types) {
+            return;
+        }
+        offer->mime_types = mime_types;
+        offer->mime_capacity = capacity;
+    }
+
+    size_t len = strlen(mime_type) + 1;
+    if (!reserve_names(offer, len)) {
+        return;
+    }
+    char *name = offer->names + offer->names_len;
+    memcpy(name, mime_type, len);
+    offer->names_len += len;
+    offer->mime_types[offer->mime_count++] = name;
+}
+
+static const struct zwlr_data_control_offer_v1_listener offer_listener = {
+    .offer = handle_offer,
+};
+
+static void
+free_record(struct offer *offer)
+{
+    mem_free(MEM_OFFER, offer->mime_types);
+    mem_free(MEM_OFFER, offer->names);
+    mem_free(MEM_OFFER, offer);
+}
+
+void
+offer_manager_init(struct offer_manager *manager)
+{
+    memset(manager, 0, sizeof(*manager));
+}
+
+void
+offer_manager_clear(struct offer_manager *manager)
+{
+    while (manager->live) {
+        offer_destroy(manager->live);
+    }
+}
+
+void
+offer_manager_finish(struct offer_manager *manager)
+{
+    offer_manager_clear(manager);
+    while (manager->pool) {
+        struct offer *offer = manager->pool;
+        manager->pool = offer->next;
+        free_record(offer);
+    }
+    manager->pool_count = 0;
+}
+
+int
+offer_manager_live_count(const struct offer_manager *manager)
+{
+    int count = 0;
+    for (int i = 0; i < OFFER_STATE_COUNT; i++) {
+        count += manager->live_count[i];
+    }
+    return count;
+}
+
+struct offer *
+offer_create(struct offer_manager *manager, struct zwlr_data_control_offer_v1 *proxy)
+{
+    // Every data_offer is followed by the selection event naming it, an
+    // offer still waiting for that will never see it
+    if (manager->introduced) {
+        manager->stale++;
+        offer_destroy(manager->introduced);
+    }
+
+    struct offer *offer = manager->pool;
+    if (offer) {
+        manager->pool = offer->next;
+        manager->pool_count--;
+        manager->reused++;
+    } else {
+        offer = mem_calloc(MEM_OFFER, 1, sizeof(*offer));
+        if (!offer) {
+            zwlr_data_control_offer_v1_destroy(proxy);
+            return NULL;
+        }
+        manager->created++;
+    }
+
+    offer->manager = manager;
+    offer->state = OFFER_INTRODUCED;
+    offer->proxy = proxy;
+    offer->mime_count = 0;
+    offer->names_len = 0;
+    offer->introduced_ns = clock_ns(CLOCK_MONOTONIC);
+    offer->selected_ns = 0;
+    offer->record_id = 0;
+
+    offer->prev = NULL;
+    offer->next = manager->live;
+    if (manager->live) {
+        manager->live->prev = offer;
+    }
+    manager->live = offer;
+    manager->live_count[OFFER_INTRODUCED]++;
+    manager->introduced = offer;
+
+    zwlr_data_control_offer_v1_add_listener(proxy, &offer_listener, offer);
+    return offer;
+}
+
+void
+offer_destroy(struct offer *offer)
+{
+    struct offer_manager *manager = offer->manager;
+
+    zwlr_data_control_offer_v1_destroy(offer->proxy);
+    offer->proxy = NULL;
+
+    if (offer->prev) {
+        offer->prev->next = offer->next;
+    } else {
+        manager->live = offer->next;
+    }
+    if (offer->next) {
+        offer->next->prev = offer->prev;
+    }
+    if (manager->introduced == offer) {
+        manager->introduced = NULL;
+    }
+    manager->live_count[offer->state]--;
+    manager->destroyed++;
+
+    size_t kept = offer->names_capacity + offer->mime_capacity * sizeof(*offer->mime_types);
+    if (manager->pool_count == OFFER_POOL_MAX || kept > OFFER_POOL_KEEP_BYTES) {
+        free_record(offer);
+        return;
+    }
+    offer->next = manager->pool;
+    manager->pool = offer;
+    manager->pool_count++;
+}
+
+void
+offer_select(struct offer *offer)
+{
+    if (offer->manager->introduced == offer) {
+        offer->manager->introduced = NULL;
+    }
+    set_state(offer, OFFER_SELECTED);
+    offer->selected_ns = clock_ns(CLOCK_MONOTONIC);
+}
+
+struct offer *
+offer_from_proxy(struct zwlr_data_control_offer_v1 *proxy)
+{
+    return zwlr_data_control_offer_v1_get_user_data(proxy);
+}
+
+bool
+offer_has_mime(const struct offer *offer, const char *mime_type)
+{
+    for (int i = 0; i < offer->mime_count; i++) {
+        if (strcmp(offer->mime_types[i], mime_type) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+/**
+ * Data-control offers
+ *
+ * Wraps an offer proxy together with the MIME types the source announced
+ * for it, collected from the offer events that precede the selection.
+ *
+ * Every record belongs to an offer manager, which knows each live offer
+ * and what state it is in. An offer is destroyed as soon as it is of no
+ * further use: when a newer selection supersedes it, when its transfer
+ * has started, or when a newer offer is introduced before it ever became
+ * the selection. Released records go back to a small pool with their
+ * buffers, so a steady stream of selections allocates nothing.
+ */
+
+#ifndef ZIG_CLIP_OFFER_H
+#define ZIG_CLIP_OFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct zwlr_data_control_offer_v1;
+
+enum offer_state {
+    OFFER_INTRODUCED, // Collecting MIME types, the selection event is next
+    OFFER_SELECTED,   // Was the selection, waiting to be fetched or replaced
+    OFFER_STATE_COUNT,
+};
+
+struct offer_manager {
+    struct offer *live; // Every offer not destroyed yet
+    struct offer *introduced; // Newest offer not selected yet
+    struct offer *pool; // Released records kept for reuse
+    int pool_count;
+
+    int live_count[OFFER_STATE_COUNT];
+    uint64_t created;  // Records allocated
+    uint64_t reused;   // Records taken from the pool instead
+    uint64_t stale;    // Introduced offers never selected
+    uint64_t destroyed;
+};
+
+struct offer {
+    struct offer_manager *manager;
+    struct offer *prev, *next; // Live list, next links the pool too
+    enum offer_state state;
+
+    struct zwlr_data_control_offer_v1 *proxy;
+    char **mime_types; // In announcement order
+    int mime_count;
+    int mime_capacity;
+    char *names; // The MIME type strings back to back
+    size_t names_len;
+    size_t names_capacity;
+
+    uint64_t introduced_ns; // CLOCK_MONOTONIC of the data_offer event
+    uint64_t selected_ns;   // CLOCK_MONOTONIC of the selection event
+    uint32_t record_id;     // Selection id in a session recording
+};
+
+void offer_manager_init(struct offer_manager *manager);
+// Destroys the offers still live and frees the pool
+void offer_manager_finish(struct offer_manager *manager);
+// Destroys the offers still live, for a connection going away
+void offer_manager_clear(struct offer_manager *manager);
+
+int offer_manager_live_count(const struct offer_manager *manager);
+const char *offer_state_name(enum offer_state state);
+
+// Takes over the proxy and listens for its MIME types. The proxy is
+// destroyed if the record cannot be allocated. An offer introduced
+// before and never selected is stale now and destroyed.
+struct offer *offer_create(struct offer_manager *manager,
+                           struct zwlr_data_control_offer_v1 *proxy);
+// Destroys the proxy as well, the record goes back to the pool
+void offer_destroy(struct offer *offer);
+
+// The offer became the selection
+void offer_select(struct offer *offer);
+
+// Record of a proxy passed to offer_create, NULL if that failed
+struct offer *offer_from_proxy(struct zwlr_data_control_offer_v1 *proxy);
+
+bool offer_has_mime(const struct offer *offer, const char *mime_type);
+
+#endif
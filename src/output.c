@@ -0,0 +1,371 @@
+/**
+ * Framed payload output
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "build-features.h"
+#include "frame-protocol.h"
+#include "json.h"
+#include "mem.h"
+#include "output.h"
+#include "payload.h"
+#include "sink.h"
+#include "util.h"
+
+// The framing, a constant in builds that fix it so the switches on it fold
+// to a single case
+static inline enum output_format
+output_format(const struct output *output)
+{
+#ifdef ZIGCLIP_OUTPUT_FORMAT
+    return ZIGCLIP_OUTPUT_FORMAT;
+#else
+    return output->format;
+#endif
+}
+
+int
+output_parse_format(const char *name, enum output_format *format)
+{
+    static const struct {
+        const char *name;
+        enum output_format format;
+    } formats[] = {
+        { "raw", OUTPUT_RAW },
+        { "nul", OUTPUT_NUL },
+        { "binary", OUTPUT_BINARY },
+        { "ndjson", OUTPUT_NDJSON },
+    };
+
+    for (size_t i = 0; i < ARRAY_LENGTH(formats); i++) {
+        if (strcmp(name, formats[i].name) == 0) {
+#ifdef ZIGCLIP_OUTPUT_FORMAT
+            if (formats[i].format != ZIGCLIP_OUTPUT_FORMAT) {
+                return -1;
+            }
+#endif
+            *format = formats[i].format;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void
+output_init(struct output *output, struct sink *sink, enum output_format format)
+{
+    memset(output, 0, sizeof(*output));
+    output->sink = sink;
+    output->format = format;
+}
+
+void
+output_finish(struct output *output)
+{
+    mem_free(MEM_OUTPUT, output->scratch);
+    mem_free(MEM_OUTPUT, output->chunk);
+    output->scratch = NULL;
+    output->scratch_size = 0;
+    output->chunk = NULL;
+    output->chunk_size = 0;
+}
+
+static int
+reserve_scratch(struct output *output, size_t size)
+{
+    if (size <= output->scratch_size) {
+        return 0;
+    }
+
+    size_t new_size = output->scratch_size ? output->scratch_size : 4096;
+    while (new_size < size) {
+        new_size += new_size / 2;
+    }
+
+    char *scratch = mem_realloc(MEM_OUTPUT, output->scratch, new_size);
+    if (!scratch) {
+        return -1;
+    }
+    output->scratch = scratch;
+    output->scratch_size = new_size;
+    return 0;
+}
+
+static bool
+is_text_mime(const char *mime_type)
+{
+    return strncmp(mime_type, "text/", 5) == 0 ||
+           strcmp(mime_type, "UTF8_STRING") == 0 ||
+           strcmp(mime_type, "STRING") == 0 ||
+           strcmp(mime_type, "TEXT") == 0 ||
+           strcmp(mime_type, "application/json") == 0;
+}
+
+// Escape src into the scratch buffer, growing it as needed
+static ssize_t
+escape_to_scratch(struct output *output, size_t offset, const char *src, size_t len)
+{
+    size_t written = offset;
+
+    if (reserve_scratch(output, offset + len + len / 8 + 16) == -1) {
+        return -1;
+    }
+
+    for (;;) {
+        size_t consumed;
+        written += json_escape(output->scratch + written, output->scratch_size - written,
+                               src, len, &consumed);
+        src += consumed;
+        len -= consumed;
+        if (len == 0) {
+            return written;
+        }
+        if (reserve_scratch(output, written + len + len / 4 + 16) == -1) {
+            return -1;
+        }
+    }
+}
+
+// One output record: a whole payload, a streamed chunk or the end marker
+struct record {
+    enum zc_frame_type type;
+    uint32_t flags;
+    uint64_t offset;
+    const void *data;
+    size_t size;
+};
+
+static int
+write_ndjson(struct output *output, const struct payload *payload,
+             const struct record *record)
+{
+    char head[192 + PAYLOAD_MIME_MAX * 6];
+    char mime[PAYLOAD_MIME_MAX * 6];
+    size_t consumed;
+    size_t mime_len = json_escape(mime, sizeof(mime), payload->mime_type,
+                                  strlen(payload->mime_type), &consumed);
+    // Only text known to be UTF-8 goes out as a JSON string. Streamed
+    // chunks are never known to be: they precede validation and may cut
+    // through a character.
+    bool text = record->type == ZC_FRAME_PAYLOAD && is_text_mime(payload->mime_type) &&
+                payload->analyzed && payload->utf8;
+
+    int head_len = snprintf(head, sizeof(head), "{\"seq\":%llu,\"ts\":%llu,\"mime\":\"%.*s\",",
+                            (unsigned long long)payload->seq,
+                            (unsigned long long)payload->timestamp_ns,
+                            (int)mime_len, mime);
+
+    if (record->type == ZC_FRAME_END) {
+        head_len += snprintf(head + head_len, sizeof(head) - head_len,
+                             "\"end\":true,\"len\":%llu%s}\n",
+                             (unsigned long long)record->offset,
+                             record->flags & ZC_FRAME_INCOMPLETE ? ",\"incomplete\":true" : "");
+        struct iovec iov = { head, head_len };
+        return sink_writev(output->sink, &iov, 1);
+    }
+
+    if (record->type == ZC_FRAME_CHUNK) {
+        head_len += snprintf(head + head_len, sizeof(head) - head_len,
+                             "\"offset\":%llu,\"chunk_base64\":\"",
+                             (unsigned long long)record->offset);
+    } else {
+        head_len += snprintf(head + head_len, sizeof(head) - head_len,
+                             "\"len\":%zu,\"%s\":\"", record->size,
+                             text ? "data" : "data_base64");
+    }
+
+    ssize_t body_len;
+    if (text) {
+        body_len = escape_to_scratch(output, 0, record->data, record->size);
+    } else if (reserve_scratch(output, json_base64_size(record->size)) == 0) {
+        body_len = json_base64(output->scratch, record->data, record->size);
+    } else {
+        body_len = -1;
+    }
+    if (body_len == -1) {
+        return -1;
+    }
+
+    struct iovec iov[] = {
+        { head, head_len },
+        { output->scratch, body_len },
+        { "\"}\n", 3 },
+    };
+    return sink_writev(output->sink, iov, ARRAY_LENGTH(iov));
+}
+
+static int
+write_record(struct output *output, const struct payload *payload,
+             const struct record *record)
+{
+    size_t mime_len = strlen(payload->mime_type);
+    struct zc_frame_header header = {
+        .magic = ZC_FRAME_MAGIC,
+        .header_size = sizeof(header) + mime_len,
+        .type = record->type,
+        .mime_len = mime_len,
+        .flags = record->flags,
+        .seq = payload->seq,
+        .timestamp_ns = payload->timestamp_ns,
+        .offset = record->offset,
+        .size = record->size,
+    };
+    struct iovec iov[3];
+    int count = 0;
+
+    switch (output_format(output)) {
+        case OUTPUT_RAW:
+        case OUTPUT_NUL:
+            // Streamed chunks go out bare, the terminator follows at the end
+            if (record->type != ZC_FRAME_END)
+                iov[count++] = (struct iovec){ (void *)record->data, record->size };
+            if (record->type != ZC_FRAME_CHUNK)
+                iov[count++] = (struct iovec){ output_format(output) == OUTPUT_RAW ? "\n" : "", 1 };
+            break;
+        case OUTPUT_BINARY:
+            iov[count++] = (struct iovec){ &header, sizeof(header) };
+            iov[count++] = (struct iovec){ (void *)payload->mime_type, mime_len };
+            iov[count++] = (struct iovec){ (void *)record->data, record->size };
+            break;
+        case OUTPUT_NDJSON:
+            return write_ndjson(output, payload, record);
+    }
+
+    return sink_writev(output->sink, iov, count);
+}
+
+int
+output_write_payload(struct output *output, const struct payload *payload)
+{
+    struct record record = {
+        .type = ZC_FRAME_PAYLOAD,
+        .data = payload->data,
+        .size = payload->size,
+    };
+    return write_record(output, payload, &record);
+}
+
+int
+output_write_chunk(struct output *output, const struct payload *payload,
+                   size_t offset, size_t len)
+{
+    if (len > output->chunk_size) {
+        char *chunk = mem_realloc(MEM_OUTPUT, output->chunk, len);
+        if (!chunk) {
+            return -1;
+        }
+        output->chunk = chunk;
+        output->chunk_size = len;
+    }
+
+    // The payload is not mapped until sealed, the bytes are still hot in
+    // the page cache of its memfd
+    for (size_t done = 0; done < len;) {
+        ssize_t n = pread(payload->fd, output->chunk + done, len - done, offset + done);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += n;
+    }
+
+    struct record record = {
+        .type = ZC_FRAME_CHUNK,
+        .offset = offset,
+        .data = output->chunk,
+        .size = len,
+    };
+    return write_record(output, payload, &record);
+}
+
+int
+output_write_end(struct output *output, const struct payload *payload, bool complete)
+{
+    struct record record = {
+        .type = ZC_FRAME_END,
+        .flags = complete ? 0 : ZC_FRAME_INCOMPLETE,
+        .offset = payload->size,
+    };
+    return write_record(output, payload, &record);
+}
+
+int
+output_write_offer(struct output *output, uint64_t seq, uint64_t timestamp_ns,
+                   char *const *mime_types, int mime_count)
+{
+    // NDJSON needs the most: the head with two 20 digit numbers, each type
+    // quoted after a comma and escaped to \u00XX per byte at worst, then
+    // the closing "]}\n" and a last byte for the NUL of snprintf()
+    size_t size = sizeof("{\"seq\":,\"ts\":,\"offer\":[") - 1 + 2 * 20 + sizeof("]}\n");
+    for (int i = 0; i < mime_count; i++) {
+        size += strlen(mime_types[i]) * 6 + sizeof(",\"\"") - 1;
+    }
+    if (reserve_scratch(output, size) == -1) {
+        return -1;
+    }
+
+    char *buf = output->scratch;
+    size_t len = 0;
+    struct zc_frame_header header = {
+        .magic = ZC_FRAME_MAGIC,
+        .header_size = sizeof(header),
+        .type = ZC_FRAME_OFFER,
+        .seq = seq,
+        .timestamp_ns = timestamp_ns,
+    };
+
+    if (output_format(output) == OUTPUT_NDJSON) {
+        len = snprintf(buf, size, "{\"seq\":%llu,\"ts\":%llu,\"offer\":[",
+                       (unsigned long long)seq, (unsigned long long)timestamp_ns);
+    }
+    for (int i = 0; i < mime_count; i++) {
+        size_t mime_len = strlen(mime_types[i]);
+        size_t consumed;
+
+        switch (output_format(output)) {
+            case OUTPUT_RAW:
+            case OUTPUT_NUL:
+                if (i > 0)
+                    buf[len++] = ' ';
+                memcpy(buf + len, mime_types[i], mime_len);
+                len += mime_len;
+                break;
+            case OUTPUT_BINARY:
+                memcpy(buf + len, mime_types[i], mime_len + 1);
+                len += mime_len + 1;
+                break;
+            case OUTPUT_NDJSON:
+                len += snprintf(buf + len, size - len, "%s\"", i > 0 ? "," : "");
+                len += json_escape(buf + len, size - len, mime_types[i], mime_len, &consumed);
+                buf[len++] = '"';
+                break;
+        }
+    }
+
+    struct iovec iov[2];
+    int count = 0;
+    switch (output_format(output)) {
+        case OUTPUT_RAW:
+        case OUTPUT_NUL:
+            buf[len++] = output_format(output) == OUTPUT_RAW ? '\n' : '\0';
+            break;
+        case OUTPUT_BINARY:
+            header.size = len;
+            iov[count++] = (struct iovec){ &header, sizeof(header) };
+            break;
+        case OUTPUT_NDJSON:
+            memcpy(buf + len, "]}\n", 3);
+            len += 3;
+            break;
+    }
+    iov[count++] = (struct iovec){ buf, len };
+    return sink_writev(output->sink, iov, count);
+}
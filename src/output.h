@@ -0,0 +1,68 @@
+/**
+ * Framed payload output
+ *
+ * Each payload is written as one record in the selected framing. Header
+ * and payload are gathered into one vector straight from the payload
+ * mapping and handed to the non-blocking sink, stdio is not involved.
+ */
+
+#ifndef ZIG_CLIP_OUTPUT_H
+#define ZIG_CLIP_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct payload;
+struct sink;
+
+enum output_format {
+    OUTPUT_RAW,    // Payload followed by a newline (the historic format)
+    OUTPUT_NUL,    // Payload followed by a NUL byte
+    OUTPUT_BINARY, // struct zc_frame_header + MIME type + payload
+    OUTPUT_NDJSON, // One JSON object per line
+};
+
+// What -f defaults to, the only choice when the build fixes the framing.
+// OUTPUT_HAS_NDJSON tells whether NDJSON can be chosen at all.
+#ifdef ZIGCLIP_OUTPUT_FORMAT
+#define OUTPUT_DEFAULT_FORMAT ZIGCLIP_OUTPUT_FORMAT
+#define OUTPUT_HAS_NDJSON (ZIGCLIP_OUTPUT_FORMAT == OUTPUT_NDJSON)
+#else
+#define OUTPUT_DEFAULT_FORMAT OUTPUT_RAW
+#define OUTPUT_HAS_NDJSON 1
+#endif
+
+struct output {
+    struct sink *sink;
+    enum output_format format;
+
+    // Reused encoding buffer so steady state output does not allocate
+    char *scratch;
+    size_t scratch_size;
+    char *chunk; // Streamed bytes read back from the payload memfd
+    size_t chunk_size;
+};
+
+// Accepts "raw", "nul", "binary" and "ndjson"
+int output_parse_format(const char *name, enum output_format *format);
+
+void output_init(struct output *output, struct sink *sink, enum output_format format);
+void output_finish(struct output *output);
+
+int output_write_payload(struct output *output, const struct payload *payload);
+
+// Streaming mode: bytes [offset, offset + len) of a payload still being
+// received, then a trailing record once it is complete. Raw and NUL
+// framings write the bare bytes followed by the terminator; NDJSON chunks
+// are always base64 encoded, one by one, text or not.
+int output_write_chunk(struct output *output, const struct payload *payload,
+                       size_t offset, size_t len);
+int output_write_end(struct output *output, const struct payload *payload, bool complete);
+
+// Metadata-only mode: a selection and the MIME types it offers. Raw and
+// NUL framings list them space separated on one record.
+int output_write_offer(struct output *output, uint64_t seq, uint64_t timestamp_ns,
+                       char *const *mime_types, int mime_count);
+
+#endif
@@ -0,0 +1,404 @@
+/**
+ * One-shot paste
+ *
+ * Prints the current clipboard selection once and exits, for scripts that
+ * would otherwise start the monitor and kill it after the first record.
+ * It waits on the compositor as little as it can: the registry request
+ * and a sync go out together, the globals are bound and the data device
+ * requested in the same batch the moment both were announced, and the
+ * first selection event the device gets is the one taken. There are no
+ * threads and no event loop, and the source's pipe is spliced straight
+ * to stdout without passing through a buffer of ours. Text is followed
+ * by a newline, other types are written exactly as received.
+ *
+ * A source that sends nothing, or never closes its end, is given up on
+ * after the same limits the monitor applies to its transfers.
+ *
+ * Exits 1 when the clipboard is empty or offers none of the types asked
+ * for, 2 when the compositor cannot do wlr-data-control or the source
+ * timed out.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+#include "util.h"
+#include "wlr-data-control-protocol.h"
+
+#define MAX_TYPES 16
+#define SPLICE_CHUNK (1 << 20)
+
+static const char *const text_types[] = {
+    "text/plain;charset=utf-8",
+    "text/plain",
+    "UTF8_STRING",
+    "STRING",
+    "TEXT",
+};
+
+// When a newline goes after the contents
+enum newline {
+    NEWLINE_TEXT, // Text types only, binary data is left as it is
+    NEWLINE_NEVER,
+    NEWLINE_ALWAYS,
+};
+
+struct paste {
+    struct wl_display *display;
+    struct wl_seat *seat;
+    struct zwlr_data_control_manager_v1 *manager;
+    struct zwlr_data_control_device_v1 *device;
+    bool globals_done; // The sync sent with get_registry came back
+
+    const char *types[MAX_TYPES]; // Most wanted first
+    int type_count;
+
+    // The offer last introduced and the best type it has so far, the
+    // selection event follows its description
+    struct zwlr_data_control_offer_v1 *offer;
+    int offer_rank;
+    struct zwlr_data_control_offer_v1 *selection;
+    int selection_rank;
+    bool selection_seen;
+};
+
+static void
+offer_handle_offer(void *data, struct zwlr_data_control_offer_v1 *offer, const char *mime_type)
+{
+    struct paste *paste = data;
+
+    if (offer != paste->offer) {
+        return;
+    }
+    for (int i = 0; i < paste->offer_rank; i++) {
+        if (strcmp(mime_type, paste->types[i]) == 0) {
+            paste->offer_rank = i;
+            break;
+        }
+    }
+}
+
+static const struct zwlr_data_control_offer_v1_listener offer_listener = {
+    .offer = offer_handle_offer,
+};
+
+static void
+device_handle_data_offer(void *data, struct zwlr_data_control_device_v1 *device,
+                         struct zwlr_data_control_offer_v1 *offer)
+{
+    struct paste *paste = data;
+
+    if (paste->offer) {
+        zwlr_data_control_offer_v1_destroy(paste->offer);
+    }
+    paste->offer = offer;
+    paste->offer_rank = paste->type_count;
+    zwlr_data_control_offer_v1_add_listener(offer, &offer_listener, paste);
+}
+
+static void
+device_handle_selection(void *data, struct zwlr_data_control_device_v1 *device,
+                        struct zwlr_data_control_offer_v1 *offer)
+{
+    struct paste *paste = data;
+
+    if (paste->selection_seen) {
+        return; // Only the selection current when we asked counts
+    }
+    paste->selection_seen = true;
+    if (offer && offer == paste->offer) {
+        paste->selection = offer;
+        paste->selection_rank = paste->offer_rank;
+        paste->offer = NULL;
+    }
+}
+
+static void
+device_handle_finished(void *data, struct zwlr_data_control_device_v1 *device)
+{
+    struct paste *paste = data;
+    paste->selection_seen = true;
+}
+
+static const struct zwlr_data_control_device_v1_listener device_listener = {
+    .data_offer = device_handle_data_offer,
+    .selection = device_handle_selection,
+    .finished = device_handle_finished,
+    .primary_selection = NULL, // Version 1 is bound, it never comes
+};
+
+// Ask for the device as soon as both globals are known, the rest of the
+// registry is of no interest
+static void
+request_device(struct paste *paste)
+{
+    if (paste->device || !paste->seat || !paste->manager) {
+        return;
+    }
+    paste->device = zwlr_data_control_manager_v1_get_data_device(paste->manager, paste->seat);
+    zwlr_data_control_device_v1_add_listener(paste->device, &device_listener, paste);
+    wl_display_flush(paste->display);
+}
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry, uint32_t name,
+                       const char *interface, uint32_t version)
+{
+    struct paste *paste = data;
+
+    if (!paste->seat && strcmp(interface, wl_seat_interface.name) == 0) {
+        paste->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+    } else if (!paste->manager &&
+               strcmp(interface, zwlr_data_control_manager_v1_interface.name) == 0) {
+        paste->manager = wl_registry_bind(registry, name,
+                                          &zwlr_data_control_manager_v1_interface, 1);
+    }
+    request_device(paste);
+}
+
+static void
+registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_handle_global,
+    .global_remove = registry_handle_global_remove,
+};
+
+static void
+sync_handle_done(void *data, struct wl_callback *callback, uint32_t serial)
+{
+    struct paste *paste = data;
+    paste->globals_done = true;
+    wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener sync_listener = {
+    .done = sync_handle_done,
+};
+
+static int
+write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Wait until fd is readable or deadline_ns (CLOCK_MONOTONIC, 0 = never)
+// passes. Fails with ETIMEDOUT at the deadline.
+static int
+wait_readable(int fd, uint64_t deadline_ns)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    for (;;) {
+        int timeout = -1;
+        if (deadline_ns) {
+            uint64_t now = clock_ns(CLOCK_MONOTONIC);
+            if (now >= deadline_ns) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            // Rounded up, a poll that wakes early would spin
+            timeout = (deadline_ns - now + 999999) / 1000000;
+        }
+        int ret = poll(&pfd, 1, timeout);
+        if (ret == -1 && errno != EINTR) {
+            return -1;
+        }
+        if (ret > 0) {
+            return 0;
+        }
+    }
+}
+
+// Move everything the source writes to stdout. splice() needs no copy
+// through user space but not every stdout takes it, a terminal for one.
+// Fails with ETIMEDOUT when nothing arrived within first_byte_ns or the
+// source is still open after total_ns, either 0 for no limit.
+static int
+copy_to_stdout(int fd, uint64_t first_byte_ns, uint64_t total_ns)
+{
+    static char buf[65536];
+    bool use_splice = true;
+    bool received = false;
+    uint64_t start = clock_ns(CLOCK_MONOTONIC);
+
+    for (;;) {
+        uint64_t limit = received ? total_ns : first_byte_ns;
+        if (wait_readable(fd, limit ? start + limit : 0) == -1) {
+            if (errno == ETIMEDOUT) {
+                fprintf(stderr, "Gave up on the source: %s\n",
+                        received ? "still sending after the total limit"
+                                 : "nothing sent within the first byte limit");
+            }
+            return -1;
+        }
+
+        ssize_t n;
+        if (use_splice) {
+            n = splice(fd, NULL, STDOUT_FILENO, NULL, SPLICE_CHUNK, SPLICE_F_MOVE);
+            if (n == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                use_splice = false;
+                continue;
+            }
+        } else {
+            n = read(fd, buf, sizeof(buf));
+            if (n > 0 && write_all(STDOUT_FILENO, buf, n) == -1) {
+                return -1;
+            }
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n;
+        }
+        received = true;
+    }
+}
+
+static bool
+is_text_type(const char *type)
+{
+    if (strncmp(type, "text/", 5) == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < ARRAY_LENGTH(text_types); i++) {
+        if (strcmp(type, text_types[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+print_usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", program_name);
+    fprintf(stderr, "Print the clipboard once and exit.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -m TYPE  MIME type to ask for, repeat in order of preference (default: text)\n");
+    fprintf(stderr, "  -t MS    Give up on a source that has not sent anything after MS (default 5000, 0 = never)\n");
+    fprintf(stderr, "  -T MS    Give up on a source still sending after MS (default 60000, 0 = never)\n");
+    fprintf(stderr, "  -n       No newline after the contents\n");
+    fprintf(stderr, "  -N       Newline after the contents even when they are not text\n");
+    fprintf(stderr, "  -h       Show this help message\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    struct paste paste = { 0 };
+    enum newline newline = NEWLINE_TEXT;
+    long first_byte_ms = 5000;
+    long total_ms = 60000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:t:T:nNh")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (paste.type_count == MAX_TYPES) {
+                    fprintf(stderr, "Too many types\n");
+                    return 2;
+                }
+                paste.types[paste.type_count++] = optarg;
+                break;
+            case 't':
+                first_byte_ms = atol(optarg);
+                break;
+            case 'T':
+                total_ms = atol(optarg);
+                break;
+            case 'n':
+                newline = NEWLINE_NEVER;
+                break;
+            case 'N':
+                newline = NEWLINE_ALWAYS;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (paste.type_count == 0) {
+        for (size_t i = 0; i < ARRAY_LENGTH(text_types); i++) {
+            paste.types[paste.type_count++] = text_types[i];
+        }
+    }
+
+    paste.display = wl_display_connect(NULL);
+    if (!paste.display) {
+        fprintf(stderr, "Failed to connect to Wayland display\n");
+        return 2;
+    }
+
+    // The sync only matters when a global is missing: its answer tells
+    // the whole registry has been seen
+    struct wl_registry *registry = wl_display_get_registry(paste.display);
+    wl_registry_add_listener(registry, &registry_listener, &paste);
+    wl_callback_add_listener(wl_display_sync(paste.display), &sync_listener, &paste);
+
+    while (!paste.selection_seen) {
+        if (wl_display_dispatch(paste.display) == -1) {
+            fprintf(stderr, "Lost the Wayland connection: %s\n", strerror(errno));
+            return 2;
+        }
+        if (paste.globals_done && !paste.device) {
+            fprintf(stderr, "wlr-data-control protocol not supported by this compositor\n");
+            return 2;
+        }
+    }
+
+    if (!paste.selection || paste.selection_rank == paste.type_count) {
+        wl_display_disconnect(paste.display);
+        return 1;
+    }
+
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return 2;
+    }
+    const char *type = paste.types[paste.selection_rank];
+    zwlr_data_control_offer_v1_receive(paste.selection, type, pipefd[1]);
+    wl_display_flush(paste.display);
+    close(pipefd[1]);
+
+    int ret = copy_to_stdout(pipefd[0], first_byte_ms > 0 ? first_byte_ms * 1000000ull : 0,
+                             total_ms > 0 ? total_ms * 1000000ull : 0);
+    close(pipefd[0]);
+    if (ret == 0 && (newline == NEWLINE_ALWAYS ||
+                     (newline == NEWLINE_TEXT && is_text_type(type)))) {
+        ret = write_all(STDOUT_FILENO, "\n", 1);
+    }
+    if (ret == -1 && errno != ETIMEDOUT) {
+        perror("paste");
+    }
+
+    // Closing the socket releases every object, no need to destroy them one by one
+    wl_display_disconnect(paste.display);
+    return ret == -1 ? 2 : 0;
+}
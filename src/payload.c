@@ -0,0 +1,125 @@
+/**
+ * Captured clipboard payloads backed by sealed memfds
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "mem.h"
+#include "payload.h"
+
+#define PAYLOAD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+struct payload *
+payload_create(const char *mime_type)
+{
+    struct payload *payload = mem_calloc(MEM_TRANSFER, 1, sizeof(*payload));
+    if (!payload) {
+        return NULL;
+    }
+
+    payload->fd = memfd_create("zig-clip-payload", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (payload->fd == -1) {
+        mem_free(MEM_TRANSFER, payload);
+        return NULL;
+    }
+
+    payload->refcount = 1;
+    snprintf(payload->mime_type, sizeof(payload->mime_type), "%s", mime_type);
+    return payload;
+}
+
+struct payload *
+payload_ref(struct payload *payload)
+{
+    payload->refcount++;
+    return payload;
+}
+
+void
+payload_unref(struct payload *payload)
+{
+    if (!payload || --payload->refcount > 0) {
+        return;
+    }
+
+    if (payload->data) {
+        munmap((void *)payload->data, payload->size);
+    }
+    close(payload->fd);
+    mem_account(MEM_TRANSFER, -(int64_t)payload->size);
+    mem_free(MEM_TRANSFER, payload);
+}
+
+// Fallback for inputs splice() refuses, costs one bounce through userspace
+static ssize_t
+copy_from(struct payload *payload, int fd, size_t max)
+{
+    char buffer[16384];
+    size_t want = max < sizeof(buffer) ? max : sizeof(buffer);
+
+    ssize_t n = read(fd, buffer, want);
+    if (n <= 0) {
+        return n;
+    }
+
+    for (ssize_t done = 0; done < n;) {
+        ssize_t w = pwrite(payload->fd, buffer + done, n - done, payload->size + done);
+        if (w == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += w;
+    }
+    return n;
+}
+
+ssize_t
+payload_read_from(struct payload *payload, int fd, size_t max)
+{
+    if (payload->sealed) {
+        errno = EPERM;
+        return -1;
+    }
+
+    // Pipe pages are moved into the memfd without touching userspace
+    loff_t offset = payload->size;
+    ssize_t n = splice(fd, NULL, payload->fd, &offset, max, SPLICE_F_MOVE);
+    if (n == -1 && errno == EINVAL) {
+        n = copy_from(payload, fd, max);
+    }
+
+    if (n > 0) {
+        payload->size += n;
+        mem_account(MEM_TRANSFER, n); // memfd pages
+    }
+    return n;
+}
+
+int
+payload_seal(struct payload *payload)
+{
+    if (payload->sealed) {
+        return 0;
+    }
+
+    if (fcntl(payload->fd, F_ADD_SEALS, PAYLOAD_SEALS) == -1) {
+        return -1;
+    }
+    payload->sealed = true;
+
+    if (payload->size > 0) {
+        void *data = mmap(NULL, payload->size, PROT_READ, MAP_SHARED, payload->fd, 0);
+        if (data == MAP_FAILED) {
+            return -1;
+        }
+        payload->data = data;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * Captured clipboard payloads
+ *
+ * Every capture is written exactly once into an anonymous memfd. When the
+ * transfer completes the memfd is sealed against any further modification
+ * and mapped read-only, so the same bytes can be printed, handed to
+ * subscribers as a file descriptor and mapped by them without a copy.
+ *
+ * Reference counting is not atomic: only the dispatch thread takes and
+ * drops references, pipeline workers just read sealed payloads it keeps
+ * alive for them.
+ */
+
+#ifndef ZIG_CLIP_PAYLOAD_H
+#define ZIG_CLIP_PAYLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "latency.h"
+
+#define PAYLOAD_MIME_MAX 128
+
+struct payload {
+    int refcount;
+    int fd;              // memfd holding the bytes
+    const void *data;    // Read-only mapping, valid once sealed (NULL if empty)
+    size_t size;
+    bool sealed;
+
+    uint64_t seq;        // Capture sequence number
+    uint64_t timestamp_ns; // CLOCK_REALTIME of the selection event
+    char mime_type[PAYLOAD_MIME_MAX];
+
+    // Filled in by the processing pipeline once sealed
+    bool analyzed;
+    bool utf8;           // Bytes are valid UTF-8
+    uint64_t hash;
+
+    uint64_t marks_ns[LATENCY_MARK_COUNT]; // Set only when tracing latency
+};
+
+struct payload *payload_create(const char *mime_type);
+struct payload *payload_ref(struct payload *payload);
+void payload_unref(struct payload *payload);
+
+// Move up to max bytes from fd (normally the read end of an offer pipe)
+// into the payload. Returns the byte count, 0 on EOF or -1 with errno set.
+ssize_t payload_read_from(struct payload *payload, int fd, size_t max);
+
+// Seal the memfd and map it. No more data can be appended afterwards.
+int payload_seal(struct payload *payload);
+
+#endif
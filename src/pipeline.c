@@ -0,0 +1,391 @@
+/**
+ * Post-capture processing pipeline
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/eventfd.h>
+
+#include "build-features.h"
+#include "event-loop.h"
+#include "evtrace.h"
+#include "hash.h"
+#include "mem.h"
+#include "metrics.h"
+#include "output.h"
+#include "payload.h"
+#include "pipeline.h"
+#include "queue.h"
+#include "utf8.h"
+#include "util.h"
+
+#define PIPELINE_CAPACITY 256
+
+struct pipeline_stage {
+    const char *name;
+    void (*run)(struct payload *payload);
+};
+
+static void
+stage_hash(struct payload *payload)
+{
+    payload->hash = hash64(payload->data, payload->size, 0);
+}
+
+static void
+stage_classify(struct payload *payload)
+{
+    payload->utf8 = utf8_valid(payload->data, payload->size);
+    payload->analyzed = true;
+}
+
+// Worker stages in the order they run. One whose result nothing in this
+// build reads has no run function and is skipped: the hash is for
+// duplicate detection and recordings, the UTF-8 check for NDJSON text.
+static const struct pipeline_stage stages[] = {
+    { "hash", ZIGCLIP_FEATURE_HISTORY || ZIGCLIP_FEATURE_RECORDING ? stage_hash : NULL },
+    { "classify", OUTPUT_HAS_NDJSON ? stage_classify : NULL },
+};
+
+#define STAGE_COUNT ARRAY_LENGTH(stages)
+
+struct job {
+    struct payload *payload;
+    bool done;
+    uint64_t submit_ns;
+    uint64_t start_ns;
+    uint64_t stage_end_ns[STAGE_COUNT];
+};
+
+struct stage_stats {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
+struct pipeline {
+    struct event_loop *loop;
+    struct event_source *source;
+    int event_fd;
+    pipeline_done_func_t done;
+    void *data;
+
+    struct queue jobs;    // Dispatch thread -> workers
+    struct queue results; // Workers -> dispatch thread
+    sem_t job_count;
+    bool job_count_ready; // sem_init() succeeded
+    atomic_bool stopping;
+    pthread_t *threads;
+    int worker_count;
+
+    // Jobs by ticket, results are handed out in ticket order
+    struct job slots[PIPELINE_CAPACITY];
+    uint64_t next_ticket;
+    uint64_t next_done;
+
+    // Dispatch thread only
+    struct stage_stats queue_wait;
+    struct stage_stats stage[STAGE_COUNT];
+    struct stage_stats reorder_wait;
+    size_t jobs_depth_peak;
+    size_t results_depth_peak;
+};
+
+static void
+run_stages(struct job *job)
+{
+    evtrace(EVTRACE_STAGES_BEGIN, job->payload, 0, job->payload->size);
+    job->start_ns = clock_ns(CLOCK_MONOTONIC);
+    uint64_t end_ns = job->start_ns;
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        if (stages[i].run) {
+            stages[i].run(job->payload);
+            end_ns = clock_ns(CLOCK_MONOTONIC);
+        }
+        job->stage_end_ns[i] = end_ns;
+    }
+
+    evtrace(EVTRACE_STAGES_END, job->payload, 0, job->payload->hash);
+    metrics_add(METRICS_WORKER_JOBS, 1);
+    metrics_add(METRICS_WORKER_BYTES, job->payload->size);
+    metrics_add(METRICS_WORKER_BUSY_NS, job->stage_end_ns[STAGE_COUNT - 1] - job->start_ns);
+}
+
+static void *
+worker_main(void *data)
+{
+    struct pipeline *pipeline = data;
+
+    if (ZIGCLIP_FEATURE_METRICS)
+        metrics_thread_register();
+    if (ZIGCLIP_FEATURE_EVTRACE)
+        evtrace_thread_register("worker");
+    for (;;) {
+        while (sem_wait(&pipeline->job_count) == -1 && errno == EINTR)
+            ;
+
+        struct job *job = queue_pop(&pipeline->jobs);
+        if (!job) {
+            if (atomic_load(&pipeline->stopping))
+                return NULL;
+            continue;
+        }
+
+        run_stages(job);
+
+        // Sized for every slot, a push can only lose a race, never fail for good
+        while (!queue_push(&pipeline->results, job)) {
+            sched_yield();
+        }
+        uint64_t one = 1;
+        write(pipeline->event_fd, &one, sizeof(one));
+    }
+}
+
+static void
+record(struct stage_stats *stats, uint64_t ns)
+{
+    stats->count++;
+    stats->total_ns += ns;
+    if (ns > stats->max_ns) {
+        stats->max_ns = ns;
+    }
+}
+
+// Hand finished jobs to the callback, oldest first
+static void
+complete_ready(struct pipeline *pipeline)
+{
+    while (pipeline->next_done < pipeline->next_ticket) {
+        struct job *job = &pipeline->slots[pipeline->next_done % PIPELINE_CAPACITY];
+        if (!job->done) {
+            break;
+        }
+
+        uint64_t now = clock_ns(CLOCK_MONOTONIC);
+        uint64_t prev = job->start_ns;
+        record(&pipeline->queue_wait, job->start_ns - job->submit_ns);
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            if (stages[i].run)
+                record(&pipeline->stage[i], job->stage_end_ns[i] - prev);
+            prev = job->stage_end_ns[i];
+        }
+        record(&pipeline->reorder_wait, now - prev);
+
+        struct payload *payload = job->payload;
+        job->payload = NULL;
+        job->done = false;
+        pipeline->next_done++;
+
+        pipeline->done(pipeline->data, payload);
+        payload_unref(payload);
+    }
+}
+
+static void
+handle_results(void *data, int fd, uint32_t mask)
+{
+    struct pipeline *pipeline = data;
+    uint64_t count;
+
+    read(fd, &count, sizeof(count));
+
+    size_t depth = queue_depth(&pipeline->results);
+    if (depth > pipeline->results_depth_peak) {
+        pipeline->results_depth_peak = depth;
+    }
+
+    struct job *job;
+    while ((job = queue_pop(&pipeline->results))) {
+        job->done = true;
+    }
+    complete_ready(pipeline);
+}
+
+static bool
+has_stages(void)
+{
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        if (stages[i].run)
+            return true;
+    }
+    return false;
+}
+
+int
+pipeline_default_workers(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 1 ? cores - 1 : 1;
+}
+
+struct pipeline *
+pipeline_create(struct event_loop *loop, int workers,
+                pipeline_done_func_t done, void *data)
+{
+    struct pipeline *pipeline = mem_calloc(MEM_PIPELINE, 1, sizeof(*pipeline));
+    if (!pipeline) {
+        return NULL;
+    }
+    pipeline->loop = loop;
+    pipeline->done = done;
+    pipeline->data = data;
+    pipeline->event_fd = -1;
+    atomic_init(&pipeline->stopping, false);
+
+    // With every stage compiled out there is nothing to hand a worker
+    if (workers == 0 || !has_stages()) {
+        return pipeline;
+    }
+
+    if (queue_init(&pipeline->jobs, PIPELINE_CAPACITY) == -1 ||
+        queue_init(&pipeline->results, PIPELINE_CAPACITY) == -1 ||
+        sem_init(&pipeline->job_count, 0, 0) == -1) {
+        goto err;
+    }
+    pipeline->job_count_ready = true;
+
+    pipeline->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (pipeline->event_fd == -1) {
+        goto err;
+    }
+    pipeline->source = event_loop_add_fd(loop, pipeline->event_fd, EVENT_LOOP_READABLE,
+                                         handle_results, pipeline);
+    pipeline->threads = mem_calloc(MEM_PIPELINE, workers, sizeof(*pipeline->threads));
+    if (!pipeline->source || !pipeline->threads) {
+        goto err;
+    }
+
+    for (; pipeline->worker_count < workers; pipeline->worker_count++) {
+        if (pthread_create(&pipeline->threads[pipeline->worker_count], NULL,
+                           worker_main, pipeline) != 0) {
+            break;
+        }
+    }
+    if (pipeline->worker_count == 0) {
+        goto err;
+    }
+    return pipeline;
+
+err:
+    pipeline_destroy(pipeline);
+    return NULL;
+}
+
+void
+pipeline_destroy(struct pipeline *pipeline)
+{
+    if (!pipeline) {
+        return;
+    }
+
+    atomic_store(&pipeline->stopping, true);
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        sem_post(&pipeline->job_count);
+    }
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        pthread_join(pipeline->threads[i], NULL);
+    }
+    mem_free(MEM_PIPELINE, pipeline->threads);
+
+    // Work still in flight is dropped
+    for (; pipeline->next_done < pipeline->next_ticket; pipeline->next_done++) {
+        payload_unref(pipeline->slots[pipeline->next_done % PIPELINE_CAPACITY].payload);
+    }
+
+    if (pipeline->source)
+        event_source_remove(pipeline->source);
+    if (pipeline->event_fd != -1)
+        close(pipeline->event_fd);
+    // Creation may have failed part way, undo only what it got to
+    if (pipeline->jobs.cells)
+        queue_finish(&pipeline->jobs);
+    if (pipeline->results.cells)
+        queue_finish(&pipeline->results);
+    if (pipeline->job_count_ready)
+        sem_destroy(&pipeline->job_count);
+    mem_free(MEM_PIPELINE, pipeline);
+}
+
+bool
+pipeline_full(const struct pipeline *pipeline)
+{
+    return pipeline->next_ticket - pipeline->next_done >= PIPELINE_CAPACITY;
+}
+
+int
+pipeline_room(const struct pipeline *pipeline)
+{
+    return PIPELINE_CAPACITY - (int)(pipeline->next_ticket - pipeline->next_done);
+}
+
+int
+pipeline_depth(const struct pipeline *pipeline)
+{
+    return pipeline->next_ticket - pipeline->next_done;
+}
+
+int
+pipeline_submit(struct pipeline *pipeline, struct payload *payload)
+{
+    if (pipeline_full(pipeline)) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    struct job *job = &pipeline->slots[pipeline->next_ticket++ % PIPELINE_CAPACITY];
+    job->payload = payload_ref(payload);
+    job->done = false;
+    job->submit_ns = clock_ns(CLOCK_MONOTONIC);
+
+    if (pipeline->worker_count == 0) {
+        run_stages(job);
+        job->done = true;
+        complete_ready(pipeline);
+        return 0;
+    }
+
+    // Cannot fail, the queue has a cell for every slot
+    queue_push(&pipeline->jobs, job);
+    sem_post(&pipeline->job_count);
+
+    size_t depth = queue_depth(&pipeline->jobs);
+    if (depth > pipeline->jobs_depth_peak) {
+        pipeline->jobs_depth_peak = depth;
+    }
+    return 0;
+}
+
+static void
+print_stage(FILE *out, const char *name, const struct stage_stats *stats)
+{
+    fprintf(out, "  %-12s %8llu runs  avg %9.3f ms  max %9.3f ms\n", name,
+            (unsigned long long)stats->count,
+            stats->count ? stats->total_ns / 1e6 / stats->count : 0.0,
+            stats->max_ns / 1e6);
+}
+
+void
+pipeline_print_stats(struct pipeline *pipeline, FILE *out)
+{
+    fprintf(out, "pipeline: %d workers, %llu in flight\n", pipeline->worker_count,
+            (unsigned long long)(pipeline->next_ticket - pipeline->next_done));
+    if (pipeline->worker_count > 0) {
+        fprintf(out, "  job queue    depth %zu (peak %zu)\n",
+                queue_depth(&pipeline->jobs), pipeline->jobs_depth_peak);
+        fprintf(out, "  result queue depth %zu (peak %zu)\n",
+                queue_depth(&pipeline->results), pipeline->results_depth_peak);
+    }
+    print_stage(out, "queue wait", &pipeline->queue_wait);
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        if (stages[i].run)
+            print_stage(out, stages[i].name, &pipeline->stage[i]);
+    }
+    print_stage(out, "reorder wait", &pipeline->reorder_wait);
+}
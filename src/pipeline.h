@@ -0,0 +1,43 @@
+/**
+ * Post-capture processing pipeline
+ *
+ * The dispatch thread only drains offer pipes. Sealed payloads are pushed
+ * onto a lock-free queue and a pool of worker threads runs the CPU heavy
+ * stages (hashing, classification) on them. Results come back through a
+ * second queue and an eventfd, and are handed to the completion callback
+ * on the dispatch thread in submission order.
+ */
+
+#ifndef ZIG_CLIP_PIPELINE_H
+#define ZIG_CLIP_PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct event_loop;
+struct payload;
+struct pipeline;
+
+// Runs on the dispatch thread once all stages are done with payload
+typedef void (*pipeline_done_func_t)(void *data, struct payload *payload);
+
+// workers == 0 runs the stages inline in pipeline_submit()
+struct pipeline *pipeline_create(struct event_loop *loop, int workers,
+                                 pipeline_done_func_t done, void *data);
+void pipeline_destroy(struct pipeline *pipeline);
+
+// Default pool size: one worker per core, the dispatch thread keeps one
+int pipeline_default_workers(void);
+
+// Process a sealed payload (takes a reference). Fails only when full.
+int pipeline_submit(struct pipeline *pipeline, struct payload *payload);
+bool pipeline_full(const struct pipeline *pipeline);
+// Payloads that can still be submitted before it is full
+int pipeline_room(const struct pipeline *pipeline);
+// Payloads submitted and not yet handed back
+int pipeline_depth(const struct pipeline *pipeline);
+
+void pipeline_print_stats(struct pipeline *pipeline, FILE *out);
+
+#endif
@@ -0,0 +1,122 @@
+//! Wayland interfaces spoken by the native wire client.
+//!
+//! Every interface is a namespace with its requests and events as tagged
+//! unions in protocol XML order, so an opcode is the index of a union
+//! field, and the payload structs list the arguments in wire order. The
+//! argument types (see wire.zig) carry everything the encoder and decoder
+//! need, both are derived from these declarations at comptime.
+
+const wire = @import("wire.zig");
+
+const Object = wire.Object;
+const NewId = wire.NewId;
+const BindId = wire.BindId;
+const Fd = wire.Fd;
+
+pub const Interface = enum {
+    wl_display,
+    wl_registry,
+    wl_callback,
+    wl_seat,
+    zwlr_data_control_manager_v1,
+    zwlr_data_control_device_v1,
+    zwlr_data_control_source_v1,
+    zwlr_data_control_offer_v1,
+};
+
+pub fn Spec(comptime interface: Interface) type {
+    return switch (interface) {
+        .wl_display => WlDisplay,
+        .wl_registry => WlRegistry,
+        .wl_callback => WlCallback,
+        .wl_seat => WlSeat,
+        .zwlr_data_control_manager_v1 => DataControlManager,
+        .zwlr_data_control_device_v1 => DataControlDevice,
+        .zwlr_data_control_source_v1 => DataControlSource,
+        .zwlr_data_control_offer_v1 => DataControlOffer,
+    };
+}
+
+pub const WlDisplay = struct {
+    pub const Request = union(enum) {
+        sync: struct { callback: NewId(.wl_callback) },
+        get_registry: struct { registry: NewId(.wl_registry) },
+    };
+    pub const Event = union(enum) {
+        @"error": struct { object_id: Object, code: u32, message: [:0]const u8 },
+        delete_id: struct { id: u32 },
+    };
+};
+
+pub const WlRegistry = struct {
+    pub const Request = union(enum) {
+        bind: struct { name: u32, id: BindId },
+    };
+    pub const Event = union(enum) {
+        global: struct { name: u32, interface: [:0]const u8, version: u32 },
+        global_remove: struct { name: u32 },
+    };
+};
+
+pub const WlCallback = struct {
+    pub const Request = union(enum) {};
+    pub const Event = union(enum) {
+        done: struct { callback_data: u32 },
+    };
+};
+
+// Version 1, the name event and release request came later
+pub const WlSeat = struct {
+    pub const Request = union(enum) {
+        get_pointer: struct { id: Object },
+        get_keyboard: struct { id: Object },
+        get_touch: struct { id: Object },
+    };
+    pub const Event = union(enum) {
+        capabilities: struct { capabilities: u32 },
+    };
+};
+
+pub const DataControlManager = struct {
+    pub const Request = union(enum) {
+        create_data_source: struct { id: NewId(.zwlr_data_control_source_v1) },
+        get_data_device: struct { id: NewId(.zwlr_data_control_device_v1), seat: Object },
+        destroy: struct {},
+    };
+    pub const Event = union(enum) {};
+};
+
+pub const DataControlDevice = struct {
+    pub const Request = union(enum) {
+        set_selection: struct { source: Object },
+        destroy: struct {},
+        set_primary_selection: struct { source: Object },
+    };
+    pub const Event = union(enum) {
+        data_offer: struct { id: NewId(.zwlr_data_control_offer_v1) },
+        selection: struct { id: Object },
+        finished: struct {},
+        primary_selection: struct { id: Object },
+    };
+};
+
+pub const DataControlSource = struct {
+    pub const Request = union(enum) {
+        offer: struct { mime_type: [:0]const u8 },
+        destroy: struct {},
+    };
+    pub const Event = union(enum) {
+        send: struct { mime_type: [:0]const u8, fd: Fd },
+        cancelled: struct {},
+    };
+};
+
+pub const DataControlOffer = struct {
+    pub const Request = union(enum) {
+        receive: struct { mime_type: [:0]const u8, fd: Fd },
+        destroy: struct {},
+    };
+    pub const Event = union(enum) {
+        offer: struct { mime_type: [:0]const u8 },
+    };
+};
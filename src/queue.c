@@ -0,0 +1,37 @@
+/**
+ * Bounded lock-free multi-producer multi-consumer queue of pointers
+ */
+
+#include <stdlib.h>
+
+#include "mem.h"
+#include "queue.h"
+
+int
+queue_init(struct queue *queue, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    queue->cells = mem_calloc(MEM_PIPELINE, size, sizeof(*queue->cells));
+    if (!queue->cells) {
+        return -1;
+    }
+    queue->mask = size - 1;
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    return 0;
+}
+
+void
+queue_finish(struct queue *queue)
+{
+    mem_free(MEM_PIPELINE, queue->cells);
+    queue->cells = NULL;
+}
@@ -0,0 +1,98 @@
+/**
+ * Bounded lock-free multi-producer multi-consumer queue of pointers
+ *
+ * Dmitry Vyukov's array based design: every cell carries a sequence number
+ * telling producers and consumers whose turn it is, so the only contended
+ * operations are one CAS on the enqueue or dequeue position.
+ */
+
+#ifndef ZIG_CLIP_QUEUE_H
+#define ZIG_CLIP_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util.h"
+
+struct queue_cell {
+    atomic_size_t sequence;
+    void *data;
+};
+
+struct queue {
+    struct queue_cell *cells;
+    size_t mask;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos;
+};
+
+// capacity is rounded up to a power of two
+int queue_init(struct queue *queue, size_t capacity);
+void queue_finish(struct queue *queue);
+
+static inline bool
+queue_push(struct queue *queue, void *data)
+{
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    struct queue_cell *cell;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return false; // Full
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->data = data;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+static inline void *
+queue_pop(struct queue *queue)
+{
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    struct queue_cell *cell;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return NULL; // Empty
+        } else {
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    void *data = cell->data;
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+    return data;
+}
+
+// Approximate number of queued entries
+static inline size_t
+queue_depth(struct queue *queue)
+{
+    size_t tail = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+#endif
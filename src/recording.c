@@ -0,0 +1,401 @@
+/**
+ * Session recordings
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+#include "recording.h"
+#include "util.h"
+
+#define MAX_RECORD_SIZE 64 // Any record but a MIME type definition
+#define MAX_SELECTION_MIMES 256
+
+struct recorder {
+    FILE *file;
+    bool failed;
+    uint64_t last_ns;
+    uint32_t next_selection;
+
+    // Interned MIME types, the index is the id
+    char **mime_types;
+    uint32_t mime_count;
+    uint32_t mime_capacity;
+};
+
+struct recording_reader {
+    char *data;
+    size_t size;
+    size_t offset;
+    uint64_t time_ns;
+
+    char **mime_types;
+    uint32_t mime_count;
+    uint32_t mime_capacity;
+    const char *selection[MAX_SELECTION_MIMES];
+};
+
+static size_t
+put_varint(uint8_t *out, uint64_t value)
+{
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        out[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = value;
+    return n;
+}
+
+static void
+write_bytes(struct recorder *recorder, const void *data, size_t len)
+{
+    if (!recorder->failed && fwrite(data, 1, len, recorder->file) != len) {
+        recorder->failed = true;
+    }
+}
+
+// Type and time delta, the start of every record
+static size_t
+put_head(struct recorder *recorder, uint8_t *out, enum recording_type type)
+{
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    size_t n = 0;
+
+    out[n++] = type;
+    n += put_varint(out + n, now - recorder->last_ns);
+    recorder->last_ns = now;
+    return n;
+}
+
+static bool
+grow_strings(char ***strings, uint32_t *capacity, uint32_t count)
+{
+    if (count < *capacity) {
+        return true;
+    }
+    uint32_t new_capacity = *capacity ? *capacity * 2 : 16;
+    char **grown = mem_realloc(MEM_TELEMETRY, *strings, new_capacity * sizeof(*grown));
+    if (!grown) {
+        return false;
+    }
+    *strings = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Id of a MIME type, defining it in the file the first time around
+static int64_t
+intern(struct recorder *recorder, const char *mime_type)
+{
+    for (uint32_t i = 0; i < recorder->mime_count; i++) {
+        if (strcmp(recorder->mime_types[i], mime_type) == 0) {
+            return i;
+        }
+    }
+
+    char *copy = mem_strdup(MEM_TELEMETRY, mime_type);
+    if (!copy || !grow_strings(&recorder->mime_types, &recorder->mime_capacity,
+                               recorder->mime_count)) {
+        mem_free(MEM_TELEMETRY, copy);
+        return -1;
+    }
+    recorder->mime_types[recorder->mime_count] = copy;
+
+    uint8_t record[MAX_RECORD_SIZE];
+    size_t len = strlen(copy);
+    size_t n = put_head(recorder, record, RECORDING_MIME_TYPE);
+    n += put_varint(record + n, len);
+    write_bytes(recorder, record, n);
+    write_bytes(recorder, copy, len);
+    return recorder->mime_count++;
+}
+
+struct recorder *
+recorder_create(const char *path)
+{
+    struct recorder *recorder = mem_calloc(MEM_TELEMETRY, 1, sizeof(*recorder));
+    if (!recorder) {
+        return NULL;
+    }
+
+    recorder->file = fopen(path, "we");
+    if (!recorder->file) {
+        mem_free(MEM_TELEMETRY, recorder);
+        return NULL;
+    }
+    recorder->last_ns = clock_ns(CLOCK_MONOTONIC);
+    recorder->next_selection = 1;
+
+    struct recording_header header = {
+        .magic = RECORDING_MAGIC,
+        .version = RECORDING_VERSION,
+        .start_ns = clock_ns(CLOCK_REALTIME),
+    };
+    write_bytes(recorder, &header, sizeof(header));
+    return recorder;
+}
+
+void
+recorder_destroy(struct recorder *recorder)
+{
+    if (!recorder) {
+        return;
+    }
+    fclose(recorder->file);
+    for (uint32_t i = 0; i < recorder->mime_count; i++) {
+        mem_free(MEM_TELEMETRY, recorder->mime_types[i]);
+    }
+    mem_free(MEM_TELEMETRY, recorder->mime_types);
+    mem_free(MEM_TELEMETRY, recorder);
+}
+
+uint32_t
+recorder_selection(struct recorder *recorder, char *const *mime_types, int count)
+{
+    uint32_t ids[MAX_SELECTION_MIMES];
+    uint32_t id = recorder->next_selection++;
+    int recorded = 0;
+
+    // Definitions have to come before the record using them
+    for (int i = 0; i < count && recorded < MAX_SELECTION_MIMES; i++) {
+        int64_t mime = intern(recorder, mime_types[i]);
+        if (mime >= 0) {
+            ids[recorded++] = mime;
+        }
+    }
+
+    uint8_t record[MAX_RECORD_SIZE];
+    size_t n = put_head(recorder, record, RECORDING_SELECTION);
+    n += put_varint(record + n, id);
+    n += put_varint(record + n, recorded);
+    write_bytes(recorder, record, n);
+    for (int i = 0; i < recorded; i++) {
+        n = put_varint(record, ids[i]);
+        write_bytes(recorder, record, n);
+    }
+    return id;
+}
+
+void
+recorder_clear(struct recorder *recorder)
+{
+    uint8_t record[MAX_RECORD_SIZE];
+
+    write_bytes(recorder, record, put_head(recorder, record, RECORDING_CLEAR));
+}
+
+void
+recorder_fetch(struct recorder *recorder, uint32_t selection, const char *mime_type,
+               uint64_t seq)
+{
+    int64_t mime = intern(recorder, mime_type);
+    if (mime < 0) {
+        return;
+    }
+
+    uint8_t record[MAX_RECORD_SIZE];
+    size_t n = put_head(recorder, record, RECORDING_FETCH);
+    n += put_varint(record + n, selection);
+    n += put_varint(record + n, mime);
+    n += put_varint(record + n, seq);
+    write_bytes(recorder, record, n);
+}
+
+void
+recorder_payload(struct recorder *recorder, uint64_t seq, uint64_t size, uint64_t hash)
+{
+    uint8_t record[MAX_RECORD_SIZE];
+    size_t n = put_head(recorder, record, RECORDING_PAYLOAD);
+    n += put_varint(record + n, seq);
+    n += put_varint(record + n, size);
+    for (int i = 0; i < 8; i++) {
+        record[n++] = hash >> (i * 8);
+    }
+    write_bytes(recorder, record, n);
+}
+
+void
+recorder_finished(struct recorder *recorder)
+{
+    uint8_t record[MAX_RECORD_SIZE];
+
+    write_bytes(recorder, record, put_head(recorder, record, RECORDING_FINISHED));
+    fflush(recorder->file);
+}
+
+struct recording_reader *
+recording_reader_open(const char *path)
+{
+    struct recording_reader *reader = mem_calloc(MEM_TELEMETRY, 1, sizeof(*reader));
+    FILE *file = fopen(path, "re");
+    struct recording_header header;
+
+    if (!reader || !file) {
+        goto fail;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != RECORDING_MAGIC ||
+        header.version != RECORDING_VERSION) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    // Recordings are small, the whole thing is read up front
+    size_t capacity = 0;
+    for (;;) {
+        if (reader->size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            char *grown = mem_realloc(MEM_TELEMETRY, reader->data, capacity);
+            if (!grown) {
+                goto fail;
+            }
+            reader->data = grown;
+        }
+        size_t n = fread(reader->data + reader->size, 1, capacity - reader->size, file);
+        if (n == 0) {
+            break;
+        }
+        reader->size += n;
+    }
+    if (ferror(file)) {
+        goto fail;
+    }
+    fclose(file);
+    return reader;
+
+fail:
+    if (file) {
+        fclose(file);
+    }
+    recording_reader_close(reader);
+    return NULL;
+}
+
+void
+recording_reader_close(struct recording_reader *reader)
+{
+    if (!reader) {
+        return;
+    }
+    for (uint32_t i = 0; i < reader->mime_count; i++) {
+        mem_free(MEM_TELEMETRY, reader->mime_types[i]);
+    }
+    mem_free(MEM_TELEMETRY, reader->mime_types);
+    mem_free(MEM_TELEMETRY, reader->data);
+    mem_free(MEM_TELEMETRY, reader);
+}
+
+static bool
+get_varint(struct recording_reader *reader, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->offset == reader->size) {
+            return false;
+        }
+        uint8_t byte = reader->data[reader->offset++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+get_mime(struct recording_reader *reader, const char **mime_type)
+{
+    uint64_t id;
+
+    if (!get_varint(reader, &id) || id >= reader->mime_count) {
+        return false;
+    }
+    *mime_type = reader->mime_types[id];
+    return true;
+}
+
+// The payload of a MIME_TYPE record
+static bool
+define_mime(struct recording_reader *reader)
+{
+    uint64_t len;
+
+    if (!get_varint(reader, &len) || len > reader->size - reader->offset ||
+        !grow_strings(&reader->mime_types, &reader->mime_capacity, reader->mime_count)) {
+        return false;
+    }
+    char *copy = mem_strndup(MEM_TELEMETRY, reader->data + reader->offset, len);
+    if (!copy) {
+        return false;
+    }
+    reader->offset += len;
+    reader->mime_types[reader->mime_count++] = copy;
+    return true;
+}
+
+int
+recording_reader_next(struct recording_reader *reader, struct recording_event *event)
+{
+    for (;;) {
+        uint64_t delta, value, count;
+
+        if (reader->offset == reader->size) {
+            return 0;
+        }
+        memset(event, 0, sizeof(*event));
+        event->type = reader->data[reader->offset++];
+        if (!get_varint(reader, &delta)) {
+            return -1;
+        }
+        reader->time_ns += delta;
+        event->time_ns = reader->time_ns;
+
+        switch (event->type) {
+            case RECORDING_MIME_TYPE:
+                if (!define_mime(reader)) {
+                    return -1;
+                }
+                continue;
+            case RECORDING_SELECTION:
+                if (!get_varint(reader, &value) || !get_varint(reader, &count) ||
+                    count > MAX_SELECTION_MIMES) {
+                    return -1;
+                }
+                event->selection = value;
+                for (uint64_t i = 0; i < count; i++) {
+                    if (!get_mime(reader, &reader->selection[i])) {
+                        return -1;
+                    }
+                }
+                event->mime_types = reader->selection;
+                event->mime_count = count;
+                return 1;
+            case RECORDING_FETCH:
+                if (!get_varint(reader, &value) || !get_mime(reader, &event->mime_type) ||
+                    !get_varint(reader, &event->seq)) {
+                    return -1;
+                }
+                event->selection = value;
+                return 1;
+            case RECORDING_PAYLOAD:
+                if (!get_varint(reader, &event->seq) || !get_varint(reader, &event->size) ||
+                    reader->size - reader->offset < 8) {
+                    return -1;
+                }
+                for (int i = 0; i < 8; i++) {
+                    event->hash |= (uint64_t)(uint8_t)reader->data[reader->offset++] << (i * 8);
+                }
+                return 1;
+            case RECORDING_CLEAR:
+            case RECORDING_FINISHED:
+                return 1;
+            default:
+                return -1;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/**
+ * Session recordings
+ *
+ * A compact binary log of the data-control events the monitor saw, for
+ * replaying real clipboard usage against it later (bench/mock-compositor
+ * -p). Payload bytes are never stored, only their size and hash.
+ *
+ * After a fixed header the file is a sequence of records, each a type
+ * byte and the time since the previous record in LEB128 nanoseconds,
+ * followed by LEB128 fields:
+ *
+ *   MIME_TYPE  len, bytes        Interns the next MIME id, from 0
+ *   SELECTION  id, count, ids... A new selection and the MIME ids offered
+ *   CLEAR                        Selection cleared
+ *   FETCH      id, mime, seq     Selection id read as MIME id, capture seq
+ *   PAYLOAD    seq, size, hash   hash as 8 little-endian bytes
+ *   FINISHED                     Data device went away
+ */
+
+#ifndef ZIG_CLIP_RECORDING_H
+#define ZIG_CLIP_RECORDING_H
+
+#include <stdint.h>
+
+#define RECORDING_MAGIC 0x4345525au // "ZREC" little-endian
+#define RECORDING_VERSION 1
+
+struct recording_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t start_ns; // CLOCK_REALTIME the recording began at
+};
+
+enum recording_type {
+    RECORDING_MIME_TYPE = 1,
+    RECORDING_SELECTION,
+    RECORDING_CLEAR,
+    RECORDING_FETCH,
+    RECORDING_PAYLOAD,
+    RECORDING_FINISHED,
+};
+
+struct recorder;
+
+struct recorder *recorder_create(const char *path);
+void recorder_destroy(struct recorder *recorder);
+
+// Returns the id that later fetches of this selection refer to
+uint32_t recorder_selection(struct recorder *recorder, char *const *mime_types, int count);
+void recorder_clear(struct recorder *recorder);
+void recorder_fetch(struct recorder *recorder, uint32_t selection, const char *mime_type,
+                    uint64_t seq);
+void recorder_payload(struct recorder *recorder, uint64_t seq, uint64_t size, uint64_t hash);
+void recorder_finished(struct recorder *recorder);
+
+struct recording_event {
+    enum recording_type type;
+    uint64_t time_ns; // Since the recording began
+    uint32_t selection;
+    const char *const *mime_types; // SELECTION, valid until the next event
+    int mime_count;
+    const char *mime_type;         // FETCH
+    uint64_t seq;                  // FETCH and PAYLOAD
+    uint64_t size;
+    uint64_t hash;
+};
+
+struct recording_reader;
+
+struct recording_reader *recording_reader_open(const char *path);
+void recording_reader_close(struct recording_reader *reader);
+
+// Interned MIME types are handled internally, so it never returns one.
+// Returns 1 with an event, 0 at the end and -1 on a malformed file.
+int recording_reader_next(struct recording_reader *reader, struct recording_event *event);
+
+#endif
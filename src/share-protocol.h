@@ -0,0 +1,61 @@
+/**
+ * Wire format of the payload sharing socket
+ *
+ * Subscribers connect a SOCK_SEQPACKET socket to the path given with -s.
+ * For every captured payload they receive one packet carrying a
+ * struct zc_share_header and, as SCM_RIGHTS ancillary data, a sealed
+ * read-only memfd with the payload bytes. Consumers map it with
+ *
+ *     mmap(NULL, header.size, PROT_READ, MAP_SHARED, fd, 0)
+ *
+ * and close the fd when done. Packets that do not fit into a slow
+ * subscriber's socket buffer are dropped rather than delaying capture.
+ *
+ * In metadata-only mode (-L) selections are not fetched up front. Each one
+ * is announced with a struct zc_share_offer packet, no fd attached,
+ * followed in the same packet by the offered MIME types as mime_size
+ * bytes of NUL terminated strings. A subscriber wanting the bytes sends a
+ * struct zc_share_fetch naming the seq it saw; the payload then arrives
+ * as a regular packet with that seq. Requests for a selection that was
+ * replaced in the meantime are ignored. Readers tell packets apart by
+ * their leading magic.
+ */
+
+#ifndef ZIG_CLIP_SHARE_PROTOCOL_H
+#define ZIG_CLIP_SHARE_PROTOCOL_H
+
+#include <stdint.h>
+
+#define ZC_SHARE_MAGIC 0x50494c43u // "CLIP" little-endian
+#define ZC_SHARE_VERSION 1
+#define ZC_SHARE_OFFER_MAGIC 0x5246464fu // "OFFR" little-endian
+#define ZC_SHARE_FETCH_MAGIC 0x48435446u // "FTCH" little-endian
+#define ZC_SHARE_MIME_MAX 128
+
+struct zc_share_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;          // Capture sequence number, gaps mean drops or empty clips
+    uint64_t timestamp_ns; // CLOCK_REALTIME of the selection change
+    uint64_t size;         // Payload size in bytes
+    char mime_type[ZC_SHARE_MIME_MAX]; // NUL terminated
+};
+
+struct zc_share_offer {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;          // Sequence number the payload will carry if fetched
+    uint64_t timestamp_ns; // CLOCK_REALTIME of the selection change
+    uint32_t mime_count;
+    uint32_t mime_size;    // Bytes of MIME types following the header
+};
+
+// Subscriber to monitor
+struct zc_share_fetch {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;
+    char mime_type[ZC_SHARE_MIME_MAX]; // Empty picks text, else the first type
+};
+
+#endif
@@ -0,0 +1,298 @@
+/**
+ * Payload sharing server over a Unix SOCK_SEQPACKET socket
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "event-loop.h"
+#include "mem.h"
+#include "payload.h"
+#include "share-protocol.h"
+#include "share.h"
+
+// MIME types listed per announcement, sources rarely offer more than a dozen
+#define SHARE_OFFER_MIME_MAX 64
+
+struct share_client {
+    struct share *share;
+    int fd;
+    struct event_source *source;
+};
+
+struct share {
+    struct event_loop *loop;
+    int listen_fd;
+    struct event_source *listen_source;
+    char *path;
+
+    struct share_client **clients;
+    int client_count;
+    int client_capacity;
+
+    uint64_t dropped;
+
+    share_fetch_func_t fetch;
+    void *fetch_data;
+};
+
+static void
+client_destroy(struct share_client *client)
+{
+    struct share *share = client->share;
+
+    for (int i = 0; i < share->client_count; i++) {
+        if (share->clients[i] == client) {
+            share->clients[i] = share->clients[--share->client_count];
+            break;
+        }
+    }
+
+    event_source_remove(client->source);
+    close(client->fd);
+    mem_free(MEM_SHARE, client);
+}
+
+static void
+handle_client_event(void *data, int fd, uint32_t mask)
+{
+    struct share_client *client = data;
+    struct share *share = client->share;
+    struct zc_share_fetch request;
+
+    if (mask & (EVENT_LOOP_HANGUP | EVENT_LOOP_ERROR)) {
+        client_destroy(client);
+        return;
+    }
+
+    // Fetch requests are all a subscriber may say, anything else is noise
+    ssize_t n = recv(fd, &request, sizeof(request), MSG_DONTWAIT);
+    if (n == 0) {
+        client_destroy(client);
+    } else if (n == sizeof(request) && request.magic == ZC_SHARE_FETCH_MAGIC &&
+               request.version == ZC_SHARE_VERSION && share->fetch) {
+        request.mime_type[sizeof(request.mime_type) - 1] = '\0';
+        share->fetch(share->fetch_data, request.seq, request.mime_type);
+    }
+}
+
+static void
+handle_listen_event(void *data, int fd, uint32_t mask)
+{
+    struct share *share = data;
+
+    for (;;) {
+        int client_fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (client_fd == -1) {
+            return; // EAGAIN once the backlog is empty
+        }
+
+        if (share->client_count == share->client_capacity) {
+            int capacity = share->client_capacity ? share->client_capacity * 2 : 8;
+            struct share_client **clients =
+                mem_realloc(MEM_SHARE, share->clients, capacity * sizeof(*clients));
+            if (!clients) {
+                close(client_fd);
+                continue;
+            }
+            share->clients = clients;
+            share->client_capacity = capacity;
+        }
+
+        struct share_client *client = mem_calloc(MEM_SHARE, 1, sizeof(*client));
+        if (!client) {
+            close(client_fd);
+            continue;
+        }
+        client->share = share;
+        client->fd = client_fd;
+        client->source = event_loop_add_fd(share->loop, client_fd, EVENT_LOOP_READABLE,
+                                           handle_client_event, client);
+        if (!client->source) {
+            close(client_fd);
+            mem_free(MEM_SHARE, client);
+            continue;
+        }
+        share->clients[share->client_count++] = client;
+    }
+}
+
+struct share *
+share_create(struct event_loop *loop, const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+
+    struct share *share = mem_calloc(MEM_SHARE, 1, sizeof(*share));
+    if (!share) {
+        return NULL;
+    }
+    share->loop = loop;
+    share->path = mem_strdup(MEM_SHARE, path);
+
+    share->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (share->listen_fd == -1) {
+        goto err;
+    }
+
+    // Replace a stale socket left behind by a previous run, nothing else
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    mode_t old_umask = umask(0077);
+    int ret = bind(share->listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+    if (ret == -1 || listen(share->listen_fd, 16) == -1) {
+        goto err_close;
+    }
+
+    share->listen_source = event_loop_add_fd(loop, share->listen_fd, EVENT_LOOP_READABLE,
+                                             handle_listen_event, share);
+    if (!share->listen_source) {
+        goto err_unlink;
+    }
+
+    return share;
+
+err_unlink:
+    unlink(path);
+err_close:
+    close(share->listen_fd);
+err:
+    mem_free(MEM_SHARE, share->path);
+    mem_free(MEM_SHARE, share);
+    return NULL;
+}
+
+void
+share_destroy(struct share *share)
+{
+    if (!share) {
+        return;
+    }
+
+    while (share->client_count > 0) {
+        client_destroy(share->clients[0]);
+    }
+    mem_free(MEM_SHARE, share->clients);
+
+    event_source_remove(share->listen_source);
+    close(share->listen_fd);
+    unlink(share->path);
+    mem_free(MEM_SHARE, share->path);
+    mem_free(MEM_SHARE, share);
+}
+
+static void
+send_all(struct share *share, const struct msghdr *msg)
+{
+    // Walk backwards so dropping a client does not skip the one moved into its slot
+    for (int i = share->client_count - 1; i >= 0; i--) {
+        struct share_client *client = share->clients[i];
+        if (sendmsg(client->fd, msg, MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                share->dropped++;
+            } else {
+                client_destroy(client);
+            }
+        }
+    }
+}
+
+void
+share_broadcast(struct share *share, const struct payload *payload)
+{
+    if (share->client_count == 0 || !payload->sealed) {
+        return;
+    }
+
+    struct zc_share_header header = {
+        .magic = ZC_SHARE_MAGIC,
+        .version = ZC_SHARE_VERSION,
+        .seq = payload->seq,
+        .timestamp_ns = payload->timestamp_ns,
+        .size = payload->size,
+    };
+    snprintf(header.mime_type, sizeof(header.mime_type), "%s", payload->mime_type);
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &payload->fd, sizeof(int));
+
+    send_all(share, &msg);
+}
+
+void
+share_broadcast_offer(struct share *share, uint64_t seq, uint64_t timestamp_ns,
+                      char *const *mime_types, int mime_count)
+{
+    if (share->client_count == 0) {
+        return;
+    }
+
+    struct zc_share_offer header = {
+        .magic = ZC_SHARE_OFFER_MAGIC,
+        .version = ZC_SHARE_VERSION,
+        .seq = seq,
+        .timestamp_ns = timestamp_ns,
+        .mime_count = mime_count,
+    };
+    struct iovec iov[1 + SHARE_OFFER_MIME_MAX];
+    int count = 0;
+
+    iov[count++] = (struct iovec){ &header, sizeof(header) };
+    for (int i = 0; i < mime_count && i < SHARE_OFFER_MIME_MAX; i++) {
+        size_t len = strlen(mime_types[i]) + 1;
+        iov[count++] = (struct iovec){ mime_types[i], len };
+        header.mime_size += len;
+    }
+    header.mime_count = count - 1;
+
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = count };
+    send_all(share, &msg);
+}
+
+void
+share_set_fetch_handler(struct share *share, share_fetch_func_t func, void *data)
+{
+    share->fetch = func;
+    share->fetch_data = data;
+}
+
+int
+share_subscriber_count(const struct share *share)
+{
+    return share->client_count;
+}
+
+uint64_t
+share_dropped_count(const struct share *share)
+{
+    return share->dropped;
+}
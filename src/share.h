@@ -0,0 +1,35 @@
+/**
+ * Payload sharing server
+ *
+ * Hands every captured payload to connected subscribers as a sealed memfd,
+ * see share-protocol.h for the wire format. Subscribers may also ask for
+ * a selection announced in metadata-only mode.
+ */
+
+#ifndef ZIG_CLIP_SHARE_H
+#define ZIG_CLIP_SHARE_H
+
+#include <stdint.h>
+
+struct event_loop;
+struct payload;
+struct share;
+
+// A subscriber asked for announced selection seq, mime_type may be empty
+typedef void (*share_fetch_func_t)(void *data, uint64_t seq, const char *mime_type);
+
+struct share *share_create(struct event_loop *loop, const char *path);
+void share_destroy(struct share *share);
+
+// Send the sealed payload to every subscriber without blocking
+void share_broadcast(struct share *share, const struct payload *payload);
+
+// Announce a selection that was not fetched
+void share_broadcast_offer(struct share *share, uint64_t seq, uint64_t timestamp_ns,
+                           char *const *mime_types, int mime_count);
+void share_set_fetch_handler(struct share *share, share_fetch_func_t func, void *data);
+
+int share_subscriber_count(const struct share *share);
+uint64_t share_dropped_count(const struct share *share);
+
+#endif
@@ -0,0 +1,366 @@
+/**
+ * Non-blocking output sink with bounded memory and disk spill
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "event-loop.h"
+#include "mem.h"
+#include "sink.h"
+
+static void sink_drain(struct sink *sink);
+
+static void
+drop_backlog(struct sink *sink)
+{
+    sink->error = true;
+    sink->stats.queued_bytes = 0;
+    sink->stats.spill_pending = 0;
+}
+
+static void
+handle_sink_event(void *data, int fd, uint32_t mask)
+{
+    struct sink *sink = data;
+
+    // The reading end went away, stop watching or epoll keeps reporting it
+    if (mask & (EVENT_LOOP_HANGUP | EVENT_LOOP_ERROR)) {
+        drop_backlog(sink);
+        event_source_remove(sink->source);
+        sink->source = NULL;
+        return;
+    }
+    sink_drain(sink);
+}
+
+static void
+want_writable(struct sink *sink, bool want)
+{
+    if (sink->source && sink->want_writable != want) {
+        event_source_update(sink->source, want ? EVENT_LOOP_WRITABLE : 0);
+        sink->want_writable = want;
+    }
+}
+
+// Non-blocking writes that leave the fd's open file description as it is
+static void
+open_nonblocking(struct sink *sink)
+{
+    struct stat st;
+    if (fstat(sink->fd, &st) == -1) {
+        return;
+    }
+
+    if (S_ISSOCK(st.st_mode)) {
+        sink->socket = true;
+        sink->send_flags = MSG_DONTWAIT;
+    } else if (S_ISFIFO(st.st_mode)) {
+        // Opening the pipe again gives a description only we use. Without
+        // /proc, or with the reader already gone, writes simply block.
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", sink->fd);
+        int fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd != -1) {
+            sink->write_fd = fd;
+        }
+    }
+}
+
+int
+sink_init(struct sink *sink, struct event_loop *loop, int fd, size_t queue_limit)
+{
+    memset(sink, 0, sizeof(*sink));
+    sink->fd = fd;
+    sink->write_fd = fd;
+    sink->ring_size = queue_limit > 0 ? queue_limit : 1;
+    sink->spill_fd = -1;
+
+    open_nonblocking(sink);
+
+    // Regular files cannot be polled, but they never push back either
+    sink->source = event_loop_add_fd(loop, sink->write_fd, 0, handle_sink_event, sink);
+    if (!sink->source && errno != EPERM) {
+        if (sink->write_fd != fd)
+            close(sink->write_fd);
+        return -1;
+    }
+    return 0;
+}
+
+void
+sink_finish(struct sink *sink)
+{
+    // Hand whatever is left to the consumer, blocking is fine now
+    if (sink->write_fd != sink->fd) {
+        fcntl(sink->write_fd, F_SETFL, fcntl(sink->write_fd, F_GETFL) & ~O_NONBLOCK);
+    }
+    sink->send_flags = 0;
+    sink_drain(sink);
+
+    if (sink->source)
+        event_source_remove(sink->source);
+    if (sink->write_fd != sink->fd)
+        close(sink->write_fd);
+    if (sink->spill_fd != -1)
+        close(sink->spill_fd);
+    mem_free(MEM_OUTPUT, sink->ring);
+    sink->ring = NULL;
+}
+
+static int
+open_spill(struct sink *sink)
+{
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !*dir) {
+        dir = "/var/tmp";
+    }
+
+    sink->spill_fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (sink->spill_fd == -1) {
+        char path[] = "/tmp/zig-clip-spill-XXXXXX";
+        sink->spill_fd = mkostemp(path, O_CLOEXEC);
+        if (sink->spill_fd == -1) {
+            return -1;
+        }
+        unlink(path);
+    }
+    return 0;
+}
+
+static int
+spill(struct sink *sink, const struct iovec *iov, int count)
+{
+    if (sink->spill_fd == -1 && open_spill(sink) == -1) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const char *base = iov[i].iov_base;
+        size_t done = 0;
+        while (done < iov[i].iov_len) {
+            ssize_t n = pwrite(sink->spill_fd, base + done, iov[i].iov_len - done,
+                               sink->spill_write);
+            if (n == -1) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            done += n;
+            sink->spill_write += n;
+            sink->stats.spill_pending += n;
+            sink->stats.spilled_total += n;
+        }
+    }
+    return 0;
+}
+
+static void
+ring_push(struct sink *sink, const char *data, size_t len)
+{
+    size_t tail = (sink->ring_head + sink->stats.queued_bytes) % sink->ring_size;
+    size_t first = sink->ring_size - tail < len ? sink->ring_size - tail : len;
+
+    memcpy(sink->ring + tail, data, first);
+    memcpy(sink->ring, data + first, len - first);
+    sink->stats.queued_bytes += len;
+    if (sink->stats.queued_bytes > sink->stats.queued_peak) {
+        sink->stats.queued_peak = sink->stats.queued_bytes;
+    }
+}
+
+// Keep the tail of the vector the consumer did not take, in order
+static int
+enqueue(struct sink *sink, const struct iovec *iov, int count)
+{
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+
+    // Once anything is spilled, later data must queue up behind it
+    if (sink->stats.spill_pending > 0 ||
+        sink->stats.queued_bytes + total > sink->ring_size) {
+        return spill(sink, iov, count);
+    }
+
+    if (!sink->ring) {
+        sink->ring = mem_alloc(MEM_OUTPUT, sink->ring_size);
+        if (!sink->ring) {
+            return spill(sink, iov, count);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        ring_push(sink, iov[i].iov_base, iov[i].iov_len);
+    }
+    return 0;
+}
+
+static ssize_t
+write_vec(struct sink *sink, const struct iovec *iov, int count)
+{
+    if (sink->socket) {
+        struct msghdr msg = { .msg_iov = (struct iovec *)iov, .msg_iovlen = count };
+        return sendmsg(sink->write_fd, &msg, sink->send_flags | MSG_NOSIGNAL);
+    }
+    return writev(sink->write_fd, iov, count);
+}
+
+static ssize_t
+write_ring(struct sink *sink)
+{
+    size_t first = sink->ring_size - sink->ring_head;
+    if (first > sink->stats.queued_bytes) {
+        first = sink->stats.queued_bytes;
+    }
+    struct iovec iov[] = {
+        { sink->ring + sink->ring_head, first },
+        { sink->ring, sink->stats.queued_bytes - first },
+    };
+
+    ssize_t n = write_vec(sink, iov, iov[1].iov_len ? 2 : 1);
+    if (n > 0) {
+        sink->ring_head = (sink->ring_head + n) % sink->ring_size;
+        sink->stats.queued_bytes -= n;
+        sink->stats.written += n;
+    }
+    return n;
+}
+
+// Move spilled data back into the ring for consumers sendfile() cannot reach
+static ssize_t
+refill_ring(struct sink *sink)
+{
+    if (!sink->ring && !(sink->ring = mem_alloc(MEM_OUTPUT, sink->ring_size))) {
+        return -1;
+    }
+
+    size_t want = sink->stats.spill_pending < sink->ring_size ?
+                  sink->stats.spill_pending : sink->ring_size;
+
+    ssize_t n = pread(sink->spill_fd, sink->ring, want, sink->spill_read);
+    if (n > 0) {
+        sink->ring_head = 0;
+        sink->stats.queued_bytes = n;
+        sink->spill_read += n;
+        sink->stats.spill_pending -= n;
+    }
+    return n;
+}
+
+static void
+sink_drain(struct sink *sink)
+{
+    uint64_t written = sink->stats.written;
+
+    while (sink_backlogged(sink)) {
+        ssize_t n;
+        if (sink->stats.queued_bytes > 0) {
+            n = write_ring(sink);
+        } else if (sink->socket) {
+            // sendfile() has no MSG_DONTWAIT, it would block on the socket
+            n = refill_ring(sink);
+        } else {
+            n = sendfile(sink->write_fd, sink->spill_fd, &sink->spill_read,
+                         sink->stats.spill_pending);
+            if (n > 0) {
+                sink->stats.spill_pending -= n;
+                sink->stats.written += n;
+            } else if (n == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                n = refill_ring(sink);
+            }
+        }
+
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                want_writable(sink, true);
+                goto out;
+            }
+            // Consumer is gone, nothing we queue will ever be read
+            drop_backlog(sink);
+            break;
+        }
+    }
+
+    // Give the disk back once the spill segment is fully drained
+    if (sink->spill_fd != -1 && sink->spill_write > 0 && sink->stats.spill_pending == 0) {
+        ftruncate(sink->spill_fd, 0);
+        sink->spill_read = 0;
+        sink->spill_write = 0;
+    }
+    want_writable(sink, false);
+
+out:
+    if (sink->progress && sink->stats.written != written) {
+        sink->progress(sink->progress_data);
+    }
+}
+
+int
+sink_writev(struct sink *sink, const struct iovec *iov, int count)
+{
+    if (sink->error) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        sink->stats.accepted += iov[i].iov_len;
+    }
+    if (sink_backlogged(sink)) {
+        return enqueue(sink, iov, count);
+    }
+
+    ssize_t n;
+    do {
+        n = write_vec(sink, iov, count);
+    } while (n == -1 && errno == EINTR);
+
+    if (n == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+        n = 0;
+    }
+    sink->stats.written += n;
+
+    // Skip what went out and queue the rest
+    while (count > 0 && (size_t)n >= iov->iov_len) {
+        n -= iov->iov_len;
+        iov++;
+        count--;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    sink->stats.stalls++;
+    struct iovec rest[count];
+    memcpy(rest, iov, count * sizeof(*iov));
+    rest[0].iov_base = (char *)rest[0].iov_base + n;
+    rest[0].iov_len -= n;
+
+    if (enqueue(sink, rest, count) == -1) {
+        return -1;
+    }
+    want_writable(sink, true);
+    return 0;
+}
+
+void
+sink_set_progress_func(struct sink *sink, void (*func)(void *data), void *data)
+{
+    sink->progress = func;
+    sink->progress_data = data;
+}
@@ -0,0 +1,80 @@
+/**
+ * Non-blocking output sink
+ *
+ * Whatever reads our stdout may stall. Writes never block the event loop:
+ * data the consumer cannot take right away goes to a bounded in-memory
+ * ring, and once that is full to an unlinked spill file. Both drain in
+ * order when the fd becomes writable again.
+ *
+ * The fd's own flags are left alone: stdout shares its open file
+ * description with stderr on a terminal and with whoever else holds the
+ * pipe, so O_NONBLOCK on it would reach them too. Pipes are reopened
+ * through /proc/self/fd into a description of our own, sockets get
+ * MSG_DONTWAIT per send, and anything else, a terminal or a file, is
+ * written blocking.
+ */
+
+#ifndef ZIG_CLIP_SINK_H
+#define ZIG_CLIP_SINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct event_loop;
+struct event_source;
+
+struct sink_stats {
+    size_t queued_bytes;     // Bytes waiting in the memory ring
+    size_t queued_peak;
+    uint64_t spill_pending;  // Bytes in the spill file not yet written out
+    uint64_t spilled_total;  // Bytes that ever went through the spill file
+    uint64_t stalls;         // Writes that found the consumer not ready
+    uint64_t accepted;       // Bytes ever handed to sink_writev()
+    uint64_t written;        // Bytes of those the consumer got
+};
+
+struct sink {
+    int fd;                  // As passed to sink_init(), left as it was
+    int write_fd;            // fd, or our non-blocking reopen of a pipe
+    int send_flags;          // MSG_DONTWAIT while a socket fd must not block
+    bool socket;
+    struct event_source *source; // NULL for fds epoll cannot watch
+    bool want_writable;
+
+    // Memory ring, allocated on the first stall
+    char *ring;
+    size_t ring_size;
+    size_t ring_head;
+
+    // Spill segment, created on the first overflow
+    int spill_fd;
+    off_t spill_read;
+    off_t spill_write;
+    bool error;
+
+    // Called when queued bytes went out
+    void (*progress)(void *data);
+    void *progress_data;
+
+    struct sink_stats stats;
+};
+
+int sink_init(struct sink *sink, struct event_loop *loop, int fd, size_t queue_limit);
+void sink_finish(struct sink *sink);
+
+// Queue the vector for output. Never blocks; returns -1 only when the
+// consumer is gone or the spill file cannot be written.
+int sink_writev(struct sink *sink, const struct iovec *iov, int count);
+
+void sink_set_progress_func(struct sink *sink, void (*func)(void *data), void *data);
+
+static inline bool
+sink_backlogged(const struct sink *sink)
+{
+    return sink->stats.queued_bytes > 0 || sink->stats.spill_pending > 0;
+}
+
+#endif
@@ -0,0 +1,235 @@
+/**
+ * Hierarchical timer wheel
+ */
+
+#include <string.h>
+
+#include "event-loop.h"
+#include "timer-wheel.h"
+#include "util.h"
+
+#define ROOT_MASK (TIMER_WHEEL_ROOT_SIZE - 1)
+#define LEVEL_MASK (TIMER_WHEEL_LEVEL_SIZE - 1)
+#define LEVEL_SHIFT(l) (TIMER_WHEEL_ROOT_BITS + (l) * TIMER_WHEEL_LEVEL_BITS)
+#define MAX_DELTA ((1ull << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+
+static void
+link_timer(struct wheel_timer **slot, struct wheel_timer *timer)
+{
+    timer->next = *slot;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+static void
+unlink_timer(struct wheel_timer *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+static void
+place(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+    if (timer->expires < wheel->current) {
+        // Overdue, runs with the next tick
+        timer->expires = wheel->current;
+    } else if (timer->expires - wheel->current > MAX_DELTA) {
+        timer->expires = wheel->current + MAX_DELTA;
+    }
+
+    uint64_t delta = timer->expires - wheel->current;
+    if (delta < TIMER_WHEEL_ROOT_SIZE) {
+        link_timer(&wheel->root[timer->expires & ROOT_MASK], timer);
+        return;
+    }
+    for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        if (delta < 1ull << LEVEL_SHIFT(l + 1)) {
+            int index = (timer->expires >> LEVEL_SHIFT(l)) & LEVEL_MASK;
+            link_timer(&wheel->levels[l][index], timer);
+            return;
+        }
+    }
+}
+
+// Move one coarse slot down now that its range is within reach
+static void
+cascade(struct timer_wheel *wheel, int level, int index)
+{
+    struct wheel_timer *list = wheel->levels[level][index];
+
+    wheel->levels[level][index] = NULL;
+    while (list) {
+        struct wheel_timer *timer = list;
+        list = timer->next;
+        place(wheel, timer);
+    }
+}
+
+static void
+run_tick(struct timer_wheel *wheel)
+{
+    int index = wheel->current & ROOT_MASK;
+
+    if (index == 0) {
+        for (int l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+            int level_index = (wheel->current >> LEVEL_SHIFT(l)) & LEVEL_MASK;
+            cascade(wheel, l, level_index);
+            if (level_index != 0) {
+                break;
+            }
+        }
+    }
+
+    // Detach the slot so callbacks can add or cancel timers freely
+    struct wheel_timer *expired = wheel->root[index];
+    wheel->root[index] = NULL;
+    if (expired) {
+        expired->pprev = &expired;
+    }
+    wheel->current++;
+
+    while (expired) {
+        struct wheel_timer *timer = expired;
+        unlink_timer(timer);
+        wheel->count--;
+        timer->func(timer->data);
+    }
+}
+
+// The next tick with work: a filled root slot or the next cascade
+static uint64_t
+next_tick(struct timer_wheel *wheel)
+{
+    if (wheel->count == 0) {
+        return UINT64_MAX;
+    }
+
+    if ((wheel->current & ROOT_MASK) == 0) {
+        return wheel->current; // Cascade still due
+    }
+
+    uint64_t boundary = (wheel->current | ROOT_MASK) + 1;
+    for (uint64_t tick = wheel->current; tick < boundary; tick++) {
+        if (wheel->root[tick & ROOT_MASK]) {
+            return tick;
+        }
+    }
+    return boundary;
+}
+
+static uint64_t
+now_tick(struct timer_wheel *wheel, uint64_t now)
+{
+    return (now - wheel->base_ns) / wheel->tick_ns;
+}
+
+static void
+arm(struct timer_wheel *wheel, uint64_t now)
+{
+    uint64_t next = next_tick(wheel);
+
+    if (next == wheel->armed) {
+        return;
+    }
+    wheel->armed = next;
+    if (next == UINT64_MAX) {
+        event_source_timer_update(wheel->timer, 0);
+        return;
+    }
+
+    uint64_t when = wheel->base_ns + next * wheel->tick_ns;
+    event_source_timer_update(wheel->timer, when > now ? when - now : 1);
+}
+
+static void
+handle_timer(void *data)
+{
+    struct timer_wheel *wheel = data;
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    uint64_t due = now_tick(wheel, now);
+
+    wheel->armed = UINT64_MAX;
+    for (;;) {
+        // Skipping empty ticks keeps a long stall from costing one step per tick
+        uint64_t next = next_tick(wheel);
+        if (next > due) {
+            break;
+        }
+        wheel->current = next;
+        run_tick(wheel);
+    }
+    arm(wheel, now);
+}
+
+int
+timer_wheel_init(struct timer_wheel *wheel, struct event_loop *loop, uint64_t tick_ns)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->tick_ns = tick_ns;
+    wheel->base_ns = clock_ns(CLOCK_MONOTONIC);
+    wheel->armed = UINT64_MAX;
+
+    wheel->timer = event_loop_add_timer(loop, handle_timer, wheel);
+    if (!wheel->timer) {
+        return -1;
+    }
+    return 0;
+}
+
+void
+timer_wheel_finish(struct timer_wheel *wheel)
+{
+    if (wheel->timer) {
+        event_source_remove(wheel->timer);
+        wheel->timer = NULL;
+    }
+}
+
+void
+wheel_timer_init(struct wheel_timer *timer, void (*func)(void *data), void *data)
+{
+    memset(timer, 0, sizeof(*timer));
+    timer->func = func;
+    timer->data = data;
+}
+
+void
+timer_wheel_add(struct timer_wheel *wheel, struct wheel_timer *timer, uint64_t delay_ns)
+{
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+
+    if (wheel_timer_pending(timer)) {
+        timer_wheel_cancel(wheel, timer);
+    }
+    if (wheel->count == 0) {
+        // Nothing to run in between, catch up without walking the ticks
+        wheel->current = now_tick(wheel, now);
+    }
+
+    // Round up so a timer never fires early
+    timer->expires = (now - wheel->base_ns + delay_ns + wheel->tick_ns - 1) / wheel->tick_ns;
+    place(wheel, timer);
+    wheel->count++;
+
+    if (timer->expires < wheel->armed) {
+        arm(wheel, now);
+    }
+}
+
+void
+timer_wheel_cancel(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+    if (!wheel_timer_pending(timer)) {
+        return;
+    }
+    unlink_timer(timer);
+    wheel->count--;
+}
@@ -0,0 +1,61 @@
+/**
+ * Hierarchical timer wheel
+ *
+ * Many cheap deadlines on top of a single event loop timer. Timers are
+ * intrusive, so adding, cancelling and expiring one is O(1); far away
+ * deadlines sit in coarser levels and cascade down as time approaches.
+ * Expiry is rounded up to the wheel's tick.
+ */
+
+#ifndef ZIG_CLIP_TIMER_WHEEL_H
+#define ZIG_CLIP_TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_ROOT_BITS 8
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_LEVELS 3 // Above the root level
+
+#define TIMER_WHEEL_ROOT_SIZE (1 << TIMER_WHEEL_ROOT_BITS)
+#define TIMER_WHEEL_LEVEL_SIZE (1 << TIMER_WHEEL_LEVEL_BITS)
+
+struct event_loop;
+struct event_source;
+
+struct wheel_timer {
+    struct wheel_timer *next;
+    struct wheel_timer **pprev; // NULL while not pending
+    uint64_t expires;           // In ticks
+    void (*func)(void *data);
+    void *data;
+};
+
+struct timer_wheel {
+    uint64_t tick_ns;
+    uint64_t base_ns; // CLOCK_MONOTONIC at tick 0
+    uint64_t current; // Next tick to run
+    uint64_t armed;   // Tick the loop timer is set for, UINT64_MAX if idle
+    int count;
+
+    struct event_source *timer;
+    struct wheel_timer *root[TIMER_WHEEL_ROOT_SIZE];
+    struct wheel_timer *levels[TIMER_WHEEL_LEVELS][TIMER_WHEEL_LEVEL_SIZE];
+};
+
+int timer_wheel_init(struct timer_wheel *wheel, struct event_loop *loop, uint64_t tick_ns);
+void timer_wheel_finish(struct timer_wheel *wheel);
+
+void wheel_timer_init(struct wheel_timer *timer, void (*func)(void *data), void *data);
+
+// (Re)arm a timer to fire delay_ns from now
+void timer_wheel_add(struct timer_wheel *wheel, struct wheel_timer *timer, uint64_t delay_ns);
+void timer_wheel_cancel(struct timer_wheel *wheel, struct wheel_timer *timer);
+
+static inline bool
+wheel_timer_pending(const struct wheel_timer *timer)
+{
+    return timer->pprev != NULL;
+}
+
+#endif
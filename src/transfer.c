@@ -0,0 +1,322 @@
+/**
+ * Asynchronous offer pipe transfers
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "build-features.h"
+#include "event-loop.h"
+#include "mem.h"
+#include "payload.h"
+#include "transfer.h"
+#include "util.h"
+
+// Bytes a transfer may move per turn before the next one is served. Text
+// is small and waited for; the rest moves about a pipe buffer per turn.
+static const size_t class_budget[TRANSFER_CLASS_COUNT] = {
+    [TRANSFER_CLASS_TEXT] = 1 << 20,
+    [TRANSFER_CLASS_RICH_TEXT] = 256 << 10,
+    [TRANSFER_CLASS_IMAGE] = 64 << 10,
+    [TRANSFER_CLASS_OTHER] = 64 << 10,
+};
+
+static const char *class_names[TRANSFER_CLASS_COUNT] = {
+    [TRANSFER_CLASS_TEXT] = "text",
+    [TRANSFER_CLASS_RICH_TEXT] = "rich-text",
+    [TRANSFER_CLASS_IMAGE] = "image",
+    [TRANSFER_CLASS_OTHER] = "other",
+};
+
+static const char *limit_names[TRANSFER_LIMIT_COUNT] = {
+    [TRANSFER_LIMIT_NONE] = "none",
+    [TRANSFER_LIMIT_FIRST_BYTE] = "first-byte",
+    [TRANSFER_LIMIT_TOTAL] = "total",
+    [TRANSFER_LIMIT_SIZE] = "size",
+};
+
+const char *
+transfer_limit_name(enum transfer_limit limit)
+{
+    return limit_names[limit];
+}
+
+const char *
+transfer_class_name(enum transfer_class class)
+{
+    return class_names[class];
+}
+
+enum transfer_class
+transfer_class_for_mime(const char *mime_type)
+{
+    static const char *rich_text[] = {
+        "text/html", "text/rtf", "text/richtext", "application/rtf", "application/x-rtf",
+    };
+
+    for (size_t i = 0; i < ARRAY_LENGTH(rich_text); i++) {
+        size_t len = strlen(rich_text[i]);
+        if (strncmp(mime_type, rich_text[i], len) == 0 &&
+            (mime_type[len] == '\0' || mime_type[len] == ';')) {
+            return TRANSFER_CLASS_RICH_TEXT;
+        }
+    }
+    if (strncmp(mime_type, "text/", 5) == 0 || strcmp(mime_type, "UTF8_STRING") == 0 ||
+        strcmp(mime_type, "STRING") == 0 || strcmp(mime_type, "TEXT") == 0) {
+        return TRANSFER_CLASS_TEXT;
+    }
+    if (strncmp(mime_type, "image/", 6) == 0) {
+        return TRANSFER_CLASS_IMAGE;
+    }
+    return TRANSFER_CLASS_OTHER;
+}
+
+// Served before b: higher class, then the newer selection
+static bool
+serves_before(const struct transfer *a, const struct transfer *b)
+{
+    if (a->class != b->class) {
+        return a->class < b->class;
+    }
+    return a->payload->seq > b->payload->seq;
+}
+
+static void
+mark_ready(struct transfer *transfer)
+{
+    struct transfer **link = &transfer->manager->ready;
+
+    if (transfer->ready) {
+        return;
+    }
+    while (*link && !serves_before(transfer, *link)) {
+        link = &(*link)->next_ready;
+    }
+    transfer->next_ready = *link;
+    *link = transfer;
+    transfer->ready = true;
+}
+
+static void
+unmark_ready(struct transfer *transfer)
+{
+    struct transfer **link = &transfer->manager->ready;
+
+    if (!transfer->ready) {
+        return;
+    }
+    while (*link != transfer) {
+        link = &(*link)->next_ready;
+    }
+    *link = transfer->next_ready;
+    transfer->ready = false;
+}
+
+// Builds without deadlines never touch the wheel, nor link it
+static inline bool
+has_deadlines(const struct transfer_manager *manager)
+{
+    return ZIGCLIP_FEATURE_DEADLINES && manager->wheel;
+}
+
+static void
+finish(struct transfer *transfer, int error)
+{
+    struct transfer_manager *manager = transfer->manager;
+
+    event_source_remove(transfer->source);
+    transfer->source = NULL;
+    if (has_deadlines(manager)) {
+        timer_wheel_cancel(manager->wheel, &transfer->deadline);
+    }
+    unmark_ready(transfer);
+
+    if (error == 0 && payload_seal(transfer->payload) == -1) {
+        error = errno;
+    }
+    transfer->handler->done(transfer->data, transfer, error);
+}
+
+static void
+handle_deadline(void *data)
+{
+    struct transfer *transfer = data;
+
+    transfer->exceeded = transfer->deadline_limit;
+    finish(transfer, ETIMEDOUT);
+}
+
+// Read one batch; false once the transfer finished or the pipe is empty
+static bool
+read_some(struct transfer *transfer, size_t budget)
+{
+    struct transfer_manager *manager = transfer->manager;
+    size_t offset = transfer->payload->size;
+    size_t chunk = budget;
+
+    // One byte past the limit is enough to tell it was exceeded
+    if (transfer->max_bytes && transfer->max_bytes - offset + 1 < chunk) {
+        chunk = transfer->max_bytes - offset + 1;
+    }
+
+    ssize_t n;
+    do {
+        n = payload_read_from(transfer->payload, transfer->fd, chunk);
+    } while (n == -1 && errno == EINTR);
+
+    if (n > 0 && transfer->max_bytes && transfer->payload->size > transfer->max_bytes) {
+        transfer->exceeded = TRANSFER_LIMIT_SIZE;
+        finish(transfer, EFBIG);
+        return false;
+    } else if (n > 0) {
+        manager->bytes[transfer->class] += n;
+        if (has_deadlines(manager) && offset == 0 &&
+            transfer->deadline_limit == TRANSFER_LIMIT_FIRST_BYTE) {
+            // Data is flowing, only the overall bound is left
+            timer_wheel_cancel(manager->wheel, &transfer->deadline);
+            if (transfer->total_ns) {
+                uint64_t elapsed = clock_ns(CLOCK_MONOTONIC) - transfer->start_ns;
+                transfer->deadline_limit = TRANSFER_LIMIT_TOTAL;
+                timer_wheel_add(manager->wheel, &transfer->deadline,
+                                elapsed < transfer->total_ns ? transfer->total_ns - elapsed : 0);
+            }
+        }
+        if (transfer->handler->data) {
+            transfer->handler->data(transfer->data, transfer, offset, n);
+        }
+        return true;
+    } else if (n == 0) {
+        finish(transfer, 0);
+    } else if (errno != EAGAIN) {
+        finish(transfer, errno);
+    }
+    return false;
+}
+
+static void
+serve(struct transfer *transfer)
+{
+    size_t budget = class_budget[transfer->class];
+
+    // Whatever is left in the pipe wakes the loop again next turn
+    while (budget > 0) {
+        size_t before = transfer->payload->size;
+        if (!read_some(transfer, budget)) {
+            return;
+        }
+        size_t moved = transfer->payload->size - before;
+        budget -= moved < budget ? moved : budget;
+    }
+}
+
+static void
+handle_turn(void *data)
+{
+    struct transfer_manager *manager = data;
+
+    while (manager->ready) {
+        struct transfer *transfer = manager->ready;
+        manager->ready = transfer->next_ready;
+        transfer->ready = false;
+        serve(transfer);
+    }
+}
+
+static void
+handle_pipe_event(void *data, int fd, uint32_t mask)
+{
+    // Hangups are read too, that is how the end of the data shows up
+    mark_ready(data);
+}
+
+void
+transfer_manager_init(struct transfer_manager *manager, struct event_loop *loop,
+                      struct timer_wheel *wheel)
+{
+    memset(manager, 0, sizeof(*manager));
+    manager->loop = loop;
+    manager->wheel = wheel;
+    event_loop_set_turn_func(loop, handle_turn, manager);
+}
+
+void
+transfer_manager_finish(struct transfer_manager *manager)
+{
+    while (manager->transfers) {
+        transfer_destroy(manager->transfers);
+    }
+    event_loop_set_turn_func(manager->loop, NULL, NULL);
+}
+
+struct transfer *
+transfer_create(struct transfer_manager *manager, int fd, struct payload *payload,
+                const struct transfer_limits *limits,
+                const struct transfer_handler *handler, void *data)
+{
+    struct transfer *transfer = mem_calloc(MEM_TRANSFER, 1, sizeof(*transfer));
+    if (!transfer) {
+        return NULL;
+    }
+
+    transfer->manager = manager;
+    transfer->class = transfer_class_for_mime(payload->mime_type);
+    transfer->payload = payload;
+    transfer->fd = fd;
+    transfer->handler = handler;
+    transfer->data = data;
+    transfer->source = event_loop_add_fd(manager->loop, fd, EVENT_LOOP_READABLE,
+                                         handle_pipe_event, transfer);
+    if (!transfer->source) {
+        mem_free(MEM_TRANSFER, transfer);
+        return NULL;
+    }
+
+    transfer->start_ns = clock_ns(CLOCK_MONOTONIC);
+    transfer->total_ns = limits->total_ns;
+    transfer->max_bytes = limits->max_bytes;
+
+    // A single deadline at a time, whichever limit comes first
+    uint64_t first_byte = limits->first_byte_ns;
+    if (has_deadlines(manager)) {
+        wheel_timer_init(&transfer->deadline, handle_deadline, transfer);
+        if (first_byte && (!limits->total_ns || first_byte < limits->total_ns)) {
+            transfer->deadline_limit = TRANSFER_LIMIT_FIRST_BYTE;
+            timer_wheel_add(manager->wheel, &transfer->deadline, first_byte);
+        } else if (limits->total_ns) {
+            transfer->deadline_limit = TRANSFER_LIMIT_TOTAL;
+            timer_wheel_add(manager->wheel, &transfer->deadline, limits->total_ns);
+        }
+    }
+
+    transfer->next = manager->transfers;
+    manager->transfers = transfer;
+    manager->count++;
+    return transfer;
+}
+
+void
+transfer_destroy(struct transfer *transfer)
+{
+    struct transfer_manager *manager = transfer->manager;
+
+    if (transfer->source) {
+        event_source_remove(transfer->source);
+    }
+    if (has_deadlines(manager)) {
+        timer_wheel_cancel(manager->wheel, &transfer->deadline);
+    }
+    unmark_ready(transfer);
+
+    struct transfer **link = &manager->transfers;
+    while (*link != transfer) {
+        link = &(*link)->next;
+    }
+    *link = transfer->next;
+    manager->count--;
+
+    close(transfer->fd);
+    payload_unref(transfer->payload);
+    mem_free(MEM_TRANSFER, transfer);
+}
@@ -0,0 +1,114 @@
+/**
+ * Asynchronous offer pipe transfers
+ *
+ * A transfer drains the read end of an offer pipe into a payload from the
+ * event loop, so a source that trickles its data in never blocks the
+ * monitor. The handler sees every chunk as it lands and is told once the
+ * source closes its end.
+ *
+ * Optional limits guard against sources that never write, never close or
+ * never stop: a transfer breaking one ends with ETIMEDOUT or EFBIG and
+ * records which limit it hit.
+ *
+ * Several transfers can run at once. Their pipes only flag themselves
+ * ready; at the end of each event loop turn the manager serves them by
+ * MIME class (text, rich text, images, everything else), newest selection
+ * first, each with a byte budget of its class. A large image keeps
+ * moving in the background without delaying the text copied after it.
+ */
+
+#ifndef ZIG_CLIP_TRANSFER_H
+#define ZIG_CLIP_TRANSFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "timer-wheel.h"
+
+struct event_loop;
+struct event_source;
+struct payload;
+struct transfer;
+
+enum transfer_class {
+    TRANSFER_CLASS_TEXT,      // Plain text, what someone is waiting to paste
+    TRANSFER_CLASS_RICH_TEXT, // HTML, RTF and other markup
+    TRANSFER_CLASS_IMAGE,
+    TRANSFER_CLASS_OTHER,
+    TRANSFER_CLASS_COUNT,
+};
+
+enum transfer_limit {
+    TRANSFER_LIMIT_NONE,
+    TRANSFER_LIMIT_FIRST_BYTE, // Nothing arrived within first_byte_ns
+    TRANSFER_LIMIT_TOTAL,      // Still open after total_ns
+    TRANSFER_LIMIT_SIZE,       // More than max_bytes
+    TRANSFER_LIMIT_COUNT,
+};
+
+// Zero leaves a limit off
+struct transfer_limits {
+    uint64_t first_byte_ns;
+    uint64_t total_ns;
+    size_t max_bytes;
+};
+
+struct transfer_handler {
+    // Bytes [offset, offset + len) of the payload just arrived
+    void (*data)(void *data, struct transfer *transfer, size_t offset, size_t len);
+    // The source closed the pipe (error 0, payload sealed) or reading
+    // failed with the given errno. The handler owns the transfer now.
+    void (*done)(void *data, struct transfer *transfer, int error);
+};
+
+struct transfer_manager {
+    struct event_loop *loop;
+    struct timer_wheel *wheel; // Deadlines, NULL ignores the time limits
+    struct transfer *transfers; // All running transfers
+    struct transfer *ready;     // Readable this turn, in service order
+    int count;
+
+    uint64_t bytes[TRANSFER_CLASS_COUNT]; // Moved per class
+};
+
+struct transfer {
+    struct transfer_manager *manager;
+    struct transfer *next;
+    struct transfer *next_ready;
+    bool ready;
+    enum transfer_class class;
+
+    struct payload *payload;
+    int fd;
+    struct event_source *source;
+    const struct transfer_handler *handler;
+    void *data;
+
+    struct wheel_timer deadline;
+    enum transfer_limit deadline_limit; // What the armed deadline enforces
+    uint64_t start_ns;
+    uint64_t total_ns;
+    size_t max_bytes;
+    enum transfer_limit exceeded;
+};
+
+const char *transfer_limit_name(enum transfer_limit limit);
+const char *transfer_class_name(enum transfer_class class);
+enum transfer_class transfer_class_for_mime(const char *mime_type);
+
+// Takes over the loop's turn function
+void transfer_manager_init(struct transfer_manager *manager, struct event_loop *loop,
+                           struct timer_wheel *wheel);
+// Destroys transfers still running
+void transfer_manager_finish(struct transfer_manager *manager);
+
+// Takes ownership of fd, which must be non-blocking, and a payload
+// reference. Both stay with the caller if creation fails.
+struct transfer *transfer_create(struct transfer_manager *manager, int fd,
+                                 struct payload *payload,
+                                 const struct transfer_limits *limits,
+                                 const struct transfer_handler *handler, void *data);
+void transfer_destroy(struct transfer *transfer);
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * UTF-8 validation
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "utf8.h"
+
+bool
+utf8_valid(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t i = 0;
+
+    while (i < len) {
+        // ASCII runs dominate, check eight bytes at a time
+        if (i + 8 <= len) {
+            uint64_t v;
+            memcpy(&v, p + i, sizeof(v));
+            if ((v & 0x8080808080808080ull) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = p[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        size_t n;
+        unsigned char lo = 0x80, hi = 0xbf; // Range of the second byte
+        if (c >= 0xc2 && c <= 0xdf) {
+            n = 2;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            n = 3;
+            if (c == 0xe0) lo = 0xa0;      // Overlong
+            else if (c == 0xed) hi = 0x9f; // Surrogates
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            n = 4;
+            if (c == 0xf0) lo = 0x90;      // Overlong
+            else if (c == 0xf4) hi = 0x8f; // Past U+10FFFF
+        } else {
+            return false;
+        }
+
+        if (len - i < n || p[i + 1] < lo || p[i + 1] > hi) {
+            return false;
+        }
+        for (size_t k = 2; k < n; k++) {
+            if ((p[i + k] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        i += n;
+    }
+    return true;
+}
@@ -0,0 +1,14 @@
+/**
+ * UTF-8 validation
+ */
+
+#ifndef ZIG_CLIP_UTF8_H
+#define ZIG_CLIP_UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Strict validation: no overlongs, surrogates or code points past U+10FFFF
+bool utf8_valid(const void *data, size_t len);
+
+#endif
@@ -0,0 +1,24 @@
+/**
+ * Small helpers shared by the clipboard monitor modules.
+ */
+
+#ifndef ZIG_CLIP_UTIL_H
+#define ZIG_CLIP_UTIL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define ARRAY_LENGTH(a) (sizeof(a) / sizeof((a)[0]))
+
+#define CACHE_LINE_SIZE 64
+
+// Read a clock in nanoseconds
+static inline uint64_t
+clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,599 @@
+//! Native Wayland wire client.
+//!
+//! Speaks the protocol directly on the compositor socket, without
+//! libwayland-client or libc. Messages are parsed in place from a fixed
+//! receive buffer: strings and arrays handed to a handler are slices of
+//! that buffer, valid until the handler returns, and nothing is allocated
+//! per message. Requests are encoded into a fixed send buffer that goes
+//! out with the next flush.
+//!
+//! Decoding and encoding are generated at comptime from the interface
+//! declarations in protocol.zig. Dispatch switches on the interface of the
+//! target object, then on the opcode, and calls the handler method named
+//! after the interface with a typed event, so a handler only declares the
+//! interfaces it cares about.
+
+const std = @import("std");
+const protocol = @import("protocol.zig");
+
+const linux = std.os.linux;
+const native = @import("builtin").cpu.arch.endian();
+const posix = std.posix;
+
+pub const Interface = protocol.Interface;
+
+// An object id, .none where an argument is a null object
+pub const Object = enum(u32) { none = 0, _ };
+
+// A new object of a known interface, registered when it goes over the wire
+pub fn NewId(comptime interface: Interface) type {
+    return enum(u32) {
+        _,
+
+        pub const target = interface;
+
+        pub fn object(self: @This()) Object {
+            return @enumFromInt(@intFromEnum(self));
+        }
+    };
+}
+
+// wl_registry.bind names the interface of the new object on the wire
+pub const BindId = struct {
+    interface: [:0]const u8,
+    version: u32,
+    id: Object,
+};
+
+// A file descriptor, passed as SCM_RIGHTS ancillary data
+pub const Fd = enum(posix.fd_t) { _ };
+
+pub const display: Object = @enumFromInt(1);
+
+pub const Error = error{
+    ConnectionClosed,
+    ConnectionFailed,
+    MessageTooLong,
+    BadMessage,
+    MissingFd,
+    TooManyFds,
+    UnknownObject,
+    OutOfObjects,
+    ProtocolError,
+};
+
+// The compositor never sends a message larger than this
+const max_message_size = 4096;
+// libwayland sends at most 28 fds with one sendmsg
+const max_fds = 28;
+const server_id_base = 0xff000000;
+const max_objects = 256;
+
+const IoVec = extern struct {
+    base: [*]u8,
+    len: usize,
+};
+
+const MsgHdr = extern struct {
+    name: ?*anyopaque = null,
+    namelen: u32 = 0,
+    iov: [*]IoVec,
+    iovlen: usize,
+    control: ?*anyopaque,
+    controllen: usize,
+    flags: i32 = 0,
+};
+
+const CmsgHdr = extern struct {
+    len: usize,
+    level: i32,
+    type: i32,
+};
+
+const SCM_RIGHTS = 1;
+const MSG_CMSG_CLOEXEC = 0x40000000;
+
+fn cmsgAlign(len: usize) usize {
+    return std.mem.alignForward(usize, len, @sizeOf(usize));
+}
+
+const cmsg_data_offset = cmsgAlign(@sizeOf(CmsgHdr));
+const cmsg_space = cmsg_data_offset + cmsgAlign(max_fds * @sizeOf(posix.fd_t));
+
+fn pad(len: usize) usize {
+    return std.mem.alignForward(usize, len, 4);
+}
+
+// Received descriptors, in the order their messages consume them
+const FdQueue = struct {
+    fds: [max_fds * 2]posix.fd_t = undefined,
+    head: usize = 0,
+    count: usize = 0,
+
+    fn push(self: *FdQueue, fd: posix.fd_t) Error!void {
+        if (self.count == self.fds.len) {
+            posix.close(fd);
+            return error.TooManyFds;
+        }
+        self.fds[(self.head + self.count) % self.fds.len] = fd;
+        self.count += 1;
+    }
+
+    fn pop(self: *FdQueue) ?posix.fd_t {
+        if (self.count == 0) {
+            return null;
+        }
+        const fd = self.fds[self.head];
+        self.head = (self.head + 1) % self.fds.len;
+        self.count -= 1;
+        return fd;
+    }
+};
+
+const Reader = struct {
+    body: []const u8,
+    pos: usize = 0,
+    fds: *FdQueue,
+
+    fn word(self: *Reader) Error!u32 {
+        if (self.body.len - self.pos < 4) {
+            return error.BadMessage;
+        }
+        const value = std.mem.readInt(u32, self.body[self.pos..][0..4], native);
+        self.pos += 4;
+        return value;
+    }
+
+    fn string(self: *Reader) Error![:0]const u8 {
+        const len = try self.word();
+        if (len == 0 or self.body.len - self.pos < pad(len)) {
+            return error.BadMessage;
+        }
+        const end = self.pos + len - 1;
+        if (self.body[end] != 0) {
+            return error.BadMessage;
+        }
+        const value = self.body[self.pos..end :0];
+        self.pos += pad(len);
+        return value;
+    }
+
+    fn array(self: *Reader) Error![]const u8 {
+        const len = try self.word();
+        if (self.body.len - self.pos < pad(len)) {
+            return error.BadMessage;
+        }
+        const value = self.body[self.pos..][0..len];
+        self.pos += pad(len);
+        return value;
+    }
+
+    fn arg(self: *Reader, comptime T: type) Error!T {
+        if (T == u32) {
+            return self.word();
+        } else if (T == i32) {
+            return @bitCast(try self.word());
+        } else if (T == [:0]const u8) {
+            return self.string();
+        } else if (T == []const u8) {
+            return self.array();
+        } else if (T == Fd) {
+            return @enumFromInt(self.fds.pop() orelse return error.MissingFd);
+        } else if (@typeInfo(T) == .@"enum") {
+            // Object and NewId(...)
+            return @enumFromInt(try self.word());
+        } else {
+            @compileError("no wire encoding for " ++ @typeName(T));
+        }
+    }
+};
+
+fn isNewId(comptime T: type) bool {
+    return switch (@typeInfo(T)) {
+        .@"enum" => @hasDecl(T, "target"),
+        else => false,
+    };
+}
+
+// An interface without requests or events has an empty union for them,
+// which cannot be switched on
+fn isEmpty(comptime Union: type) bool {
+    return @typeInfo(Union).@"union".fields.len == 0;
+}
+
+fn decode(comptime Event: type, opcode: u16, reader: *Reader) Error!Event {
+    inline for (@typeInfo(Event).@"union".fields, 0..) |field, i| {
+        if (i == opcode) {
+            var args: field.type = undefined;
+            _ = &args;
+            inline for (@typeInfo(field.type).@"struct".fields) |arg| {
+                @field(args, arg.name) = try reader.arg(arg.type);
+            }
+            return @unionInit(Event, field.name, args);
+        }
+    }
+    return error.BadMessage;
+}
+
+// Descriptors of an event nobody takes would leak otherwise
+fn closeFds(event: anytype) void {
+    if (comptime isEmpty(@TypeOf(event))) {
+        return;
+    } else switch (event) {
+        inline else => |args| {
+            inline for (@typeInfo(@TypeOf(args)).@"struct".fields) |arg| {
+                if (arg.type == Fd) {
+                    posix.close(@intFromEnum(@field(args, arg.name)));
+                }
+            }
+        },
+    }
+}
+
+const Slot = struct {
+    interface: ?Interface = null,
+    // Destroyed by us, events still in flight are dropped
+    zombie: bool = false,
+};
+
+// Ids from 1 are ours, from server_id_base the compositor's
+const ObjectMap = struct {
+    client: [max_objects]Slot = [_]Slot{.{}} ** max_objects,
+    server: [max_objects]Slot = [_]Slot{.{}} ** max_objects,
+
+    fn get(self: *ObjectMap, id: u32) ?*Slot {
+        if (id >= server_id_base) {
+            const index = id - server_id_base;
+            return if (index < max_objects) &self.server[index] else null;
+        }
+        return if (id < max_objects) &self.client[id] else null;
+    }
+
+    fn create(self: *ObjectMap, interface: Interface) Error!u32 {
+        for (self.client[2..], 2..) |*slot, id| {
+            if (slot.interface == null) {
+                slot.* = .{ .interface = interface };
+                return @intCast(id);
+            }
+        }
+        return error.OutOfObjects;
+    }
+};
+
+pub const Connection = struct {
+    fd: posix.fd_t,
+    in: [max_message_size * 2]u8 = undefined,
+    in_start: usize = 0,
+    in_end: usize = 0,
+    in_fds: FdQueue = .{},
+    out: [max_message_size]u8 = undefined,
+    out_len: usize = 0,
+    out_fds: [max_fds]posix.fd_t = undefined,
+    out_fd_count: usize = 0,
+    objects: ObjectMap = .{},
+    // Callback of the roundtrip in progress
+    sync: Object = .none,
+
+    // WAYLAND_SOCKET when a parent passed us the connection, otherwise
+    // WAYLAND_DISPLAY under XDG_RUNTIME_DIR
+    pub fn connect(self: *Connection) !void {
+        self.* = .{ .fd = try openSocket() };
+        self.objects.client[1] = .{ .interface = .wl_display };
+    }
+
+    pub fn close(self: *Connection) void {
+        while (self.in_fds.pop()) |fd| {
+            posix.close(fd);
+        }
+        for (self.out_fds[0..self.out_fd_count]) |fd| {
+            posix.close(fd);
+        }
+        posix.close(self.fd);
+    }
+
+    fn openSocket() !posix.fd_t {
+        if (posix.getenv("WAYLAND_SOCKET")) |value| {
+            return std.fmt.parseInt(posix.fd_t, value, 10);
+        }
+        const name = posix.getenv("WAYLAND_DISPLAY") orelse "wayland-0";
+        var path_buf: [108]u8 = undefined;
+        const path = if (name.len > 0 and name[0] == '/')
+            name
+        else
+            try std.fmt.bufPrint(&path_buf, "{s}/{s}", .{
+                posix.getenv("XDG_RUNTIME_DIR") orelse return error.NoRuntimeDir,
+                name,
+            });
+
+        const address = try std.net.Address.initUnix(path);
+        const fd = try posix.socket(posix.AF.UNIX, posix.SOCK.STREAM | posix.SOCK.CLOEXEC, 0);
+        errdefer posix.close(fd);
+        try posix.connect(fd, &address.any, address.getOsSockLen());
+        return fd;
+    }
+
+    // Take an id for an object a request is about to create
+    pub fn create(self: *Connection, comptime interface: Interface) Error!NewId(interface) {
+        return @enumFromInt(try self.objects.create(interface));
+    }
+
+    // Send the destroy request of an object, events already on their way
+    // to it are dropped until the compositor confirms with delete_id, or
+    // for its own ids, hands the id out again
+    pub fn destroy(self: *Connection, object: Object, comptime interface: Interface) Error!void {
+        try self.send(object, interface, .{ .destroy = .{} });
+        if (self.objects.get(@intFromEnum(object))) |slot| {
+            slot.zombie = true;
+        }
+    }
+
+    // Whether an object is known and not destroyed by us yet
+    pub fn alive(self: *Connection, object: Object) bool {
+        const slot = self.objects.get(@intFromEnum(object)) orelse return false;
+        return slot.interface != null and !slot.zombie;
+    }
+
+    pub fn send(
+        self: *Connection,
+        object: Object,
+        comptime interface: Interface,
+        request: protocol.Spec(interface).Request,
+    ) Error!void {
+        if (comptime isEmpty(@TypeOf(request))) {
+            @compileError(@tagName(interface) ++ " has no requests");
+        } else switch (request) {
+            inline else => |args, tag| {
+                const Args = @TypeOf(args);
+                var size: usize = 8;
+                var fd_count: usize = 0;
+                inline for (@typeInfo(Args).@"struct".fields) |field| {
+                    const value = @field(args, field.name);
+                    size += switch (field.type) {
+                        [:0]const u8 => 4 + pad(value.len + 1),
+                        []const u8 => 4 + pad(value.len),
+                        BindId => 4 + pad(value.interface.len + 1) + 8,
+                        Fd => 0,
+                        else => 4,
+                    };
+                    if (field.type == Fd) {
+                        fd_count += 1;
+                    }
+                }
+                if (size > max_message_size) {
+                    return error.MessageTooLong;
+                }
+                if (self.out_len + size > self.out.len or self.out_fd_count + fd_count > max_fds) {
+                    try self.flush();
+                }
+
+                self.putWord(@intFromEnum(object));
+                self.putWord(@as(u32, @intCast(size)) << 16 | @intFromEnum(tag));
+                inline for (@typeInfo(Args).@"struct".fields) |field| {
+                    try self.putArg(field.type, @field(args, field.name));
+                }
+            },
+        }
+    }
+
+    fn putWord(self: *Connection, value: u32) void {
+        std.mem.writeInt(u32, self.out[self.out_len..][0..4], value, native);
+        self.out_len += 4;
+    }
+
+    fn putBytes(self: *Connection, bytes: []const u8, len: usize) void {
+        self.putWord(@intCast(len));
+        @memcpy(self.out[self.out_len..][0..bytes.len], bytes);
+        @memset(self.out[self.out_len + bytes.len .. self.out_len + pad(len)], 0);
+        self.out_len += pad(len);
+    }
+
+    fn putArg(self: *Connection, comptime T: type, value: T) Error!void {
+        switch (T) {
+            u32 => self.putWord(value),
+            i32 => self.putWord(@bitCast(value)),
+            [:0]const u8 => self.putBytes(value, value.len + 1),
+            []const u8 => self.putBytes(value, value.len),
+            BindId => {
+                self.putBytes(value.interface, value.interface.len + 1);
+                self.putWord(value.version);
+                self.putWord(@intFromEnum(value.id));
+            },
+            Fd => {
+                // The caller keeps its descriptor, ours is closed once sent
+                self.out_fds[self.out_fd_count] = posix.dup(@intFromEnum(value)) catch
+                    return error.TooManyFds;
+                self.out_fd_count += 1;
+            },
+            // Object and NewId(...)
+            else => self.putWord(@intFromEnum(value)),
+        }
+    }
+
+    pub fn flush(self: *Connection) Error!void {
+        var sent: usize = 0;
+        while (sent < self.out_len) {
+            var iov = [_]IoVec{.{ .base = self.out[sent..].ptr, .len = self.out_len - sent }};
+            var control: [cmsg_space]u8 align(@alignOf(CmsgHdr)) = undefined;
+            var msg = MsgHdr{ .iov = &iov, .iovlen = 1, .control = null, .controllen = 0 };
+
+            // Descriptors ride along with the first byte of the buffer
+            if (self.out_fd_count > 0) {
+                const fds_len = self.out_fd_count * @sizeOf(posix.fd_t);
+                const header: *CmsgHdr = @ptrCast(&control);
+                header.* = .{
+                    .len = cmsg_data_offset + fds_len,
+                    .level = posix.SOL.SOCKET,
+                    .type = SCM_RIGHTS,
+                };
+                @memcpy(control[cmsg_data_offset..][0..fds_len], std.mem.sliceAsBytes(self.out_fds[0..self.out_fd_count]));
+                msg.control = &control;
+                msg.controllen = cmsg_data_offset + cmsgAlign(fds_len);
+            }
+
+            const rc = linux.syscall3(.sendmsg, @intCast(self.fd), @intFromPtr(&msg), linux.MSG.NOSIGNAL);
+            switch (posix.errno(rc)) {
+                .SUCCESS => {},
+                .INTR => continue,
+                .PIPE, .CONNRESET => return error.ConnectionClosed,
+                else => return error.ConnectionFailed,
+            }
+            sent += rc;
+            for (self.out_fds[0..self.out_fd_count]) |fd| {
+                posix.close(fd);
+            }
+            self.out_fd_count = 0;
+        }
+        self.out_len = 0;
+    }
+
+    // Block until the compositor sent something and append it to the
+    // receive buffer
+    pub fn read(self: *Connection) Error!void {
+        if (self.in_start > 0) {
+            const pending = self.in_end - self.in_start;
+            std.mem.copyForwards(u8, self.in[0..pending], self.in[self.in_start..self.in_end]);
+            self.in_start = 0;
+            self.in_end = pending;
+        }
+
+        var iov = [_]IoVec{.{ .base = self.in[self.in_end..].ptr, .len = self.in.len - self.in_end }};
+        var control: [cmsg_space]u8 align(@alignOf(CmsgHdr)) = undefined;
+        var msg = MsgHdr{ .iov = &iov, .iovlen = 1, .control = &control, .controllen = control.len };
+
+        var rc: usize = undefined;
+        while (true) {
+            rc = linux.syscall3(.recvmsg, @intCast(self.fd), @intFromPtr(&msg), MSG_CMSG_CLOEXEC);
+            switch (posix.errno(rc)) {
+                .SUCCESS => break,
+                .INTR => continue,
+                .CONNRESET => return error.ConnectionClosed,
+                else => return error.ConnectionFailed,
+            }
+        }
+
+        var offset: usize = 0;
+        while (offset + @sizeOf(CmsgHdr) <= msg.controllen) {
+            const header: *align(1) const CmsgHdr = @ptrCast(control[offset..].ptr);
+            if (header.len < cmsg_data_offset or offset + header.len > msg.controllen) {
+                break;
+            }
+            if (header.level == posix.SOL.SOCKET and header.type == SCM_RIGHTS) {
+                const data = control[offset + cmsg_data_offset .. offset + header.len];
+                var i: usize = 0;
+                while (i + @sizeOf(posix.fd_t) <= data.len) : (i += @sizeOf(posix.fd_t)) {
+                    try self.in_fds.push(std.mem.readInt(posix.fd_t, data[i..][0..@sizeOf(posix.fd_t)], native));
+                }
+            }
+            offset += cmsgAlign(header.len);
+        }
+
+        if (rc == 0) {
+            return error.ConnectionClosed;
+        }
+        self.in_end += rc;
+    }
+
+    // Send a sync and dispatch until its callback fires, so everything
+    // requested before it has been answered
+    pub fn roundtrip(self: *Connection, handler: anytype) !void {
+        const callback = try self.create(.wl_callback);
+        try self.send(display, .wl_display, .{ .sync = .{ .callback = callback } });
+        try self.flush();
+
+        self.sync = callback.object();
+        while (self.sync != .none) {
+            try self.read();
+            try self.dispatch(handler);
+        }
+    }
+
+    // Handle every complete message in the receive buffer. The handler is
+    // a pointer to a struct, its method named after an interface, if any,
+    // is called as method(handler, connection, object, event).
+    pub fn dispatch(self: *Connection, handler: anytype) !void {
+        const Handler = @typeInfo(@TypeOf(handler)).pointer.child;
+
+        while (self.in_end - self.in_start >= 8) {
+            const header = self.in[self.in_start..][0..8];
+            const id = std.mem.readInt(u32, header[0..4], native);
+            const word = std.mem.readInt(u32, header[4..8], native);
+            const size = word >> 16;
+            const opcode: u16 = @truncate(word);
+            if (size < 8 or size > max_message_size or size % 4 != 0) {
+                return error.BadMessage;
+            }
+            if (self.in_end - self.in_start < size) {
+                break;
+            }
+            var reader = Reader{
+                .body = self.in[self.in_start + 8 .. self.in_start + size],
+                .fds = &self.in_fds,
+            };
+            self.in_start += size;
+
+            const slot = self.objects.get(id) orelse return error.UnknownObject;
+            const interface = slot.interface orelse return error.UnknownObject;
+            switch (interface) {
+                inline else => |tag| {
+                    const Event = protocol.Spec(tag).Event;
+                    // The compositor sends nothing to objects of this interface
+                    if (comptime isEmpty(Event)) {
+                        return error.BadMessage;
+                    } else {
+                        const object: Object = @enumFromInt(id);
+                        const event = try decode(Event, opcode, &reader);
+                        self.register(event);
+
+                        if (comptime tag == .wl_display) {
+                            try self.handleDisplay(event);
+                        } else if (comptime tag == .wl_callback) {
+                            if (object == self.sync) {
+                                self.sync = .none;
+                            }
+                        } else if (comptime !@hasDecl(Handler, @tagName(tag))) {
+                            closeFds(event);
+                        } else if (slot.zombie) {
+                            closeFds(event);
+                        } else {
+                            try @field(Handler, @tagName(tag))(handler, self, object, event);
+                        }
+                    }
+                },
+            }
+        }
+    }
+
+    // Objects the compositor creates get their interface from the event
+    fn register(self: *Connection, event: anytype) void {
+        if (comptime isEmpty(@TypeOf(event))) {
+            return;
+        } else switch (event) {
+            inline else => |args| {
+                inline for (@typeInfo(@TypeOf(args)).@"struct".fields) |arg| {
+                    if (comptime isNewId(arg.type)) {
+                        const id = @intFromEnum(@field(args, arg.name));
+                        if (id >= server_id_base) {
+                            if (self.objects.get(id)) |slot| {
+                                slot.* = .{ .interface = arg.type.target };
+                            }
+                        }
+                    }
+                }
+            },
+        }
+    }
+
+    fn handleDisplay(self: *Connection, event: protocol.WlDisplay.Event) Error!void {
+        switch (event) {
+            .@"error" => |e| {
+                std.log.err("object {d}: error {d}: {s}", .{ @intFromEnum(e.object_id), e.code, e.message });
+                return error.ProtocolError;
+            },
+            .delete_id => |e| {
+                if (self.objects.get(e.id)) |slot| {
+                    slot.* = .{};
+                }
+            },
+        }
+    }
+};
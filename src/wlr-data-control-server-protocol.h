@@ -0,0 +1,264 @@
+/* Server side of wlr_data_control_unstable_v1, laid out like wayland-scanner
+ * server-header output. The interface tables are shared with the client in
+ * wlr-data-control-protocol.c. */
+
+#ifndef WLR_DATA_CONTROL_UNSTABLE_V1_SERVER_PROTOCOL_H
+#define WLR_DATA_CONTROL_UNSTABLE_V1_SERVER_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "wayland-server.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+struct wl_client;
+struct wl_resource;
+
+struct wl_seat;
+struct zwlr_data_control_device_v1;
+struct zwlr_data_control_manager_v1;
+struct zwlr_data_control_offer_v1;
+struct zwlr_data_control_source_v1;
+
+#ifndef ZWLR_DATA_CONTROL_MANAGER_V1_INTERFACE
+#define ZWLR_DATA_CONTROL_MANAGER_V1_INTERFACE
+extern const struct wl_interface zwlr_data_control_manager_v1_interface;
+#endif
+#ifndef ZWLR_DATA_CONTROL_DEVICE_V1_INTERFACE
+#define ZWLR_DATA_CONTROL_DEVICE_V1_INTERFACE
+extern const struct wl_interface zwlr_data_control_device_v1_interface;
+#endif
+#ifndef ZWLR_DATA_CONTROL_SOURCE_V1_INTERFACE
+#define ZWLR_DATA_CONTROL_SOURCE_V1_INTERFACE
+extern const struct wl_interface zwlr_data_control_source_v1_interface;
+#endif
+#ifndef ZWLR_DATA_CONTROL_OFFER_V1_INTERFACE
+#define ZWLR_DATA_CONTROL_OFFER_V1_INTERFACE
+extern const struct wl_interface zwlr_data_control_offer_v1_interface;
+#endif
+
+/**
+ * @ingroup iface_zwlr_data_control_manager_v1
+ * @struct zwlr_data_control_manager_v1_interface
+ */
+struct zwlr_data_control_manager_v1_interface {
+	/**
+	 * create a new data source
+	 */
+	void (*create_data_source)(struct wl_client *client,
+				   struct wl_resource *resource,
+				   uint32_t id);
+	/**
+	 * get a data device for a seat
+	 */
+	void (*get_data_device)(struct wl_client *client,
+				struct wl_resource *resource,
+				uint32_t id,
+				struct wl_resource *seat);
+	/**
+	 * destroy the manager
+	 */
+	void (*destroy)(struct wl_client *client,
+			struct wl_resource *resource);
+};
+
+#ifndef ZWLR_DATA_CONTROL_DEVICE_V1_ERROR_ENUM
+#define ZWLR_DATA_CONTROL_DEVICE_V1_ERROR_ENUM
+enum zwlr_data_control_device_v1_error {
+	/**
+	 * source given to set_selection or set_primary_selection was already used before
+	 */
+	ZWLR_DATA_CONTROL_DEVICE_V1_ERROR_USED_SOURCE = 1,
+};
+#endif /* ZWLR_DATA_CONTROL_DEVICE_V1_ERROR_ENUM */
+
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ * @struct zwlr_data_control_device_v1_interface
+ */
+struct zwlr_data_control_device_v1_interface {
+	/**
+	 * copy data to the selection
+	 */
+	void (*set_selection)(struct wl_client *client,
+			      struct wl_resource *resource,
+			      struct wl_resource *source);
+	/**
+	 * destroy this data device
+	 */
+	void (*destroy)(struct wl_client *client,
+			struct wl_resource *resource);
+	/**
+	 * copy data to the primary selection
+	 * @since 2
+	 */
+	void (*set_primary_selection)(struct wl_client *client,
+				      struct wl_resource *resource,
+				      struct wl_resource *source);
+};
+
+#define ZWLR_DATA_CONTROL_DEVICE_V1_DATA_OFFER 0
+#define ZWLR_DATA_CONTROL_DEVICE_V1_SELECTION 1
+#define ZWLR_DATA_CONTROL_DEVICE_V1_FINISHED 2
+#define ZWLR_DATA_CONTROL_DEVICE_V1_PRIMARY_SELECTION 3
+
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ */
+#define ZWLR_DATA_CONTROL_DEVICE_V1_DATA_OFFER_SINCE_VERSION 1
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ */
+#define ZWLR_DATA_CONTROL_DEVICE_V1_SELECTION_SINCE_VERSION 1
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ */
+#define ZWLR_DATA_CONTROL_DEVICE_V1_FINISHED_SINCE_VERSION 1
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ */
+#define ZWLR_DATA_CONTROL_DEVICE_V1_PRIMARY_SELECTION_SINCE_VERSION 2
+
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ * Sends an data_offer event to the client owning the resource.
+ * @param resource_ The client's resource
+ */
+static inline void
+zwlr_data_control_device_v1_send_data_offer(struct wl_resource *resource_, struct wl_resource *id)
+{
+	wl_resource_post_event(resource_, ZWLR_DATA_CONTROL_DEVICE_V1_DATA_OFFER, id);
+}
+
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ * Sends an selection event to the client owning the resource.
+ * @param resource_ The client's resource
+ */
+static inline void
+zwlr_data_control_device_v1_send_selection(struct wl_resource *resource_, struct wl_resource *id)
+{
+	wl_resource_post_event(resource_, ZWLR_DATA_CONTROL_DEVICE_V1_SELECTION, id);
+}
+
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ * Sends an finished event to the client owning the resource.
+ * @param resource_ The client's resource
+ */
+static inline void
+zwlr_data_control_device_v1_send_finished(struct wl_resource *resource_)
+{
+	wl_resource_post_event(resource_, ZWLR_DATA_CONTROL_DEVICE_V1_FINISHED);
+}
+
+/**
+ * @ingroup iface_zwlr_data_control_device_v1
+ * Sends an primary_selection event to the client owning the resource.
+ * @param resource_ The client's resource
+ */
+static inline void
+zwlr_data_control_device_v1_send_primary_selection(struct wl_resource *resource_, struct wl_resource *id)
+{
+	wl_resource_post_event(resource_, ZWLR_DATA_CONTROL_DEVICE_V1_PRIMARY_SELECTION, id);
+}
+
+/**
+ * @ingroup iface_zwlr_data_control_source_v1
+ * @struct zwlr_data_control_source_v1_interface
+ */
+struct zwlr_data_control_source_v1_interface {
+	/**
+	 * add an offered MIME type
+	 */
+	void (*offer)(struct wl_client *client,
+		      struct wl_resource *resource,
+		      const char *mime_type);
+	/**
+	 * destroy this source
+	 */
+	void (*destroy)(struct wl_client *client,
+			struct wl_resource *resource);
+};
+
+#define ZWLR_DATA_CONTROL_SOURCE_V1_SEND 0
+#define ZWLR_DATA_CONTROL_SOURCE_V1_CANCELLED 1
+
+/**
+ * @ingroup iface_zwlr_data_control_source_v1
+ */
+#define ZWLR_DATA_CONTROL_SOURCE_V1_SEND_SINCE_VERSION 1
+/**
+ * @ingroup iface_zwlr_data_control_source_v1
+ */
+#define ZWLR_DATA_CONTROL_SOURCE_V1_CANCELLED_SINCE_VERSION 1
+
+/**
+ * @ingroup iface_zwlr_data_control_source_v1
+ * Sends an send event to the client owning the resource.
+ * @param resource_ The client's resource
+ * @param mime_type MIME type for the data
+ * @param fd file descriptor for the data
+ */
+static inline void
+zwlr_data_control_source_v1_send_send(struct wl_resource *resource_, const char *mime_type, int32_t fd)
+{
+	wl_resource_post_event(resource_, ZWLR_DATA_CONTROL_SOURCE_V1_SEND, mime_type, fd);
+}
+
+/**
+ * @ingroup iface_zwlr_data_control_source_v1
+ * Sends an cancelled event to the client owning the resource.
+ * @param resource_ The client's resource
+ */
+static inline void
+zwlr_data_control_source_v1_send_cancelled(struct wl_resource *resource_)
+{
+	wl_resource_post_event(resource_, ZWLR_DATA_CONTROL_SOURCE_V1_CANCELLED);
+}
+
+/**
+ * @ingroup iface_zwlr_data_control_offer_v1
+ * @struct zwlr_data_control_offer_v1_interface
+ */
+struct zwlr_data_control_offer_v1_interface {
+	/**
+	 * request that the data is transferred
+	 */
+	void (*receive)(struct wl_client *client,
+			struct wl_resource *resource,
+			const char *mime_type,
+			int32_t fd);
+	/**
+	 * destroy this offer
+	 */
+	void (*destroy)(struct wl_client *client,
+			struct wl_resource *resource);
+};
+
+#define ZWLR_DATA_CONTROL_OFFER_V1_OFFER 0
+
+/**
+ * @ingroup iface_zwlr_data_control_offer_v1
+ */
+#define ZWLR_DATA_CONTROL_OFFER_V1_OFFER_SINCE_VERSION 1
+
+/**
+ * @ingroup iface_zwlr_data_control_offer_v1
+ * Sends an offer event to the client owning the resource.
+ * @param resource_ The client's resource
+ * @param mime_type offered MIME type
+ */
+static inline void
+zwlr_data_control_offer_v1_send_offer(struct wl_resource *resource_, const char *mime_type)
+{
+	wl_resource_post_event(resource_, ZWLR_DATA_CONTROL_OFFER_V1_OFFER, mime_type);
+}
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,811 @@
+/**
+ * libzigclip
+ *
+ * The same capture path as the monitor: offers collect their MIME types
+ * on a private queue, selections go through the coalescer, pipes drain
+ * into memfds under the transfer manager and the pipeline hashes the
+ * sealed payloads before they land in the history. Instead of framing
+ * records for stdout, captures are handed to the subscribed callbacks.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+#include "wlr-data-control-protocol.h"
+
+#include "coalesce.h"
+#include "display-reader.h"
+#include "event-loop.h"
+#include "history.h"
+#include "log.h"
+#include "mem.h"
+#include "offer.h"
+#include "payload.h"
+#include "pipeline.h"
+#include "timer-wheel.h"
+#include "transfer.h"
+#include "util.h"
+#include "zigclip.h"
+
+#define MAX_SUBSCRIBERS 16
+#define MAX_PENDING_CAPTURES 16
+#define MAX_ACTIVE_TRANSFERS 4
+#define TIMER_TICK_NS (10 * 1000000ull)
+#define DEFAULT_HISTORY 100
+
+static const char *const default_mime_types[] = {
+    "text/plain;charset=utf-8",
+    "text/plain",
+    "UTF8_STRING",
+    NULL,
+};
+
+// Names other clients ask for UTF-8 text by, offered for restored text
+static const char *const text_aliases[] = {
+    "text/plain;charset=utf-8",
+    "text/plain",
+    "UTF8_STRING",
+    "STRING",
+    "TEXT",
+};
+
+struct pending_capture {
+    struct offer *offer;
+    uint64_t timestamp_ns;
+    char mime_type[PAYLOAD_MIME_MAX];
+};
+
+struct subscriber {
+    zigclip_callback_t callback;
+    void *data;
+};
+
+// A client reading a restored entry, fed from the event loop
+struct restore_write {
+    struct zigclip *zc;
+    struct restore_write *next;
+    struct payload *payload;
+    int fd;
+    size_t offset;
+    struct event_source *source;
+};
+
+struct zigclip {
+    struct wl_display *display;
+    struct wl_registry *registry;
+    struct wl_seat *seat;
+    struct zwlr_data_control_manager_v1 *manager;
+    struct zwlr_data_control_device_v1 *device;
+    struct wl_event_queue *queue; // Data-control events, dispatched in zigclip_dispatch()
+    struct event_loop *loop;
+    struct display_reader *reader;
+    bool failed;
+
+    struct offer_manager offers;
+    struct coalescer coalescer;
+    struct timer_wheel wheel;
+    struct transfer_manager transfers;
+    struct transfer_limits limits;
+    struct pipeline *pipeline;
+    struct history history;
+    struct pending_capture pending[MAX_PENDING_CAPTURES];
+    int pending_head;
+    int pending_count;
+
+    char **mime_types; // Wanted, most wanted first
+    int mime_count;
+    uint32_t flags;
+    uint64_t seq;
+
+    struct subscriber subscribers[MAX_SUBSCRIBERS];
+
+    // Entry we made the selection, served until someone replaces it
+    struct zwlr_data_control_source_v1 *source;
+    struct payload *source_payload;
+    struct restore_write *writes;
+
+    struct zigclip_stats stats;
+};
+
+static void start_next_capture(struct zigclip *zc);
+
+static void
+fill_entry(struct zigclip_entry *entry, const struct payload *payload)
+{
+    entry->seq = payload->seq;
+    entry->timestamp_ns = payload->timestamp_ns;
+    entry->mime_type = payload->mime_type;
+    entry->data = payload->data;
+    entry->size = payload->size;
+    entry->hash = payload->hash;
+    entry->fd = payload->fd;
+}
+
+static void
+notify(struct zigclip *zc, const struct payload *payload)
+{
+    struct zigclip_entry entry;
+
+    fill_entry(&entry, payload);
+    for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+        // A callback may unsubscribe itself or others
+        struct subscriber subscriber = zc->subscribers[i];
+        if (subscriber.callback) {
+            subscriber.callback(subscriber.data, &entry);
+        }
+    }
+}
+
+static bool
+is_restored(struct zigclip *zc, const struct payload *payload)
+{
+    const struct payload *restored = zc->source_payload;
+
+    return restored && restored->hash == payload->hash && restored->size == payload->size;
+}
+
+// Payload made it through the pipeline
+static void
+handle_payload_processed(void *data, struct payload *payload)
+{
+    struct zigclip *zc = data;
+    struct history_entry *entry = history_find(&zc->history, payload);
+
+    if (entry) {
+        entry->hits++;
+        zc->stats.duplicates++;
+    } else {
+        history_append(&zc->history, payload);
+        zc->stats.captures++;
+        zc->stats.bytes += payload->size;
+    }
+
+    // Reading back our own restored selection is not news either
+    if ((!entry || !(zc->flags & ZIGCLIP_DEDUP)) && !is_restored(zc, payload)) {
+        notify(zc, payload);
+    }
+    start_next_capture(zc);
+}
+
+static void
+handle_transfer_data(void *data, struct transfer *transfer, size_t offset, size_t len)
+{
+}
+
+static void
+handle_transfer_done(void *data, struct transfer *transfer, int error)
+{
+    struct zigclip *zc = data;
+    struct payload *payload = transfer->payload;
+
+    if (error || transfer->exceeded) {
+        zc->stats.failed++;
+        log_warn("capture %llu failed: %s", (unsigned long long)payload->seq,
+                 transfer->exceeded ? transfer_limit_name(transfer->exceeded) : strerror(error));
+    } else if (payload->size > 0) {
+        // Capacity was checked before the transfer started
+        pipeline_submit(zc->pipeline, payload);
+    }
+
+    transfer_destroy(transfer);
+    start_next_capture(zc);
+}
+
+static const struct transfer_handler transfer_handler = {
+    .data = handle_transfer_data,
+    .done = handle_transfer_done,
+};
+
+static void
+receive_capture(struct zigclip *zc, const struct pending_capture *capture)
+{
+    int pipefd[2];
+
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        log_warn("pipe: %s", strerror(errno));
+        return;
+    }
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    zwlr_data_control_offer_v1_receive(capture->offer->proxy, capture->mime_type, pipefd[1]);
+    close(pipefd[1]);
+    display_reader_flush(zc->reader);
+
+    struct payload *payload = payload_create(capture->mime_type);
+    if (!payload) {
+        log_warn("memfd_create: %s", strerror(errno));
+        close(pipefd[0]);
+        return;
+    }
+    payload->seq = ++zc->seq;
+    payload->timestamp_ns = capture->timestamp_ns;
+
+    if (!transfer_create(&zc->transfers, pipefd[0], payload, &zc->limits, &transfer_handler,
+                         zc)) {
+        log_warn("transfer: %s", strerror(errno));
+        payload_unref(payload);
+        close(pipefd[0]);
+    }
+}
+
+static void
+start_next_capture(struct zigclip *zc)
+{
+    // Same back pressure as the monitor: a running transfer needs a
+    // pipeline slot once it completes
+    while (zc->transfers.count < MAX_ACTIVE_TRANSFERS && zc->pending_count > 0 &&
+           pipeline_room(zc->pipeline) > zc->transfers.count) {
+        struct pending_capture capture = zc->pending[zc->pending_head];
+        zc->pending_head = (zc->pending_head + 1) % MAX_PENDING_CAPTURES;
+        zc->pending_count--;
+
+        receive_capture(zc, &capture);
+        offer_destroy(capture.offer);
+    }
+}
+
+static const char *
+wanted_mime(struct zigclip *zc, const struct offer *offer)
+{
+    for (int i = 0; i < zc->mime_count; i++) {
+        if (offer_has_mime(offer, zc->mime_types[i])) {
+            return zc->mime_types[i];
+        }
+    }
+    return NULL;
+}
+
+// A selection made it through coalescing
+static void
+handle_selection_due(void *data, void *item, uint64_t timestamp_ns)
+{
+    struct zigclip *zc = data;
+    struct offer *offer = item;
+    const char *mime_type = wanted_mime(zc, offer);
+
+    if (!mime_type) {
+        zc->stats.unsupported++;
+        offer_destroy(offer);
+        return;
+    }
+
+    if (zc->pending_count == MAX_PENDING_CAPTURES) {
+        // Falling this far behind, the oldest selection is the least useful
+        offer_destroy(zc->pending[zc->pending_head].offer);
+        zc->pending_head = (zc->pending_head + 1) % MAX_PENDING_CAPTURES;
+        zc->pending_count--;
+        zc->stats.coalesced++;
+    }
+    struct pending_capture *capture =
+        &zc->pending[(zc->pending_head + zc->pending_count) % MAX_PENDING_CAPTURES];
+    capture->offer = offer;
+    capture->timestamp_ns = timestamp_ns;
+    snprintf(capture->mime_type, sizeof(capture->mime_type), "%s", mime_type);
+    zc->pending_count++;
+
+    start_next_capture(zc);
+}
+
+static void
+discard_selection(void *data, void *item)
+{
+    struct zigclip *zc = data;
+
+    zc->stats.coalesced++;
+    offer_destroy(item);
+}
+
+static const struct coalesce_handler coalesce_handler = {
+    .fire = handle_selection_due,
+    .discard = discard_selection,
+};
+
+static void
+data_device_data_offer(void *data, struct zwlr_data_control_device_v1 *device,
+                       struct zwlr_data_control_offer_v1 *offer)
+{
+    struct zigclip *zc = data;
+    offer_create(&zc->offers, offer);
+}
+
+static void
+data_device_selection(void *data, struct zwlr_data_control_device_v1 *device,
+                      struct zwlr_data_control_offer_v1 *proxy)
+{
+    struct zigclip *zc = data;
+    struct offer *offer = proxy ? offer_from_proxy(proxy) : NULL;
+
+    if (offer) {
+        offer_select(offer);
+        zc->stats.selections++;
+        coalescer_push(&zc->coalescer, offer, clock_ns(CLOCK_REALTIME));
+    }
+}
+
+static void
+data_device_finished(void *data, struct zwlr_data_control_device_v1 *device)
+{
+    struct zigclip *zc = data;
+
+    log_info("Data device finished");
+    zc->failed = true;
+}
+
+static const struct zwlr_data_control_device_v1_listener data_device_listener = {
+    .data_offer = data_device_data_offer,
+    .selection = data_device_selection,
+    .primary_selection = NULL,
+    .finished = data_device_finished,
+};
+
+static void
+finish_write(struct restore_write *out)
+{
+    struct restore_write **link = &out->zc->writes;
+
+    while (*link != out) {
+        link = &(*link)->next;
+    }
+    *link = out->next;
+    event_source_remove(out->source);
+    close(out->fd);
+    payload_unref(out->payload);
+    mem_free(MEM_TRANSFER, out);
+}
+
+// A reader closing early must not kill the host with SIGPIPE, and a
+// library has no business changing its disposition
+static ssize_t
+write_nosignal(int fd, const void *buf, size_t len)
+{
+    sigset_t pipe_signal, old_mask;
+
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_signal, &old_mask);
+
+    ssize_t n = write(fd, buf, len);
+    if (n == -1 && errno == EPIPE) {
+        // Take the signal this write raised, unless one was pending already
+        sigset_t pending;
+        sigpending(&pending);
+        if (!sigismember(&old_mask, SIGPIPE) && sigismember(&pending, SIGPIPE)) {
+            struct timespec zero = { 0 };
+            sigtimedwait(&pipe_signal, NULL, &zero);
+        }
+        errno = EPIPE;
+    }
+    int saved = errno;
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    errno = saved;
+    return n;
+}
+
+static void
+handle_write_ready(void *data, int fd, uint32_t mask)
+{
+    struct restore_write *out = data;
+    const struct payload *payload = out->payload;
+
+    while (out->offset < payload->size) {
+        ssize_t n = write_nosignal(fd, (const char *)payload->data + out->offset,
+                                   payload->size - out->offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN) {
+            return;
+        }
+        if (n <= 0) {
+            break; // The reader went away
+        }
+        out->offset += n;
+    }
+    finish_write(out);
+}
+
+static void
+source_send(void *data, struct zwlr_data_control_source_v1 *source, const char *mime_type,
+            int32_t fd)
+{
+    struct zigclip *zc = data;
+    struct restore_write *out = mem_calloc(MEM_TRANSFER, 1, sizeof(*out));
+
+    if (!out || zc->source != source) {
+        mem_free(MEM_TRANSFER, out);
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    out->zc = zc;
+    out->fd = fd;
+    out->payload = payload_ref(zc->source_payload);
+    out->source = event_loop_add_fd(zc->loop, fd, EVENT_LOOP_WRITABLE, handle_write_ready, out);
+    if (!out->source) {
+        close(fd);
+        payload_unref(out->payload);
+        mem_free(MEM_TRANSFER, out);
+        return;
+    }
+    out->next = zc->writes;
+    zc->writes = out;
+}
+
+static void
+drop_source(struct zigclip *zc)
+{
+    if (zc->source) {
+        zwlr_data_control_source_v1_destroy(zc->source);
+        payload_unref(zc->source_payload);
+        zc->source = NULL;
+        zc->source_payload = NULL;
+    }
+}
+
+// Someone else took the selection
+static void
+source_cancelled(void *data, struct zwlr_data_control_source_v1 *source)
+{
+    struct zigclip *zc = data;
+
+    if (source == zc->source) {
+        drop_source(zc);
+    } else {
+        zwlr_data_control_source_v1_destroy(source);
+    }
+}
+
+static const struct zwlr_data_control_source_v1_listener source_listener = {
+    .send = source_send,
+    .cancelled = source_cancelled,
+};
+
+static void
+seat_capabilities(void *data, struct wl_seat *seat, uint32_t capabilities)
+{
+}
+
+static const struct wl_seat_listener seat_listener = {
+    .capabilities = seat_capabilities,
+    .name = NULL,
+};
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry, uint32_t id,
+                       const char *interface, uint32_t version)
+{
+    struct zigclip *zc = data;
+
+    if (strcmp(interface, wl_seat_interface.name) == 0 && !zc->seat) {
+        zc->seat = wl_registry_bind(registry, id, &wl_seat_interface, 1);
+        wl_seat_add_listener(zc->seat, &seat_listener, zc);
+    } else if (strcmp(interface, zwlr_data_control_manager_v1_interface.name) == 0 &&
+               !zc->manager) {
+        zc->manager = wl_registry_bind(registry, id, &zwlr_data_control_manager_v1_interface, 1);
+    }
+}
+
+static void
+registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_handle_global,
+    .global_remove = registry_handle_global_remove,
+};
+
+// The reader thread queued new events
+static void
+handle_display_events(void *data)
+{
+    struct zigclip *zc = data;
+
+    int error;
+    if (display_reader_failed(zc->reader)) {
+        error = display_reader_error(zc->reader);
+    } else if (wl_display_dispatch_queue_pending(zc->display, zc->queue) == -1) {
+        error = errno;
+    } else {
+        display_reader_flush(zc->reader);
+        return;
+    }
+    if (!zc->failed) {
+        log_error("Error in dispatch: %s", strerror(error));
+    }
+    zc->failed = true;
+}
+
+static int
+copy_mime_types(struct zigclip *zc, const char *const *mime_types)
+{
+    int count = 0;
+
+    while (mime_types[count]) {
+        count++;
+    }
+    zc->mime_types = mem_calloc(MEM_OFFER, count, sizeof(*zc->mime_types));
+    if (count && !zc->mime_types) {
+        return -1;
+    }
+    for (; zc->mime_count < count; zc->mime_count++) {
+        zc->mime_types[zc->mime_count] = mem_strdup(MEM_OFFER, mime_types[zc->mime_count]);
+        if (!zc->mime_types[zc->mime_count]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Proxy made from proxy lives on the private queue from its first event on
+static void *
+on_queue(struct zigclip *zc, void *proxy)
+{
+    void *wrapper = wl_proxy_create_wrapper(proxy);
+
+    if (wrapper) {
+        wl_proxy_set_queue(wrapper, zc->queue);
+    }
+    return wrapper;
+}
+
+uint32_t
+zigclip_abi_version(void)
+{
+    return ZIGCLIP_ABI_VERSION;
+}
+
+struct zigclip *
+zigclip_connect(const char *display, const struct zigclip_options *options)
+{
+    struct zigclip_options defaults = { .size = sizeof(defaults), .workers = -1 };
+    struct zigclip *zc = mem_calloc(MEM_LOOP, 1, sizeof(*zc));
+    int error = ENOMEM;
+
+    if (!zc) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // Fields an older caller does not know about keep their defaults
+    if (options) {
+        memcpy(&defaults, options,
+               options->size < sizeof(defaults) ? options->size : sizeof(defaults));
+    }
+    options = &defaults;
+
+    offer_manager_init(&zc->offers);
+    zc->flags = options->flags;
+    zc->limits.first_byte_ns = (options->first_byte_ms ? options->first_byte_ms : 5000) * 1000000ull;
+    zc->limits.total_ns = (options->total_ms ? options->total_ms : 60000) * 1000000ull;
+    zc->limits.max_bytes = options->max_bytes;
+    if (copy_mime_types(zc, options->mime_types ? options->mime_types : default_mime_types) == -1) {
+        goto fail;
+    }
+
+    zc->display = wl_display_connect(display);
+    if (!zc->display) {
+        error = errno ? errno : ECONNREFUSED;
+        goto fail;
+    }
+    zc->registry = wl_display_get_registry(zc->display);
+    wl_registry_add_listener(zc->registry, &registry_listener, zc);
+    if (wl_display_roundtrip(zc->display) == -1) {
+        error = wl_display_get_error(zc->display);
+        goto fail;
+    }
+    if (!zc->seat || !zc->manager) {
+        error = EPROTONOSUPPORT;
+        goto fail;
+    }
+
+    zc->queue = wl_display_create_queue(zc->display);
+    struct zwlr_data_control_manager_v1 *manager = on_queue(zc, zc->manager);
+    if (!zc->queue || !manager) {
+        goto fail;
+    }
+    zc->device = zwlr_data_control_manager_v1_get_data_device(manager, zc->seat);
+    wl_proxy_wrapper_destroy(manager);
+    zwlr_data_control_device_v1_add_listener(zc->device, &data_device_listener, zc);
+
+    zc->loop = event_loop_create();
+    if (!zc->loop ||
+        history_init(&zc->history, options->history > 0 ? options->history : DEFAULT_HISTORY) == -1) {
+        goto fail;
+    }
+    int workers = options->workers < 0 ? pipeline_default_workers() : options->workers;
+    zc->pipeline = pipeline_create(zc->loop, workers, handle_payload_processed, zc);
+    if (!zc->pipeline) {
+        error = errno;
+        goto fail;
+    }
+    uint64_t coalesce_ns = options->coalesce_ms * 1000000ull;
+    if (coalescer_init(&zc->coalescer, zc->loop, coalesce_ns, coalesce_ns * 5,
+                       &coalesce_handler, zc) == -1 ||
+        timer_wheel_init(&zc->wheel, zc->loop, TIMER_TICK_NS) == -1) {
+        error = errno;
+        goto fail;
+    }
+    transfer_manager_init(&zc->transfers, zc->loop, &zc->wheel);
+
+    zc->reader = display_reader_start(zc->display, zc->loop, handle_display_events, zc);
+    if (!zc->reader) {
+        error = errno;
+        goto fail;
+    }
+    handle_display_events(zc); // Anything queued before the thread ran
+    return zc;
+
+fail:
+    zigclip_disconnect(zc);
+    errno = error;
+    return NULL;
+}
+
+void
+zigclip_disconnect(struct zigclip *zc)
+{
+    if (!zc) {
+        return;
+    }
+
+    display_reader_stop(zc->reader);
+    coalescer_finish(&zc->coalescer);
+    for (int i = 0; i < zc->pending_count; i++) {
+        offer_destroy(zc->pending[(zc->pending_head + i) % MAX_PENDING_CAPTURES].offer);
+    }
+    offer_manager_finish(&zc->offers);
+    if (zc->transfers.loop) {
+        transfer_manager_finish(&zc->transfers);
+    }
+    timer_wheel_finish(&zc->wheel);
+    pipeline_destroy(zc->pipeline);
+    history_finish(&zc->history);
+    while (zc->writes) {
+        finish_write(zc->writes);
+    }
+    drop_source(zc);
+    if (zc->loop)
+        event_loop_destroy(zc->loop);
+    if (zc->device)
+        zwlr_data_control_device_v1_destroy(zc->device);
+    if (zc->queue)
+        wl_event_queue_destroy(zc->queue);
+    if (zc->manager)
+        zwlr_data_control_manager_v1_destroy(zc->manager);
+    if (zc->seat)
+        wl_seat_destroy(zc->seat);
+    if (zc->registry)
+        wl_registry_destroy(zc->registry);
+    if (zc->display)
+        wl_display_disconnect(zc->display);
+
+    for (int i = 0; i < zc->mime_count; i++) {
+        mem_free(MEM_OFFER, zc->mime_types[i]);
+    }
+    mem_free(MEM_OFFER, zc->mime_types);
+    mem_free(MEM_LOOP, zc);
+}
+
+int
+zigclip_get_fd(struct zigclip *zc)
+{
+    return event_loop_get_fd(zc->loop);
+}
+
+int
+zigclip_dispatch(struct zigclip *zc, int timeout_ms)
+{
+    if (!zc->failed && event_loop_dispatch(zc->loop, timeout_ms) == -1) {
+        zc->failed = true;
+    }
+    return zc->failed ? -1 : 0;
+}
+
+int
+zigclip_subscribe(struct zigclip *zc, zigclip_callback_t callback, void *data)
+{
+    for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+        if (!zc->subscribers[i].callback) {
+            zc->subscribers[i].callback = callback;
+            zc->subscribers[i].data = data;
+            return i + 1;
+        }
+    }
+    errno = ENOSPC;
+    return -1;
+}
+
+void
+zigclip_unsubscribe(struct zigclip *zc, int id)
+{
+    if (id > 0 && id <= MAX_SUBSCRIBERS) {
+        zc->subscribers[id - 1].callback = NULL;
+        zc->subscribers[id - 1].data = NULL;
+    }
+}
+
+int
+zigclip_get_entry(struct zigclip *zc, int age, struct zigclip_entry *entry)
+{
+    struct history_entry *found = age >= 0 ? history_get(&zc->history, age) : NULL;
+
+    if (!found) {
+        errno = ENOENT;
+        return -1;
+    }
+    fill_entry(entry, found->payload);
+    return 0;
+}
+
+int
+zigclip_get_current(struct zigclip *zc, struct zigclip_entry *entry)
+{
+    return zigclip_get_entry(zc, 0, entry);
+}
+
+int
+zigclip_restore(struct zigclip *zc, uint64_t seq)
+{
+    struct payload *payload = NULL;
+
+    for (int age = 0; age < zc->history.count; age++) {
+        struct history_entry *entry = history_get(&zc->history, age);
+        if (entry->payload->seq == seq) {
+            payload = entry->payload;
+            break;
+        }
+    }
+    if (!payload) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    struct zwlr_data_control_manager_v1 *manager = on_queue(zc, zc->manager);
+    if (!manager) {
+        errno = ENOMEM;
+        return -1;
+    }
+    struct zwlr_data_control_source_v1 *source =
+        zwlr_data_control_manager_v1_create_data_source(manager);
+    wl_proxy_wrapper_destroy(manager);
+    zwlr_data_control_source_v1_add_listener(source, &source_listener, zc);
+
+    zwlr_data_control_source_v1_offer(source, payload->mime_type);
+    if (payload->utf8 && transfer_class_for_mime(payload->mime_type) == TRANSFER_CLASS_TEXT) {
+        for (size_t i = 0; i < sizeof(text_aliases) / sizeof(text_aliases[0]); i++) {
+            if (strcmp(text_aliases[i], payload->mime_type) != 0) {
+                zwlr_data_control_source_v1_offer(source, text_aliases[i]);
+            }
+        }
+    }
+
+    drop_source(zc);
+    zc->source = source;
+    zc->source_payload = payload_ref(payload);
+    zwlr_data_control_device_v1_set_selection(zc->device, source);
+    display_reader_flush(zc->reader);
+    zc->stats.restores++;
+    return 0;
+}
+
+void
+zigclip_get_stats(struct zigclip *zc, struct zigclip_stats *stats)
+{
+    struct zigclip_stats current = zc->stats;
+    size_t size = stats->size < sizeof(current) ? stats->size : sizeof(current);
+
+    current.size = size;
+    current.history_count = zc->history.count;
+    current.history_bytes = zc->history.bytes;
+    current.live_offers = offer_manager_live_count(&zc->offers);
+    memcpy(stats, &current, size);
+}
@@ -0,0 +1,256 @@
+/**
+ * Event trace decoder
+ *
+ * Renders a dump written by the monitor's -E trace (SIGUSR2 or exit) as
+ * one timeline over all threads, oldest event first:
+ *
+ *        time      delta  thread    event         object          detail
+ *     1.204331    +0.812  dispatch  receive       0x5581c2a0e2c0  seq=3 mime=text/plain
+ *
+ * Times are milliseconds since the first event still in the dump, deltas
+ * microseconds since the line before. -o follows a single offer or
+ * payload, the other events of its capture are usually easy to spot from
+ * there. -s prints the per-thread summary only.
+ *
+ *   cc -O2 -Isrc tools/trace-decode.c src/evtrace.c src/mem.c
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "evtrace.h"
+
+struct timeline_event {
+    struct evtrace_event event;
+    int thread;
+    size_t order; // Position in its thread's ring
+};
+
+struct trace_file {
+    struct evtrace_file_header header;
+    char **atoms;
+    struct evtrace_file_thread *threads;
+    struct timeline_event *events;
+    size_t event_count;
+};
+
+static bool
+read_exact(FILE *file, void *buf, size_t len)
+{
+    return fread(buf, 1, len, file) == len;
+}
+
+static int
+load(FILE *file, struct trace_file *trace)
+{
+    struct evtrace_file_header *header = &trace->header;
+
+    if (!read_exact(file, header, sizeof(*header)) || header->magic != EVTRACE_MAGIC ||
+        header->version != EVTRACE_VERSION) {
+        return -1;
+    }
+
+    trace->atoms = calloc(header->atom_count + 1, sizeof(*trace->atoms));
+    trace->threads = calloc(header->thread_count, sizeof(*trace->threads));
+    if (!trace->atoms || (header->thread_count && !trace->threads)) {
+        return -1;
+    }
+    trace->atoms[0] = "";
+    for (uint32_t i = 1; i <= header->atom_count; i++) {
+        uint16_t len;
+        if (!read_exact(file, &len, sizeof(len)) || !(trace->atoms[i] = calloc(1, len + 1)) ||
+            !read_exact(file, trace->atoms[i], len)) {
+            return -1;
+        }
+    }
+
+    size_t capacity = 0;
+    for (int t = 0; t < header->thread_count; t++) {
+        struct evtrace_file_thread *thread = &trace->threads[t];
+        if (!read_exact(file, thread, sizeof(*thread))) {
+            return -1;
+        }
+        thread->name[sizeof(thread->name) - 1] = '\0';
+        if (trace->event_count + thread->count > capacity) {
+            capacity = (trace->event_count + thread->count) * 2;
+            struct timeline_event *grown = realloc(trace->events, capacity * sizeof(*grown));
+            if (!grown) {
+                return -1;
+            }
+            trace->events = grown;
+        }
+        for (uint64_t i = 0; i < thread->count; i++) {
+            struct timeline_event *event = &trace->events[trace->event_count++];
+            if (!read_exact(file, &event->event, sizeof(event->event))) {
+                return -1;
+            }
+            event->thread = t;
+            event->order = i;
+        }
+    }
+    return 0;
+}
+
+// Oldest first; events of one thread keep their order on equal ticks
+static int
+compare_events(const void *a, const void *b)
+{
+    const struct timeline_event *x = a, *y = b;
+
+    if (x->event.ticks != y->event.ticks) {
+        return x->event.ticks < y->event.ticks ? -1 : 1;
+    }
+    if (x->thread != y->thread) {
+        return x->thread - y->thread;
+    }
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static const char *
+atom_name(const struct trace_file *trace, uint32_t atom)
+{
+    return atom <= trace->header.atom_count ? trace->atoms[atom] : "?";
+}
+
+static void
+print_detail(const struct trace_file *trace, const struct evtrace_event *event)
+{
+    unsigned long long arg = event->arg;
+    const char *mime = atom_name(trace, event->atom);
+
+    switch (event->id) {
+        case EVTRACE_OFFER_MIME:
+            printf("mime=%s", mime);
+            break;
+        case EVTRACE_SELECTION:
+            if (event->ptr) {
+                printf("mimes=%llu", arg);
+            } else {
+                printf("cleared");
+            }
+            break;
+        case EVTRACE_FETCH:
+        case EVTRACE_RECEIVE:
+            printf("seq=%llu mime=%s", arg, mime);
+            break;
+        case EVTRACE_DATA:
+            printf("bytes=%llu", arg);
+            break;
+        case EVTRACE_DONE:
+        case EVTRACE_STAGES_BEGIN:
+            printf("size=%llu", arg);
+            break;
+        case EVTRACE_FAILED:
+            printf("error=%llu", arg);
+            break;
+        case EVTRACE_STAGES_END:
+            printf("hash=%016llx", arg);
+            break;
+        case EVTRACE_PROCESSED:
+            printf("seq=%llu", arg);
+            break;
+        case EVTRACE_OUTPUT:
+            printf("accepted=%llu", arg);
+            break;
+        default:
+            break;
+    }
+}
+
+static void
+print_summary(const struct trace_file *trace)
+{
+    printf("tick rate %.3f MHz, %u atoms, %zu events\n",
+           trace->header.ticks_per_sec / 1e6, trace->header.atom_count, trace->event_count);
+    for (int t = 0; t < trace->header.thread_count; t++) {
+        const struct evtrace_file_thread *thread = &trace->threads[t];
+        printf("  %-16s %10llu events, %llu overwritten\n", thread->name,
+               (unsigned long long)thread->count, (unsigned long long)thread->lost);
+    }
+}
+
+static void
+print_timeline(const struct trace_file *trace, uint64_t object)
+{
+    double ns_per_tick = 1e9 / (trace->header.ticks_per_sec ? trace->header.ticks_per_sec : 1);
+    uint64_t first = trace->event_count ? trace->events[0].event.ticks : 0;
+    uint64_t previous = first;
+
+    printf("%12s %10s  %-9s %-13s %-16s %s\n", "time", "delta", "thread", "event", "object",
+           "detail");
+    for (size_t i = 0; i < trace->event_count; i++) {
+        const struct evtrace_event *event = &trace->events[i].event;
+        if (object && event->ptr != object) {
+            continue;
+        }
+        printf("%12.6f %+10.3f  %-9s %-13s ", (event->ticks - first) * ns_per_tick / 1e6,
+               (event->ticks - previous) * ns_per_tick / 1e3,
+               trace->threads[trace->events[i].thread].name, evtrace_id_name(event->id));
+        if (event->ptr) {
+            printf("%#-16llx ", (unsigned long long)event->ptr);
+        } else {
+            printf("%-16s ", "-");
+        }
+        print_detail(trace, event);
+        printf("\n");
+        previous = event->ticks;
+    }
+}
+
+static void
+usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [-s] [-o ADDRESS] FILE\n", program_name);
+    fprintf(stderr, "  -o ADDRESS  Only events of this offer or payload\n");
+    fprintf(stderr, "  -s          Per-thread summary only\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    struct trace_file trace = { 0 };
+    uint64_t object = 0;
+    bool summary_only = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:s")) != -1) {
+        switch (opt) {
+            case 'o':
+                object = strtoull(optarg, NULL, 16);
+                break;
+            case 's':
+                summary_only = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[optind], "re");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (load(file, &trace) == -1) {
+        fprintf(stderr, "%s: not a complete event trace\n", argv[optind]);
+        return 1;
+    }
+    fclose(file);
+
+    qsort(trace.events, trace.event_count, sizeof(*trace.events), compare_events);
+    print_summary(&trace);
+    if (!summary_only) {
+        printf("\n");
+        print_timeline(&trace, object);
+    }
+    return 0;
+}